@@ -1,7 +1,21 @@
 ; Demo Program - using timer interrupts.
 ; Written for ADuC841 evaluation board, with UCD extras.
-; Generates a square wave on P3.6.
+; Generates a square wave on P3.6, or with switch 7 on, a sine or
+; arbitrary wave on DAC0 by direct digital synthesis (DDS).
 ; Brian Mulkeen, September 2016
+;
+; Switches on P2:
+;   2:0  frequency, from the SIG_FREQS_HZ list in tools/tables_config.h
+;   5:3  DDS only - adds 0 to 7 fine steps of SIG_DDS_FINE_HZ
+;   6    DDS only - 0 = sine, 1 = arbitrary table ARB
+;   7    0 = square wave on P3.6, 1 = DDS on DAC0
+;
+; DDS: Timer 2 overflows at a fixed rate (DDS_RELOAD, 256 cycles, 43.2 kHz)
+; and each overflow adds a 24-bit increment to the phase.  The top byte of
+; the phase indexes a 256-entry wave table.  Frequency = increment * rate / 2^24,
+; so the step is 0.0026 Hz; the switches select from the generated
+; DDS_COARSE and DDS_FINE increments, which are added in the main loop.
+; Timer 2 reload and increment are written only when the switches change.
 
 ; Include the ADuC841 SFR definitions
 $NOMOD51
@@ -10,6 +24,20 @@ $INCLUDE (MOD841)
 SOUND	EQU  	P3.6		; P3.6 will drive a transducer
 LED		EQU		P3.4		; P3.4 is red LED on eval board
 
+BLINK	BIT		20h.0		; LED flashing, toggled by INT0 (was the carry flag, which the arithmetic below uses)
+DDS_ON	BIT		20h.1		; Timer 2 interrupt runs DDS instead of the square wave
+PHASE0	DATA	30h			; 24-bit phase accumulator, low byte
+PHASE1	DATA	31h
+PHASE2	DATA	32h			; top byte indexes the wave table
+INC0	DATA	33h			; 24-bit phase increment, written by main loop with ET2 clear
+INC1	DATA	34h
+INC2	DATA	35h
+WAVEL	DATA	36h			; wave table address
+WAVEH	DATA	37h
+NEXT	DATA	38h			; sample for the next overflow
+LASTSW	DATA	39h			; switches the outputs were last set for
+				; stack starts at 08h, below 20h: at most 10 bytes (DELAY call, INT0, Timer 2)
+
 CSEG
 		ORG		0000h		; set origin at start of code segment
 		JMP		MAIN		; jump to start of main program
@@ -21,8 +49,8 @@ CSEG
 		JMP		INT0ISR		; jump to interrupt service routine
 
 		ORG		0060h		; set origin above interrupt addresses*/	
-		LOWER: DB 66h, 33h, 0CDh, 09Ah, 0AEh, 066h, 0EAh, 04Dh           ;Storing RCAP2L values in a lookup table
-		HIGHER: DB 0EAh, 0F5h, 0F8h, 0FAh, 0FBh, 0FCh, 0FCh, 0FDh		 ;Storing RCAP2H values in a lookup table
+		; RCAP2L values in LOWER, RCAP2H values in HIGHER, DDS increments and wave tables, generated from tools/tables_config.h by tools/gen_tables.c
+$INCLUDE (sig_tables.inc)
 		LED_table:	DB 0FEh, 0FDh, 0FBh, 0F7h, 0EFh, 0DFh, 0BFh, 7Fh	 ;Storing LED values in a lookup table
 MAIN:	
 ; ------ Setup part - happens once only ----------------------------
@@ -30,41 +58,122 @@ MAIN:
 		MOV P2, A     ;P2 set as input port to read values from the switches
 		;Timer 2 configuration to create the signal wave
 		MOV	T2CON, #00h	 ; Timer 2 as a timer
+		MOV DACCON, #0ADh  ; DAC0 on, 8-bit mode in DAC0L, 0 to AVdd range, updated as written
+		CLR DDS_ON       ; square wave until the switches say otherwise, RAM is not cleared at reset
+		MOV NEXT, #80h   ; mid scale
+		MOV PHASE0, #0
+		MOV PHASE1, #0
+		MOV PHASE2, #0
+		MOV A, P2
+		CPL A
+		MOV LASTSW, A    ; not the switches, so the first pass of the loop sets everything up
+		MOV IP, #20h    ; Timer 2 interrupt set as high priority, external interrupt 0 is low priority so it doesn't interfere with the signal
 		SETB EA          ;Enable all interrupts
 		SETB ET2         ;Enable timer 2 interrupt
 		SETB TR2	     ; start Timer 2
-		MOV IP, 20h     ; Timer 2 interrupt set as high priority, external interrupt 0 is low priority so it doesn't interfere with the signal
 		
 		;External interrupt 0 to turn LED ON/OFF if INT0 is pressed
 		SETB IT0        ;Interrupt on a 1- to-0 transition
 		SETB EX0	    ; enable External interrupt 0
-		SETB C          ; used to keep the flashing LED OFF if the button was pressed or otherwise continue flashing
+		SETB BLINK      ; used to keep the flashing LED OFF if the button was pressed or otherwise continue flashing
 		
 ; ------ Loop forever -------------
 LOOP:	
-		JNC LOW_func     ;if the INT0 button was pressed C will be 0 and the following 2 commands will not be executed, keeping P3.4 OFF
+		JNB BLINK, SW_func  ;if the INT0 button was pressed BLINK will be 0 and the following 2 commands will not be executed, keeping P3.4 OFF
 		CPL LED          ;toggles the state of the LED
 		CALL DELAY       ;blinks LED on P3.4
-		LOW_func:	         ;set low reload values
+		SW_func:             ; outputs change only when the switches do
 		MOV A, P2            ; reads switch values from P2
+		CJNE A, LASTSW, NEW_SW
+		JMP LOOP
+NEW_SW:	MOV LASTSW, A
+		JB ACC.7, DDS_func   ; switch 7 selects DDS
+		LOW_func:	         ;set low reload values
+		CLR DDS_ON           ; Timer 2 interrupt back to the square wave
 		ANL A, #07h          ; ANDs the switch value with 00000111 to eliminate switchs 4-8, by making them 0s
 		MOV DPTR, #LOWER      ; gets address of first value from look up table LOWER and saves in the pointer DPTR 
 		MOVC A, @A + DPTR     ; Offsets 1st address by the value of the switch
 		MOV RCAP2L, A  		  ; Saves the offset value into the RCAP2L register
 		HIGH_func:            ;sets high reload values
-		MOV A, P2			  ; reads switch values from P2
+		MOV A, LASTSW		  ; switch values read above
 		ANL A, #07h			  ; ANDs the switch value with 00000111 to eliminate switchs 4-8, by making them 0s
 		MOV DPTR, #HIGHER     ; gets address of first value from look up table HIGHER and saves in the pointer DPTR
 		MOVC A, @A + DPTR     ; Offsets 1st address by the value of the switch
 		MOV RCAP2H, A         ; Saves the offset value into the RCAP2H register
 		LED_func:             ; sets LEDs on P0
-		MOV A, P2             ;AS before with the LED_table look-up table
+		MOV A, LASTSW         ;AS before with the LED_table look-up table
 		ANL A, #07h  
 		MOV DPTR, #LED_table
 		MOVC A, @A + DPTR
 		MOV P0, A
 		
 		JMP	LOOP
+
+DDS_func:	; increment = DDS_COARSE[switches 2:0] + DDS_FINE[switches 5:3], 3 bytes each, low byte first
+		ANL A, #07h
+		MOV B, #3
+		MUL AB
+		MOV R0, A             ; offset of the coarse entry
+		MOV A, LASTSW
+		ANL A, #38h           ; switches 5:3 are already the fine index x 8
+		RR A
+		RR A
+		RR A
+		MOV B, #3
+		MUL AB
+		MOV R1, A             ; offset of the fine entry
+		MOV DPTR, #DDS_COARSE
+		MOV A, R0
+		MOVC A, @A + DPTR
+		MOV R2, A
+		INC R0
+		MOV A, R0
+		MOVC A, @A + DPTR
+		MOV R3, A
+		INC R0
+		MOV A, R0
+		MOVC A, @A + DPTR
+		MOV R4, A             ; R4:R3:R2 = coarse increment
+		MOV DPTR, #DDS_FINE
+		MOV A, R1
+		MOVC A, @A + DPTR
+		ADD A, R2
+		MOV R2, A
+		INC R1
+		MOV A, R1
+		MOVC A, @A + DPTR
+		ADDC A, R3
+		MOV R3, A
+		INC R1
+		MOV A, R1
+		MOVC A, @A + DPTR
+		ADDC A, R4
+		MOV R4, A             ; R4:R3:R2 = coarse + fine
+		MOV R5, #LOW(SINE)
+		MOV R6, #HIGH(SINE)
+		MOV A, LASTSW
+		JNB ACC.6, DDS_set    ; switch 6 picks the arbitrary table
+		MOV R5, #LOW(ARB)
+		MOV R6, #HIGH(ARB)
+DDS_set:
+		CLR ET2               ; the interrupt must not see half an increment
+		MOV INC0, R2
+		MOV INC1, R3
+		MOV INC2, R4
+		MOV WAVEL, R5
+		MOV WAVEH, R6
+		JB DDS_ON, DDS_led    ; already running, the sample rate is unchanged
+		MOV RCAP2L, #DDS_RELOADL
+		MOV RCAP2H, #DDS_RELOADH
+		SETB DDS_ON
+DDS_led:
+		SETB ET2
+		MOV A, LASTSW         ; LEDs show the coarse setting, as for the square wave
+		ANL A, #07h
+		MOV DPTR, #LED_table
+		MOVC A, @A + DPTR
+		MOV P0, A
+		JMP LOOP
 		
 DELAY:	; delay for time R5 x 10 ms = 500 ms
 		MOV	R5, #50		; set number of repetitions for outer loop
@@ -77,16 +186,54 @@ DLY1:	MOV	R7, #255		; inner loop repeats 255 times
 
 	
 ; ------ Interrupt service routine ---------------------------------	
+; Cycle budget for DDS, in core clocks from the ADuC841 instruction timing:
+;   entry: up to 4 to finish the current instruction (MUL/DIV up to 9),
+;   3 for the hardware call and 4 for the JMP at 002Bh          11 (16 worst)
+;   JB to DDS and write of the sample prepared last time           7
+;   save PSW, ACC, DPL, DPH                                         8
+;   24-bit phase add                                               18
+;   table lookup and store of the next sample                      12
+;   restore, clear TF2 and RETI                                    14
+;   total 70 (75 worst) of the 256 between overflows, 27 % of the processor.
+; The square wave path is 4 cycles longer than before for the JB, the same every time.
+; DAC0L is written at a fixed point after entry, so the only jitter in the
+; output is in the entry latency, not in the arithmetic.
 TF2ISR:		; Timer 2 overflow interrupt service routine
+		JB	DDS_ON, DDS_ISR	; 4
 		CPL	SOUND		; change state of output pin
 		CLR TF2             ; clear flag
 		RETI				; return from interrupt
+DDS_ISR:
+		MOV	DAC0L, NEXT		; 3  sample computed in the previous interrupt
+		PUSH	PSW			; 2
+		PUSH	ACC			; 2
+		PUSH	DPL			; 2
+		PUSH	DPH			; 2
+		MOV	A, PHASE0		; 2  phase = phase + increment
+		ADD	A, INC0			; 2
+		MOV	PHASE0, A		; 2
+		MOV	A, PHASE1		; 2
+		ADDC	A, INC1		; 2
+		MOV	PHASE1, A		; 2
+		MOV	A, PHASE2		; 2
+		ADDC	A, INC2		; 2
+		MOV	PHASE2, A		; 2
+		MOV	DPL, WAVEL		; 3  top byte of phase indexes the table
+		MOV	DPH, WAVEH		; 3
+		MOVC	A, @A + DPTR	; 4  (uses the value of A left by the last add)
+		MOV	NEXT, A			; 2
+		POP	DPH				; 2
+		POP	DPL				; 2
+		POP	ACC				; 2
+		POP	PSW				; 2
+		CLR	TF2				; 2
+		RETI				; 4
 ; ------------------------------------------------------------------	
 ; ------ Interrupt service routine ---------------------------------	
 
 INT0ISR:		        ; Timer 0 overflow interrupt service routine
 		SETB	LED		; change state of output pin to OFF (LED is off when it's at state  = 1)
-		CPL C           ; Cahnge state of C so the LED will either remain OFF or start flashing until the button is pressed again causing another interrupt
+		CPL BLINK       ; Cahnge state of BLINK so the LED will either remain OFF or start flashing until the button is pressed again causing another interrupt
 		RETI				; return from interrupt
 		
 		
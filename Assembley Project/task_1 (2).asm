@@ -23,7 +23,7 @@ CSEG		; working in code segment - program memory
 
 		ORG	0000h		; starting at address 0
 WAVE:	CPL LED			; Toggle the LED on or off
-		MOV	A, #252		; the delay needs to be 508 cycles. since we can't fit that in A, 508-256=252
+		MOV	A, #252		; inner loop count, see DELAY
 		
  
 		CALL DELAY		; Call the delay subroutine
@@ -32,13 +32,14 @@ WAVE:	CPL LED			; Toggle the LED on or off
 ;____________________________________________________________________
 		; SUBROUTINES
 		
-		; This subroutine should take 508 cycles total
+		; Half period is 11059200 / 7200 = 1536 cycles: CPL 2 + MOV 2 + JMP (SJMP) 3
+		; + 1529 for DELAY including the CALL (ACALL) 3 and RET 4, measured with tools/sim841.c
 DELAY: 
-		MOV R7, #2		; This outer loop is to account for the overflow caused by 508
-DLY1:   MOV	R5, A		; set number of repetitions for inner loop. Happens twice
-		DJNZ R5, $		; Loop to same instruction. This happens A times (252)
-		DJNZ R7, DLY1	; Loop to DLY1. This happens twice
-		RET				; return from subroutine
+		MOV R7, #2		; 2  outer loop runs twice
+DLY1:   MOV	R5, A		; 1  set number of repetitions for inner loop
+		DJNZ R5, $		; 3  x 252 = 756, loop to same instruction A times
+		DJNZ R7, DLY1	; 3  so 2 x 760 = 1520 for both passes
+		RET				; 4  return from subroutine
 
 ;____________________________________________________________________
 
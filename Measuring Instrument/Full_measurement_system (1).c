@@ -1,11 +1,36 @@
 #include <ADUC841.H>
 #include "SigGenFunctions.h"
+#include "instrument_tables.h"                 // generated clock and ADC constants, see tools/gen_tables.c
 #define T1 0x01                                //T1 (P3.5) set as input
 #define LOW_HALF 0x0F                          // When changing TMOD for Timer 1, doesn't affect timer 0
-#define RESET_CONSTANT 1000		                 //Constant for how many adc readings to sample
+#define STAT_BLOCK 128                         // ADC readings per block, the step of the sliding window
+#define STAT_BLOCK_SHIFT 7
+#define STAT_BLOCKS 8                          // Blocks per window, 1024 readings = 0.506 s at 2023 readings a second
+#define STAT_BLOCKS_SHIFT 3
 #define LOW_BYTE 	0xFF		                     // mask to select lowest byte
 #define MODE_SELECT P2  
 #define LED_BANK P0
+#define MODE_FREQ 0x08                         // State key for frequency mode
+#define MODE_VOLT 0x01                         // State key for voltage mode, all statistics share it so switching between them is instant
+#define STAT_MEAN 0x01                         // Statistic switches P2.0 - P2.2
+#define STAT_MIN 0x02
+#define STAT_MAX 0x04
+#define STAT_P2P 0x06                          // min and max switches together give peak to peak
+#define STAT_RMS 0x03                          // mean and min switches together give RMS
+#define STAT_SLIDING 0x10                      // P2.4 set: results update every block instead of once per whole window
+#define STAT_RATE 0x07                         // all three statistic switches in scan mode: each channel's sample rate
+#define MODE_SCAN 0x20                         // State key for scan mode, P2.5 set: several ADC channels in turn
+#define SCAN_CYCLE 0x10                        // P2.4 in scan mode: show each channel in turn instead of the one on P2.7 - P2.6
+#define SCAN_SLOT_SHIFT 6
+#define SCAN_CYCLE_WINDOWS 8                   // Windows each channel is shown for when cycling
+#define MODE_NONE 0xFF                         // No mode entered yet, forces the first entry action
+#define FREQ_GATED 0                           // Count input edges in Timer 1 over a fixed gate - high frequencies
+#define FREQ_PERIOD 1                          // Time whole input periods with the Timer 2 capture - low frequencies
+#define UNIT_HZ 0x00                           // Units for Write_to_Display
+#define UNIT_KHZ 0x57                          // kHz and MHz are also the MAX7219 segment patterns of the prefix ('k')
+#define UNIT_MHZ 0x76                          // ('M')
+#define UNIT_MV 0x01
+#define UNIT_OVER 0xFF                         // frequency above every range, "Err" shown
 
 typedef unsigned char uint8;				// 8-bit unsigned integer
 typedef unsigned short int uint16;	// 16-bit unsigned integer
@@ -14,12 +39,75 @@ typedef unsigned long int uint32;	  // 16-bit unsigned integer
 // all other pins taken care of by the hardware
 sfr16 RCAP2 = 0xCA;                 //timer 2 reload set to address
 uint16 delayVal = 300;              // delay value for SPI 
-uint16 adc_data = 0;                // initialized so that the main loop can run even with no reading
 sbit LOAD = P3^0;                   //P3.0 will output to the Load input pin on the MAX display
-uint32 calculated_freq;             // Variable to hold the value of frequency to be displayed onto display. Set as uint32 to show that values exceeding the max limit will produce an error
-uint32 count_meas;                  // Averaged timer 1 signal edge count value. Set as uint32 to show that values exceeding the max limit will produce an error
+uint32 calculated_freq;             // Variable to hold the value of frequency to be displayed onto display, in Hz
+uint32 count_meas;                  // Timer 1 input edges counted in the last gate
+uint8 count_shift;                  // That gate was 2^count_shift Timer 2 overflows long
 uint8 display_write_flag;
+uint8 max_shadow[13];               // Copy of what the MAX display registers 0x00 - 0x0C currently hold
+uint8 display_tag = 0x0F;           // Leftmost digit in the Hz and mV layouts, blank or the channel being shown
+uint16 max_known = 0;               // One bit per register, set once the shadow copy is valid
+uint16 t2_overflows = 0;            // Timer 2 overflows in the current frequency gate
+uint8 gate_shift = GATE_MIN_SHIFT;  // Current gate is 2^gate_shift Timer 2 overflows, set by gate_range
+uint8 gate_restart = 0;             // Set to start counting afresh at the next Timer 2 overflow
+uint16 t1_high = 0;                 // Timer 1 overflows, upper 16 bits of the 32-bit edge count
+uint32 gate_start;                  // Edge count when the current gate started
+typedef struct {                    // Statistics of one block of ADC readings
+	uint32 sum;                       // sum of readings
+	uint32 sq_lo;                     // sum of squares kept as three partial products, see adc_interrupt
+	uint32 sq_mid;
+	uint16 sq_hi;
+	uint16 min;
+	uint16 max;
+} stat_block_t;
+stat_block_t xdata stat_ring[STAT_BLOCKS];  // Last STAT_BLOCKS completed blocks, in on-chip XRAM
+uint8 stat_head = 0;                // Ring slot the next completed block goes in
+uint8 stat_filled = 0;              // Completed blocks in the ring, up to STAT_BLOCKS
+uint8 stat_ready = 0;               // Set by the ADC interrupt when a block completes
+uint32 blk_sum;                     // Accumulators for the block being collected
+uint32 blk_sq_lo;
+uint32 blk_sq_mid;
+uint16 blk_sq_hi;
+uint16 blk_min;
+uint16 blk_max;
+uint8 blk_count;
+uint16 stat_mean = 0;               // Window results in ADC codes, written by stats_update
+uint16 stat_min = 0;
+uint16 stat_max = 0;
+uint16 stat_rms = 0;
+uint8 current_mode = MODE_NONE;     // Mode whose hardware set up is currently loaded
+uint8 freq_method = FREQ_GATED;     // How frequency is being measured
+uint16 t2_high = 0;                 // Timer 2 overflows, upper 16 bits of the capture time in period mode
+uint16 since_capture = 0;           // Timer 2 overflows since the last input edge
+uint32 period_start;                // Capture time of the first edge of the current measurement
+uint8 period_edges = 0;             // Periods timed in the current measurement, 0 = waiting for first edge
+uint8 period_started = 0;
+uint32 period_ticks;                // Result - clock cycles taken by period_count whole periods
+uint8 period_count;                 // Result - number of periods, 0 if no signal
 
+uint8 code scan_list[] = {0, 1, 2, 3};  // ADC channels converted in turn in scan mode, up to 8
+#define SCAN_N (sizeof(scan_list))
+#define SCAN_RATE_DHZ (ADC_RATE_DHZ / SCAN_N)  // readings of each channel in 10 s
+typedef struct {                    // Accumulators of one channel over a scan window, as stat_block_t
+	uint32 sum;
+	uint32 sq_lo;
+	uint32 sq_mid;
+	uint16 sq_hi;
+	uint16 min;
+	uint16 max;
+} scan_acc_t;
+scan_acc_t xdata scan_acc[2][SCAN_N];  // Two banks: the ISR fills one while the other holds the last complete window
+uint16 xdata scan_mean[SCAN_N];     // Window results in ADC codes, written by scan_update
+uint16 xdata scan_min[SCAN_N];
+uint16 xdata scan_max[SCAN_N];
+uint16 xdata scan_rms[SCAN_N];
+bit scan_on = 0;                    // ADC interrupt is scanning rather than keeping the single channel statistics
+uint8 scan_bank = 0;                // Bank the ADC interrupt is filling
+uint8 scan_pos = 0;                 // Position in scan_list of the conversion in progress
+uint8 scan_pass = 0;                // Readings of every channel so far in this window
+uint8 scan_ready = 0;               // Set by the ADC interrupt when a window completes
+uint8 scan_show = 0;                // Position in scan_list of the channel on the display
+uint8 scan_windows = 0;             // Windows the channel has been shown for, when cycling
 
 void SPI_init(void)                                  // Function to congigure the SPI 
 {                                         
@@ -41,20 +129,53 @@ void SPI_transmit(uint8 High_add, uint8 Low_data){   // Function for writing SPI
 	ISPI = 0;                                           // Resets the flag to 0
 	LOAD = 1;                                           // Load goes high to cause the data to be accepted by the display
 }
-void ADC_setup(void){
-	uint8 inputs;
-  inputs = MODE_SELECT & 0x07;
-																	// Set up timer 2 in timer mode, auto reload, no external control
-  TR1 = 0;             						//turn off timer 1, not needed for voltage
-	if (inputs == 0x01){ 						// Default mode, getting average
-		RCAP2 = 0xEAA6;    						//timer 2 reload value for 0.5 second refresh time
-	} 
-	else{
-		RCAP2 = 0x4B23;    						//timer 2 reload value for 5 seconds refresh time for min and max modes
+void MAX_write(uint8 reg_ad, uint8 reg_data){      // Sends a register to the MAX display only if its value has changed
+	if ((max_known & (1 << reg_ad)) && max_shadow[reg_ad] == reg_data){
+		return;                                          // display already shows this, no SPI traffic needed
 	}
+	SPI_transmit(reg_ad, reg_data);
+	max_shadow[reg_ad] = reg_data;
+	max_known |= 1 << reg_ad;
+}
+
+void bin_to_bcd(uint16 value, uint8 *digits){      // Double dabble: converts value to 5 BCD digits, digits[0] most significant, no division needed
+	uint8 bcd0 = 0, bcd1 = 0, bcd2 = 0;             // packed BCD: bcd2 = ten thousands, bcd1 = thousands/hundreds, bcd0 = tens/units
+	uint8 i;
+	for (i = 0; i < 16; i++){
+		// add 3 to any digit of 5 or more, so that the shift carries it into the next digit
+		if ((bcd0 & 0x0F) >= 0x05) bcd0 += 0x03;
+		if ((bcd0 & 0xF0) >= 0x50) bcd0 += 0x30;
+		if ((bcd1 & 0x0F) >= 0x05) bcd1 += 0x03;
+		if ((bcd1 & 0xF0) >= 0x50) bcd1 += 0x30;
+		if (bcd2 >= 0x05) bcd2 += 0x03;
+		// shift the whole register left one place, bringing in the next bit of value
+		bcd2 = (bcd2 << 1) | (bcd1 >> 7);
+		bcd1 = (bcd1 << 1) | (bcd0 >> 7);
+		bcd0 = (bcd0 << 1) | (uint8)(value >> 15);
+		value <<= 1;
+	}
+	digits[0] = bcd2;
+	digits[1] = bcd1 >> 4;
+	digits[2] = bcd1 & 0x0F;
+	digits[3] = bcd0 >> 4;
+	digits[4] = bcd0 & 0x0F;
+}
+
+void timer2_restart(void){                      // Restarts timer 2 from its reload value so the first period after a mode change is full length
+	TR2 = 0;
+	TH2 = RCAP2H;
+	TL2 = RCAP2L;
+	TF2 = 0;
+	TR2 = 1;
+}
+
+void ADC_setup(uint8 channel){
+																	// Set up timer 2 in timer mode, auto reload, no external control
+	RCAP2 = ADC_T2_RELOAD;    					//timer 2 reload value for 2023 conversions a second, one window every 0.5 seconds
+	CFG841 |= 0x01;                 // on-chip XRAM holds the statistics ring
 	EADC = 1;			       						//enable adc interrupt
 	ADCCON1 = 0x8E;      						// set up adccon1, adccon2
-	ADCCON2 = 0x10;
+	ADCCON2 = 0x10 | channel;       // first conversion now, Timer 2 starts the rest
 }
 
 void MAX_setup(void){
@@ -65,143 +186,472 @@ void MAX_setup(void){
 	uint8 Shutdown_reg_data = 0x01;
 	uint8 Shutdown_reg_ad = 0x0C;   		//D11-D8 set to 1100, D7 to D1 set to 0, D0 set to 1 for normal operation
 
-	SPI_transmit(Intensity_reg_ad, Intensity_reg_data);
-	SPI_transmit(Scan_reg_ad, Scan_reg_data);
-	SPI_transmit(Shutdown_reg_ad, Shutdown_reg_data);
+	MAX_write(Intensity_reg_ad, Intensity_reg_data);
+	MAX_write(Scan_reg_ad, Scan_reg_data);
+	MAX_write(Shutdown_reg_ad, Shutdown_reg_data);
+}
+
+void timer1 (void) interrupt 3        // Timer 1 overflow, extends the edge count to 32 bits
+{
+	t1_high++;                           // TF1 cleared by the hardware on entry
+}
+
+// Edge count as one 32-bit value, read without stopping the counter so no edges are lost.
+// Only called from timer2(), which Timer 1 cannot interrupt, so an overflow since
+// t1_high was last incremented shows up as TF1 still set.
+uint32 t1_count(void){
+	uint8 hi = TH1;
+	uint8 lo = TL1;
+	uint16 high = t1_high;
+	if (TH1 != hi){                      // TL1 carried into TH1 between the reads, so TL1 has just rolled over
+		hi = TH1;
+		lo = TL1;
+	}
+	if (TF1 && hi < 0x80) high++;        // overflow pending but happened before this read
+	return ((uint32)high << 16) | ((uint16)hi << 8) | lo;
+}
+
+uint8 gate_range(uint32 count, uint8 shift){  // Next gate: the shortest that still collects GATE_MIN_COUNT edges
+	while (shift > GATE_MIN_SHIFT && count >= 2 * GATE_MIN_COUNT){
+		shift--;                           // half the gate, half the edges, still enough
+		count >>= 1;
+	}
+	while (shift < GATE_MAX_SHIFT && count < GATE_MIN_COUNT){
+		shift++;
+		count <<= 1;
+	}
+	return shift;
 }
 
 void timer2 (void) interrupt 5        // interrupt vector at address 2Bh = 43 = 3 + 8n: n = 5 
 {
-	static uint16 overflow_count;      // Static retains the value between interrupts
-	overflow_count++;                  // total amount of cycles needed = 65536 * 85 interrupts = 5570560 (85 was calculated to be close to target of 0.5 seconds)
-	if (overflow_count == 85){         //(5570560)*(1/clock frequency) = 0.5037 is the total time between each averaged frequency being passed to main for display
-	count_meas = (TH1 << 8) | TL1;     // On the 85th interrupt the count value from Timer 1 is read and stored in count_meas, which is declared gloabaly and available in the main
-  //count_meas = 0x7D00;              // this mode is used to test hypothetically to see if a frequency out of range (above 65,536 Hz) will write "ERR" to the screen, as there is no high frequency option in the signal generator
-	TL1 = 0;                            
-	TH1 = 0;                           // Timer 1 count registers set back to 0
-	overflow_count = 0;                // 85 interrupts have occured and so overflow_count is reset to 0 to repeat the process
-	display_write_flag = 1;            //flag for writing to display in main. FLag means that the dispalay will only be written to once per frequency measurement, improving efficiency and use of the processor
+	if (freq_method == FREQ_PERIOD){     // Timer 2 free running, capturing into RCAP2 on each falling edge of T2EX
+		if (EXF2){
+			uint16 high = t2_high;
+			uint32 now;
+			if (TF2 && RCAP2H < 0x80) high++;  // overflow pending but happened before this capture
+			now = ((uint32)high << 16) | RCAP2;
+			EXF2 = 0;
+			since_capture = 0;
+			if (!period_started){
+				period_start = now;
+				period_edges = 0;
+				period_started = 1;
+			}
+			else{
+				period_edges++;
+				if (now - period_start >= PERIOD_GATE || period_edges == 255){  // enough whole periods for the required resolution
+					period_ticks = now - period_start;
+					period_count = period_edges;
+					period_start = now;
+					period_edges = 0;
+					display_write_flag = 1;
+				}
+			}
+		}
+		if (TF2){
+			TF2 = 0;
+			t2_high++;
+			if (++since_capture == PERIOD_TIMEOUT){  // no edges - signal stopped or too slow
+				period_count = 0;
+				period_started = 0;
+				display_write_flag = 1;
+			}
+		}
+		return;
 	}
-	else{
+	t2_overflows++;                    // each overflow is 65536 cycles, the gate is 2^gate_shift of them: 47 ms for fast signals up to 0.76 s for slow ones
+	if (gate_restart){                 // first gate after a mode change starts on an overflow
+		gate_start = t1_count();
+		t2_overflows = 0;
+		gate_restart = 0;
+	}
+	else if (t2_overflows == ((uint16)1 << gate_shift)){
+		uint32 now = t1_count();         // the counter keeps running, so one gate ends exactly where the next begins
+		count_meas = now - gate_start;   // edges in this gate, correct across a 32-bit wrap
+		count_shift = gate_shift;
+		gate_start = now;
+		t2_overflows = 0;
+		gate_shift = gate_range(count_meas, gate_shift);
+		display_write_flag = 1;            //flag for writing to display in main. FLag means that the dispalay will only be written to once per frequency measurement, improving efficiency and use of the processor
 	}
 	TF2 = 0;					               // clear Timer 2 interrupt flag
 }
 
 
-uint16 scale_voltage(uint32 input_volt){
+uint16 scale_voltage(uint16 input_volt){
     // Scale raw ADC input to a voltage
-    // 12 bit all 1 (4096) corresponds to 2500mV
-	input_volt = input_volt * 2500;
-	input_volt = input_volt/4096;
-	return input_volt; //returns in millivolts
+    // 12 bit all 1 (4096) corresponds to 2500mV, generated as a multiply and shift so there is no long division
+	return ((uint32)input_volt * ADC_MV_SCALE) >> ADC_MV_SHIFT; //returns in millivolts
 }
 
-void Write_to_Display(uint16 display_freq){
-	uint8 Data1_reg_data;                                  // Holds data to be sent to the 1st display register (same for registers below)
+void Write_to_Display(uint16 display_freq, uint8 dp_reg, uint8 unit){  // dp_reg is the digit register whose decimal point is lit, 0 for none; unit is a UNIT_ value
 	uint8 Data1_reg_ad = 0x01;                             // Address for 1st display register set (same for registers below)
-	uint8 Data2_reg_data;
 	uint8 Data2_reg_ad = 0x02;
-	uint8 Data3_reg_data;
 	uint8 Data3_reg_ad = 0x03;
-	uint8 Data7_reg_data;
 	uint8 Data7_reg_ad = 0x07;
-	uint8 Data8_reg_data;
 	uint8 Data8_reg_ad = 0x08;
+	uint8 Decode_reg_ad = 0x09;                            // D11-D8 set to 1001
 	uint8 reg_ad;
-	uint8 reg_data;
-	uint8 freq_mode = MODE_SELECT & 0x08; //this bit is 1 only if we are displaying frequencies. Else, voltage
+	uint8 digits[5];                                       // BCD digits of the value, digits[0] is ten thousands
 
-	uint16 data_bit_significance = (freq_mode) ? 10000 : 1000;                  // set as 10,000 as max frequency  to be displayed = 65536 Hz (same number of digits)
-	
-    Data8_reg_data = 0x0F;                                 //clears leftmost digit     
-	SPI_transmit(Data8_reg_ad, Data8_reg_data);            // Transmits data to the leftmort digit 
+	bin_to_bcd(display_freq, digits);                      // all digits at once, no divide or modulo
+	if (unit == UNIT_MV || unit == UNIT_HZ){
+		MAX_write(Data8_reg_ad, display_tag);                //leftmost digit blank, or the channel number
+	}
+	else if (unit == UNIT_OVER){
+		MAX_write(Data8_reg_ad, 0x0F);                       //clears leftmost digit     
+	}
 
-    if (!freq_mode){
+    if (unit == UNIT_MV){
         // Voltage display
-			uint8 Decode_reg_data = 0xFC;
-			uint8 Decode_reg_ad = 0x09;   // D11-D8 set to 1001, D7 - D2 set to 1 for decode mode, D1-D0 set to 0s, not in Decode mode
-			SPI_transmit(Decode_reg_ad, Decode_reg_data);
-    	Data7_reg_data = 0x0F;                        //clears second leftmost digit     
-    	SPI_transmit(Data7_reg_ad, Data7_reg_data);
-	    for(reg_ad = 0x06; reg_ad > 0x02; reg_ad--){          // for measurement values, digits 7-3
-	    	reg_data = display_freq/data_bit_significance;
-	    	SPI_transmit(reg_ad, reg_data);
-	    	display_freq %= data_bit_significance;
-	    	data_bit_significance /= 10; //TODO: this is a slow operation. May not be best way? Could also do a lookup of data_bit_significance values
+			MAX_write(Decode_reg_ad, 0xFC);                    // D7 - D2 set to 1 for decode mode, D1-D0 set to 0s, not in Decode mode
+    	MAX_write(Data7_reg_ad, 0x0F);                      //clears second leftmost digit     
+	    for(reg_ad = 0x06; reg_ad > 0x02; reg_ad--){          // for measurement values, digits 7-3: thousands down to units
+	    	MAX_write(reg_ad, digits[7 - reg_ad]);
 	    }
-		  Data2_reg_data = 0x6A;                              //write unit 'm'
-		SPI_transmit(Data2_reg_ad, Data2_reg_data);
-          
-		Data1_reg_data = 0x3E;                              //write unit 'V'
-		SPI_transmit(Data1_reg_ad, Data1_reg_data);
+		MAX_write(Data2_reg_ad, 0x6A);                        //write unit 'm'
+		MAX_write(Data1_reg_ad, 0x3E);                        //write unit 'V'
     } else{
         // Frequency display
-	    if(display_freq <= 0xEA60){                            // Limit set as freq = 60000 HZ. Error will be displayed if this is exceeded
-           uint8 Decode_reg_data = 0xFE;                          // Has to be included in case the display was previously showing an error and decode mode was switched off and then the frequency was put back in range
-           uint8 Decode_reg_ad = 0x09;                            // D11-D8 set to 1001, D7 - D1 set to 1 for everything in decode mode except D0
-           SPI_transmit(Decode_reg_ad, Decode_reg_data);
-           for(reg_ad = 0x07; reg_ad > 0x02; reg_ad--){             // Measurement value displayed on digits 7-3, where up to 5 digit numerical frequency will be written
-               reg_data = display_freq/data_bit_significance;       // Indiviual integer from each position of the frequency acquired
-               SPI_transmit(reg_ad, reg_data);                      // Integer transferred to be displayed
-               display_freq %= data_bit_significance;               // Modulo operation to remove the current first digit of the frequency, that has just been displayed
-               data_bit_significance /= 10;                         // variable reduced by a factor of 10 so the next highest order digit can be retrieved and displayed
+	    if(unit == UNIT_HZ){                                   // Hz, up to 65535
+           MAX_write(Decode_reg_ad, 0xFE);                     // D7 - D1 set to 1 for everything in decode mode except D0
+           for(reg_ad = 0x07; reg_ad > 0x02; reg_ad--){        // Measurement value displayed on digits 7-3, where up to 5 digit numerical frequency will be written
+               MAX_write(reg_ad, digits[7 - reg_ad] | ((reg_ad == dp_reg) ? 0x80 : 0));  // ten thousands down to units, D7 is the decimal point
            }
-
-           Data2_reg_data = 0x0C;                              // Write unit 'H'
-           SPI_transmit(Data2_reg_ad, Data2_reg_data);
-
-           Data1_reg_data = 0x6D;                              // Write unit 'Z'
-           SPI_transmit(Data1_reg_ad, Data1_reg_data);
+           MAX_write(Data2_reg_ad, 0x0C);                      // Write unit 'H'
+           MAX_write(Data1_reg_ad, 0x6D);                      // Write unit 'Z'
            display_write_flag = 0;                             // Flag prevents the display from updating until a new frequency is calculated
        }
+       else if(unit != UNIT_OVER){                           // kHz or MHz - five digits on 8-4, three unit letters on 3-1
+           MAX_write(Decode_reg_ad, 0xF8);                     // D7 - D3 in decode mode, D2 - D0 written as segments
+           for(reg_ad = 0x08; reg_ad > 0x03; reg_ad--){
+               MAX_write(reg_ad, digits[8 - reg_ad] | ((reg_ad == dp_reg) ? 0x80 : 0));
+           }
+           MAX_write(Data3_reg_ad, unit);                      // Write unit 'k' or 'M'
+           MAX_write(Data2_reg_ad, 0x37);                      // Write unit 'H', as segments this time
+           MAX_write(Data1_reg_ad, 0x6D);                      // Write unit 'Z'
+           display_write_flag = 0;
+       }
        else{                                                 //When the frequency is out of range "Err" is written to the screen
-           uint8 Decode_reg_data = 0xFC;
-           uint8 Decode_reg_ad = 0x09;                         // D11-D8 set to 1001, D7 - D2 in decode mode, D1 - D0 are 0s and not in decode mode
-           SPI_transmit(Decode_reg_ad, Decode_reg_data);
+           MAX_write(Decode_reg_ad, 0xFC);                     // D7 - D2 in decode mode, D1 - D0 are 0s and not in decode mode
            for(reg_ad = 0x07; reg_ad > 0x03; reg_ad--){          // Turn off digits 7 to 4, not needed
-               reg_data = 0x0F;                            
-               SPI_transmit(reg_ad, reg_data);
+               MAX_write(reg_ad, 0x0F);
            }
-           Data3_reg_data = 0x0B;                              //write unit 'E'
-           SPI_transmit(Data3_reg_ad, Data3_reg_data);
-	
-           Data2_reg_data = 0x05;                              //write unit 'r'
-           SPI_transmit(Data2_reg_ad, Data2_reg_data);
-
-           Data1_reg_data = 0x05;                              //write unit 'r'
-           SPI_transmit(Data1_reg_ad, Data1_reg_data);
+           MAX_write(Data3_reg_ad, 0x0B);                      //write unit 'E'
+           MAX_write(Data2_reg_ad, 0x05);                      //write unit 'r'
+           MAX_write(Data1_reg_ad, 0x05);                      //write unit 'r'
            display_write_flag = 0;                             //Display will not be updated until a new frequency is calculated
        }
     }
 }
 
-void adc_interrupt(void) interrupt 6{ 
-	static uint32 sum_of_voltages;
-	static uint16 counter = 0;
-	uint32 new_value = (ADCDATAH << 8) | ADCDATAL & 0x0FFF; //concat readings to single value. Also makes sure most significant 4 bits are 0
-    uint8 inputs;
-    inputs = MODE_SELECT & 0x07;
-	if (inputs == 0x01){                                    // Default mode, getting average
-		sum_of_voltages += new_value; 
-	} else if(inputs == 0x02){                              // Min mode, checking for lower value
-		if (counter == 0) sum_of_voltages = 0xFFF;            // Added as minimum wouldn't display anything because sum_of_voltages begins at 0 and will always remain the minimum and cause the display to be stuck at 0 mV
-		if (sum_of_voltages > new_value)
-			sum_of_voltages = new_value; 
-	} else if(inputs == 0x04){                              // Max mode, checking for higher value
-		if (sum_of_voltages < new_value)
-			sum_of_voltages = new_value;
-		
-	}
-    counter++;
-    if (counter >= RESET_CONSTANT){
-		if (inputs == 0x01){
-			sum_of_voltages = sum_of_voltages / counter;
+void stats_reset(void){                         // Empties the window, called with interrupts off
+	blk_sum = 0;
+	blk_sq_lo = 0;
+	blk_sq_mid = 0;
+	blk_sq_hi = 0;
+	blk_min = 0x0FFF;
+	blk_max = 0;
+	blk_count = 0;
+	stat_head = 0;
+	stat_filled = 0;
+	stat_ready = 0;
+}
+
+// Every statistic is kept at once, so the switches only choose what is shown.
+// Each reading v = hi*256 + lo is squared as hi*hi*65536 + 2*hi*lo*256 + lo*lo,
+// three 8 x 8 MUL AB instructions instead of a call to the long multiply.
+// Worst case, hand counted from the code C51 generates at these statements with
+// ADuC841 single-cycle core timing (MUL 9, MOVX 4, PUSH/POP 2, RETI 4 clocks):
+//   entry, register saves and restores, RETI                 about 60
+//   read, sum, 3 partial squares, min, max, count             about 150
+//   block end: copy 18 bytes to the XRAM ring, reset          about 240
+// so about 450 clocks (41 us) once every 128 readings and about 210 otherwise,
+// against 5466 clocks between conversions.
+// Scan mode keeps the same sums for each channel in scan_acc, indexed rather
+// than fixed addresses, so about 250 clocks.  There is no block end: the first
+// reading of a window overwrites the sums instead of adding to them, and a
+// finished window is handed over by switching banks, so every reading costs
+// the same whatever the number of channels.
+void adc_interrupt(void) interrupt 6{
+	uint8 hi = ADCDATAH & 0x0F;                              // most significant 4 bits hold the channel number, masked off
+	uint8 lo = ADCDATAL;
+	uint16 value = ((uint16)hi << 8) | lo;
+	if (scan_on){
+		scan_acc_t xdata *a = &scan_acc[scan_bank][scan_pos];
+		if (++scan_pos == SCAN_N) scan_pos = 0;
+		ADCCON2 = scan_list[scan_pos];                         // channel for the next conversion Timer 2 starts
+		if (scan_pass == 0){                                   // first reading of the window
+			a->sum = value;
+			a->sq_lo = (uint16)(lo * lo);
+			a->sq_mid = (uint16)(hi * lo);
+			a->sq_hi = (uint8)(hi * hi);
+			a->min = value;
+			a->max = value;
 		}
-        adc_data = sum_of_voltages;
-        counter = 0;
-        sum_of_voltages = 0;
-    }
-    TF2 = 0;                                              // reset timer2 overflow
+		else{
+			a->sum += value;
+			a->sq_lo += (uint16)(lo * lo);
+			a->sq_mid += (uint16)(hi * lo);
+			a->sq_hi += (uint8)(hi * hi);
+			if (value < a->min) a->min = value;
+			if (value > a->max) a->max = value;
+		}
+		if (scan_pos == 0 && ++scan_pass == STAT_BLOCK){      // every channel has a full window
+			scan_pass = 0;
+			scan_bank ^= 1;                                      // the window just filled becomes the results, nothing copied
+			scan_ready = 1;
+		}
+		TF2 = 0;                                              // reset timer2 overflow
+		return;
+	}
+	blk_sum += value;
+	blk_sq_lo += (uint16)(lo * lo);
+	blk_sq_mid += (uint16)(hi * lo);
+	blk_sq_hi += (uint8)(hi * hi);
+	if (value < blk_min) blk_min = value;
+	if (value > blk_max) blk_max = value;
+	if (++blk_count == STAT_BLOCK){                          // block complete - store it and start the next, fixed cost
+		stat_block_t xdata *b = &stat_ring[stat_head];
+		b->sum = blk_sum;
+		b->sq_lo = blk_sq_lo;
+		b->sq_mid = blk_sq_mid;
+		b->sq_hi = blk_sq_hi;
+		b->min = blk_min;
+		b->max = blk_max;
+		blk_sum = 0;
+		blk_sq_lo = 0;
+		blk_sq_mid = 0;
+		blk_sq_hi = 0;
+		blk_min = 0x0FFF;
+		blk_max = 0;
+		blk_count = 0;
+		stat_head = (stat_head + 1) & (STAT_BLOCKS - 1);
+		if (stat_filled < STAT_BLOCKS) stat_filled++;
+		stat_ready = 1;
+	}
+	TF2 = 0;                                              // reset timer2 overflow
+}
+
+uint16 isqrt(uint32 n){                          // Integer square root, one result bit per pass, no division
+	uint32 root = 0;
+	uint32 bit = 1UL << 24;                         // highest power of 4 needed for 12-bit readings squared
+	while (bit > n) bit >>= 2;
+	while (bit != 0){
+		if (n >= root + bit){
+			n -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else{
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+	return root;
+}
+
+void stats_update(void){                         // Combines the blocks in the ring into the window results
+	uint32 sum = 0;
+	uint32 mean_sq = 0;                             // sum of the block mean squares, each at most 4095 squared
+	uint16 lo = 0x0FFF;
+	uint16 hi = 0;
+	uint8 i;
+	stat_block_t xdata *b;
+	EADC = 0;                                       // the interrupt writes the ring, this takes well under one conversion time
+	for (i = 0; i < STAT_BLOCKS; i++){
+		b = &stat_ring[i];
+		sum += b->sum;
+		mean_sq += (((uint32)b->sq_hi << 16) + (b->sq_mid << 9) + b->sq_lo) >> STAT_BLOCK_SHIFT;
+		if (b->min < lo) lo = b->min;
+		if (b->max > hi) hi = b->max;
+	}
+	EADC = 1;
+	stat_mean = sum >> (STAT_BLOCK_SHIFT + STAT_BLOCKS_SHIFT);
+	stat_min = lo;
+	stat_max = hi;
+	stat_rms = isqrt(mean_sq >> STAT_BLOCKS_SHIFT);
+}
+
+uint16 stat_value(uint8 stat){                   // Window result chosen by the switches, in ADC codes
+	if (stat == STAT_MIN) return stat_min;
+	if (stat == STAT_MAX) return stat_max;
+	if (stat == STAT_P2P) return stat_max - stat_min;
+	if (stat == STAT_RMS) return stat_rms;
+	return stat_mean;                               // mean for any other setting
+}
+
+void scan_update(void){                          // Results of the window the ADC interrupt has just finished
+	scan_acc_t xdata *a = scan_acc[scan_bank ^ 1];  // not written again until the next window completes
+	uint8 i;
+	for (i = 0; i < SCAN_N; i++, a++){
+		scan_mean[i] = a->sum >> STAT_BLOCK_SHIFT;
+		scan_min[i] = a->min;
+		scan_max[i] = a->max;
+		scan_rms[i] = isqrt((((uint32)a->sq_hi << 16) + (a->sq_mid << 9) + a->sq_lo) >> STAT_BLOCK_SHIFT);
+	}
+}
+
+uint16 scan_value(uint8 i, uint8 stat){          // Window result for the channel at position i, as stat_value
+	if (stat == STAT_MIN) return scan_min[i];
+	if (stat == STAT_MAX) return scan_max[i];
+	if (stat == STAT_P2P) return scan_max[i] - scan_min[i];
+	if (stat == STAT_RMS) return scan_rms[i];
+	return scan_mean[i];
+}
+
+void scan_reset(void){                           // Starts scanning from the first channel, called with interrupts off
+	uint8 i;
+	scan_bank = 0;
+	scan_pos = 0;
+	scan_pass = 0;
+	scan_ready = 0;
+	scan_show = 0;
+	scan_windows = 0;
+	for (i = 0; i < SCAN_N; i++){                   // nothing to show until the first window
+		scan_mean[i] = 0;
+		scan_min[i] = 0;
+		scan_max[i] = 0;
+		scan_rms[i] = 0;
+	}
+}
+
+void show_scan(uint8 stat){                      // Channel chosen by the switches, or each in turn
+	uint8 slot = MODE_SELECT >> SCAN_SLOT_SHIFT;
+	if (scan_ready){
+		scan_ready = 0;
+		scan_update();
+		if (++scan_windows >= SCAN_CYCLE_WINDOWS){
+			scan_windows = 0;
+			if (++scan_show >= SCAN_N) scan_show = 0;
+		}
+	}
+	if (MODE_SELECT & SCAN_CYCLE) slot = scan_show;
+	else if (slot >= SCAN_N) slot = SCAN_N - 1;
+	display_tag = scan_list[slot];                  // channel number on the leftmost digit
+	if (stat == STAT_RATE){
+		Write_to_Display(SCAN_RATE_DHZ, 0x04, UNIT_HZ);   // readings a second of each channel, one decimal
+	}
+	else{
+		Write_to_Display(scale_voltage(scan_value(slot, stat)), 0, UNIT_MV);
+	}
+}
+
+void freq_method_set(uint8 method){              // Switches between gated counting and period timing, called with interrupts off
+	freq_method = method;
+	display_write_flag = 0;                         // nothing shown until the new method has a full result
+	if (method == FREQ_PERIOD){
+		TR1 = 0;                                      // edge counter not needed
+		ET1 = 0;
+		P1 &= ~0x02;                                  // P1.1 (T2EX) as digital input, the signal must be wired here as well as to T1
+		T2CON = 0x0D;                                 // capture mode, T2EX falling edge enabled, timer running
+		TH2 = 0;
+		TL2 = 0;
+		t2_high = 0;
+		since_capture = 0;
+		period_started = 0;
+	}
+	else{
+		T2CON = 0x04;                                 // auto reload timer mode, as used by the gate and the ADC
+		RCAP2 = 0x0;                                  // timer 2 overflows every 65536 cycles for the gate
+		t2_overflows = 0;
+		gate_shift = GATE_MIN_SHIFT;                  // short first gate, lengthened if the signal is slow
+		gate_restart = 1;
+		ET1 = 1;                                      // Timer 1 overflows extend the count
+		TR1 = 1;                                      // Timer 1 enabled, free running from here on
+	}
+}
+
+void show_hz(uint32 freq){                       // Chooses the range that shows the most digits of freq
+	if (freq <= 0xFFFF){
+		Write_to_Display(freq, 0, UNIT_HZ);           // 0 to 65535 Hz
+	}
+	else if (freq < 655360UL){
+		Write_to_Display(freq / 10, 0x06, UNIT_KHZ);  // 65.53 to 655.35 kHz, 10 Hz steps
+	}
+	else if (freq < 6553600UL){
+		Write_to_Display(freq / 100, 0x08, UNIT_MHZ); // 0.6553 to 6.5535 MHz, 100 Hz steps
+	}
+	else{
+		Write_to_Display(0, 0, UNIT_OVER);
+	}
+}
+
+void show_frequency(void){                       // Turns the latest result into a display value, choosing the method for the next one
+	uint32 count;
+	uint32 ticks;
+	uint8 periods;
+	uint8 shift;
+	EA = 0;                                         // results are multi-byte and written by the interrupt
+	count = count_meas;
+	shift = count_shift;
+	ticks = period_ticks;
+	periods = period_count;
+	display_write_flag = 0;
+	EA = 1;
+	if (freq_method == FREQ_GATED){
+		calculated_freq = (count * GATE_SCALE) >> (GATE_SHIFT + shift);   // Edges counted by Timer 1 over the gate, scaled by the gate time, no floating point
+		show_hz(calculated_freq);
+		if (count != 0 && calculated_freq < PERIOD_BELOW_HZ){
+			EA = 0;
+			freq_method_set(FREQ_PERIOD);             // slow signal - time the periods for sub-Hz resolution
+			EA = 1;
+		}
+	}
+	else{
+		uint32 freq_chz = 0;                          // frequency in hundredths of a Hz
+		if (periods){                                 // reciprocal: f = periods * clock / ticks, kept in integers
+			freq_chz = (CLK_CHZ / ticks) * periods + ((CLK_CHZ % ticks) * periods) / ticks;
+		}
+		if (freq_chz <= 0xFFFF){
+			Write_to_Display(freq_chz, 0x05, UNIT_HZ);  // up to 655.35 Hz, decimal point after the hundreds digit
+		}
+		else if (freq_chz < 655360UL){                // too many digits for 2 decimals, show 1
+			Write_to_Display(freq_chz / 10, 0x04, UNIT_HZ);
+		}
+		else{
+			show_hz(freq_chz / 100);
+		}
+		if (periods == 0 || freq_chz > GATED_ABOVE_CHZ){
+			EA = 0;
+			freq_method_set(FREQ_GATED);              // fast signal or none - count edges instead
+			EA = 1;
+		}
+	}
+}
+
+void mode_exit(uint8 mode){                      // Exit actions - stop whatever the old mode was using
+	if (mode == MODE_FREQ){
+		TR1 = 0;                                      // stop counting input edges
+		ET1 = 0;
+		freq_method = FREQ_GATED;
+		T2CON = 0x04;                                 // leave capture mode, timer 2 paces the ADC again
+	}
+	else if (mode != MODE_NONE){
+		EADC = 0;                                     // stop ADC interrupts
+		ADCCON1 = 0x00;                               // power down ADC
+		scan_on = 0;
+		display_tag = 0x0F;
+	}
+}
+
+void mode_enter(uint8 mode){                     // Entry actions - set up hardware once, and start the first window cleanly
+	EA = 0;                                         // accumulators shared with the interrupts
+	if (mode == MODE_FREQ){
+		SigGenSetup();		                            // Initialise the signal generator
+		freq_method_set(FREQ_GATED);                  // start with edge counting, switches to period timing if slow
+	}
+	else if (mode == MODE_SCAN){
+		scan_reset();
+		scan_on = 1;
+		ADC_setup(scan_list[0]);
+	}
+	else{
+		ADC_setup(0);
+		stats_reset();
+	}
+	if (freq_method == FREQ_GATED) timer2_restart();  // capture mode runs from zero instead
+	EA = 1;
 }
 
 void main (void) {
@@ -216,26 +666,34 @@ void main (void) {
   MAX_setup();                                       // MAX display set up function called
 
 	while (1){
-		uint8 freq_mode = MODE_SELECT & 0x08;
+		uint8 mode;
 		inputs = MODE_SELECT & 0x0F;                     // mask zeros out unused significant bits
 		LED_BANK = ~inputs;                              //sets LED to whatever mode we are in// Loop forever, repeating tasks 
-                                                     //if (inputs & 0x08 == 0x08) // Checks if P2.3 is set
-		if (freq_mode)
+		mode = (inputs & 0x08) ? MODE_FREQ : (MODE_SELECT & MODE_SCAN) ? MODE_SCAN : MODE_VOLT;  // all frequency settings share one state, as do all statistics
+		if (mode != current_mode){                       // hardware only reconfigured on a change of mode
+			mode_exit(current_mode);
+			mode_enter(mode);
+			current_mode = mode;
+		}
+		if (mode == MODE_FREQ)
         { //frequency
-			      TR1 = 1;                                           // Timer 1 enabled
-            SigGenSetup();		                                 // Initialise the signal generator
-            EADC = 0;
-            RCAP2 = 0x0;
             if(display_write_flag == 1){                       //flag used to only display when a new value is retrieved after every averaging reset
-                calculated_freq = count_meas/0.5037;           // Total cycles counted by Timer 1, obtained during 85 interrupts, divided by time taken for 85 interrupts to give the measured frequency 
-                Write_to_Display(calculated_freq);             //write to lcd
+                show_frequency();                              //write to lcd
             }
         }
+        else if (mode == MODE_SCAN){
+            show_scan(inputs & 0x07);
+        }
         else {                                                 // This should only trigger when P2.0 - P2.2 is set.
             // voltage
-            ADC_setup();
-            voltage = scale_voltage(adc_data);
-            Write_to_Display(voltage);
+            if (stat_ready){                                   // a block has completed
+                stat_ready = 0;
+                if (stat_filled == STAT_BLOCKS && ((MODE_SELECT & STAT_SLIDING) || stat_head == 0)){
+                    stats_update();                            // sliding: every block, otherwise once per whole window
+                }
+            }
+            voltage = scale_voltage(stat_value(inputs & 0x07));
+            Write_to_Display(voltage, 0, UNIT_MV);
         }
     }
 }
\ No newline at end of file
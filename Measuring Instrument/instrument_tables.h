@@ -0,0 +1,24 @@
+// instrument_tables.h - generated by tools/gen_tables.c from tools/tables_config.h, do not edit.
+// Change the configuration and run gen_tables again to retune.
+#ifndef INSTRUMENT_TABLES_ALREADY_INCLUDED
+#define INSTRUMENT_TABLES_ALREADY_INCLUDED
+
+// ADC code to mV: 2500 mV reference, 12 bits.  mV = (code * SCALE) >> SHIFT
+#define ADC_MV_SCALE 625UL                     // exact
+#define ADC_MV_SHIFT 10
+#define ADC_T2_RELOAD 0xEAA6                    // Timer 2 reload, 5466 cycles between conversions
+#define ADC_RATE_DHZ 20233UL                   // conversions in 10 s, 2023.27 a second
+
+// Frequency measurement, 11059200 Hz clock
+#define CLK_CHZ 1105920000UL                   // clock in hundredths, numerator for frequency in centi-Hz
+#define GATE_MIN_SHIFT 3                       // shortest gate 2^3 Timer 2 overflows, 0.0474 s
+#define GATE_MAX_SHIFT 7                       // longest gate, 0.7585 s
+#define GATE_MIN_COUNT 10000UL                 // edges wanted per gate, ranging keeps the count below twice this
+#define GATE_SCALE 675UL                       // count to Hz = (count * SCALE) >> (SHIFT + gate shift), exact
+#define GATE_SHIFT 2
+#define PERIOD_BELOW_HZ 1985UL                 // gated result below which periods are timed
+#define GATED_ABOVE_CHZ 250000UL               // period result (2500 Hz) above which edges are counted
+#define PERIOD_GATE 1105920UL                  // 100 ms in clock cycles, minimum time to average periods over
+#define PERIOD_TIMEOUT 506                     // Timer 2 overflows in 3000 ms without an edge, signal gone
+
+#endif
@@ -16,6 +16,22 @@
 //			byte 2 - Enable for digits 7 to 0: 1 = enabled, 0 = off.
 //			byte 1 - Mode control for digits 7 to 0: 1 = hexadecimal, 0 = raw. 
 //			byte 0 - Dot control for digits 7 to 0 in hex mode, 1 = ON.
+//		Address 10 - 32-bit read/write, signed number to be displayed in
+//			decimal.  Writing starts a conversion to BCD which takes 33 
+//			clock cycles, the previous number is shown until it finishes.
+//		Address 14 - 32-bit read/write, decimal configuration register:
+//			bits 2:0  - digit holding the units of the decimal field
+//			bits 7:4  - width of the field in digits, 0 to 8
+//			bits 10:8 - decimal point position, counted in digits from the
+//				units digit of the field
+//			bit 11    - decimal point enable
+//			bit 16    - decimal field enable: digits in the field show the
+//				decimal number whatever the control register says
+//			bit 31    - read only, conversion in progress
+//			In the field, leading zeros are blank (but zeros up to the 
+//			decimal point are shown), a minus sign is placed just left of
+//			the most significant digit, and a number too wide for the field
+//			shows a dash on every digit of the field.
 //		This version only handles 32-bit bus transactions.
 //
 //		The display refresh rate is the clock frequency divided by
@@ -25,6 +41,7 @@
 //		display cycles through all 8 digits every ~21 ms.
 //
 // Revision: March 2021 - comments updated, some internal signal names changed.
+//           April 2021 - decimal display registers added.
 //
 //////////////////////////////////////////////////////////////////////////////////
 module  AHBdisplay #(D_WIDTH = 20) (
@@ -47,10 +64,11 @@ module  AHBdisplay #(D_WIDTH = 20) (
 
 //================================  AHB-Lite Bus Interface =============================
 	 // Address bits for registers
-	localparam [1:0] RAWL = 2'h0, RAWH = 2'h1, HEXD = 2'h2, CTRL = 2'h3;
+	localparam [2:0] RAWL = 3'h0, RAWH = 3'h1, HEXD = 3'h2, CTRL = 3'h3,
+					 DECD = 3'h4, DCFG = 3'h5;
 	
 	// Registers to hold signals from address phase
-	reg [1:0] rHADDR;			// only need two bits of address
+	reg [2:0] rHADDR;			// only need three bits of address
 	reg rWrite;					// write enable signal
 
 	// Internal signals
@@ -60,18 +78,20 @@ module  AHBdisplay #(D_WIDTH = 20) (
 	always @ (posedge HCLK)
 		if (!HRESETn)
 			begin
-				rHADDR <= 2'b0;
+				rHADDR <= 3'b0;
 				rWrite <= 1'b0;
 			end
 		else if (HREADY)	// previous bus transaction is completing
             begin
-                rHADDR <= HADDR[3:2];  // capture address bits for for use in data phase
+                rHADDR <= HADDR[4:2];  // capture address bits for for use in data phase
                 rWrite <= HSEL & HWRITE & HTRANS[1]; // slave selected for write transfer       
             end
 
 	// Registers visible on the AHB-Lite bus, as described above
-	reg [31:0] rawLow, rawHigh, hexData;
+	reg [31:0] rawLow, rawHigh, hexData, decData;
 	reg [23:0] control;
+	reg [16:0] decConfig;
+	wire       convBusy;	// decimal conversion in progress
 	always @ (posedge HCLK)
 		if (!HRESETn) 
 			begin
@@ -79,6 +99,8 @@ module  AHBdisplay #(D_WIDTH = 20) (
 				rawHigh <= 32'd0;
 				hexData <= 32'd0;
 				control <= 24'b0;
+				decData <= 32'd0;
+				decConfig <= 17'b0;
 			end
 		else if (rWrite)  // writing to a register
 			case (rHADDR)
@@ -86,26 +108,102 @@ module  AHBdisplay #(D_WIDTH = 20) (
 				RAWH:   rawHigh <= HWDATA[31:0];
 				HEXD:   hexData <= HWDATA[31:0];
 				CTRL:   control <= HWDATA[23:0];
+				DECD:   decData <= HWDATA[31:0];
+				DCFG:   decConfig <= HWDATA[16:0] & 17'h10FF7;	// unused bits read as 0
 			endcase
 
 	// Bus read data
-	always @(rawLow, rawHigh, hexData, control, rHADDR)
+	always @(rawLow, rawHigh, hexData, control, decData, decConfig, convBusy, rHADDR)
 		case (rHADDR)		// select on word address (stored from address phase)
 			RAWL:		readData = rawLow;	// read back raw low register
 			RAWH:		readData = rawHigh;	
 			HEXD:		readData = hexData;    
 			CTRL:		readData = {8'b0, control};	// control register with 0 bits
+			DECD:		readData = decData;
+			DCFG:		readData = {convBusy, 14'b0, decConfig};
+			default:	readData = 32'b0;
 		endcase
 		
 	assign HRDATA = readData;	
 	assign HREADYOUT = 1'b1;	// always ready - transaction is never delayed
 	
+//================================  Binary to Decimal Conversion ===============================
+
+	// Shift-and-add-3 (double dabble), one bit per clock cycle.  The magnitude
+	// of the number is shifted into ten BCD digits, MSB first, after adding 3
+	// to any digit of 5 or more so that the shift carries it correctly.
+	reg [31:0] binShift;	// magnitude, bits not yet converted at the top
+	reg [39:0] bcdShift;	// BCD digits being built
+	reg [5:0]  bitsLeft;	// bits still to shift in, conversion busy if not 0
+	reg        convNeg;		// sign of the number being converted
+	reg [39:0] decBCD;		// BCD digits of the last completed conversion
+	reg        decNeg;		// sign of the last completed conversion
+	reg [39:0] bcdAdj;		// bcdShift after add-3 correction
+	wire [39:0] bcdNext = {bcdAdj[38:0], binShift[31]};	// after the shift
+	integer i;
+
+	always @ (bcdShift)
+		for (i = 0; i < 10; i = i + 1)
+			bcdAdj[4*i +: 4] = (bcdShift[4*i +: 4] >= 4'd5) ? bcdShift[4*i +: 4] + 4'd3 : bcdShift[4*i +: 4];
+
+	assign convBusy = (bitsLeft != 6'd0);
+
+	always @ (posedge HCLK)
+		if (!HRESETn)
+			begin
+				binShift <= 32'd0;
+				bcdShift <= 40'd0;
+				bitsLeft <= 6'd0;
+				convNeg  <= 1'b0;
+				decBCD   <= 40'd0;
+				decNeg   <= 1'b0;
+			end
+		else if (rWrite & (rHADDR == DECD))		// new number - start again
+			begin
+				convNeg  <= HWDATA[31];
+				binShift <= HWDATA[31] ? -HWDATA : HWDATA;	// magnitude, 2^31 fits unsigned
+				bcdShift <= 40'd0;
+				bitsLeft <= 6'd32;
+			end
+		else if (convBusy)
+			begin
+				bcdShift <= bcdNext;
+				binShift <= {binShift[30:0], 1'b0};
+				bitsLeft <= bitsLeft - 1'b1;
+				if (bitsLeft == 6'd1)		// last bit - show the result
+					begin
+						decBCD <= bcdNext;
+						decNeg <= convNeg;
+					end
+			end
+
+	// Digits needed for the number: up to the most significant non-zero
+	// digit, and at least up to the decimal point if it is enabled
+	wire [2:0] decOffset = decConfig[2:0];
+	wire [3:0] decWidth  = decConfig[7:4];
+	wire [2:0] dpPos     = decConfig[10:8];
+	wire       dpEnable  = decConfig[11];
+	wire       decEnable = decConfig[16];
+	reg  [3:0] sigDigits;	// digits to show, not counting the sign
+	integer k;
+
+	always @ (decBCD or dpEnable or dpPos)
+		begin
+			sigDigits = dpEnable ? {1'b0, dpPos} + 1'b1 : 4'd1;
+			for (k = 1; k < 10; k = k + 1)
+				if ((decBCD[4*k +: 4] != 4'd0) && (sigDigits < k + 1))
+					sigDigits = k + 1;
+		end
+
+	wire decOverflow = ({1'b0, sigDigits} + decNeg) > {1'b0, decWidth};
+
 //================================  Display Interface ===============================
 
 	reg [D_WIDTH-1:0] clkCount; // counter to scan digits
 	wire [2:0] digitSel;   // 3-bit value to select one digit
 	reg [7:0]  pattern;    // raw pattern for this digit
 	reg [3:0]  value;      // 4-bit value for this digit
+	reg [3:0]  hexValue;   // 4-bit value for this digit in hex mode
 	reg        dot;        // decimal point for this digit
 	wire [6:0] hexPattern; // pattern to represent hex digit
 	reg [1:0]  digitMode;  // mode for this digit:  0x = off, 10 = raw, 11 = hex
@@ -147,16 +245,24 @@ module  AHBdisplay #(D_WIDTH = 20) (
 	// Multiplexer to select the value for use in hexadecimal mode
 	always @ (digitSel or hexData)
         case (digitSel)
-            3'b000:  value = hexData[3:0];  // value for rightmost digit
-            3'b001:  value = hexData[7:4];
-            3'b010:  value = hexData[11:8];
-            3'b011:  value = hexData[15:12];
-            3'b100:  value = hexData[19:16];
-            3'b101:  value = hexData[23:20];
-            3'b110:  value = hexData[27:24];
-            3'b111:  value = hexData[31:28];  // value for leftmost digit
+            3'b000:  hexValue = hexData[3:0];  // value for rightmost digit
+            3'b001:  hexValue = hexData[7:4];
+            3'b010:  hexValue = hexData[11:8];
+            3'b011:  hexValue = hexData[15:12];
+            3'b100:  hexValue = hexData[19:16];
+            3'b101:  hexValue = hexData[23:20];
+            3'b110:  hexValue = hexData[27:24];
+            3'b111:  hexValue = hexData[31:28];  // value for leftmost digit
         endcase  
 
+	// Position of this digit in the decimal field, 0 = units
+	wire [2:0] fieldPos = digitSel - decOffset;
+	wire       inField  = decEnable & (digitSel >= decOffset) & ({1'b0, fieldPos} < decWidth);
+
+	// Decimal digits share the hex to 7-segment converter
+	always @ (inField or fieldPos or decBCD or hexValue)
+		value = inField ? decBCD[4*fieldPos +: 4] : hexValue;
+
 	// Multiplexer to select the dot for use in hexadecimal mode
 	always @ (digitSel or control)
         case (digitSel)
@@ -187,12 +293,26 @@ module  AHBdisplay #(D_WIDTH = 20) (
 	hex2seg LUT ( .number( value ),		
 		.pattern( hexPattern ) );
 
+	// Pattern for a digit in the decimal field: digit, minus sign or blank
+	localparam [6:0] MINUS = 7'b1111110, BLANK = 7'b1111111;	// active low ABCDEFG
+	reg [6:0] decPattern;
+	always @ (decOverflow or fieldPos or sigDigits or decNeg or hexPattern)
+		if (decOverflow)							decPattern = MINUS;		// dash on every digit
+		else if ({1'b0, fieldPos} < sigDigits)		decPattern = hexPattern;
+		else if (decNeg & (fieldPos == sigDigits))	decPattern = MINUS;
+		else										decPattern = BLANK;		// leading zero
+
+	wire decDot = dpEnable & (fieldPos == dpPos) & ~decOverflow;
+
 	// Multiplexer to choose segment pattern according to mode
-    always @ (digitMode or pattern or hexPattern or dot)
-        case (digitMode)
-            2'b00, 2'b01:   segment = 8'hFF;    // all segments off
-            2'b10:          segment = ~pattern;  // raw mode
-            2'b11:          segment = {hexPattern, ~dot}; // hex mode
-        endcase
+    always @ (inField or decPattern or decDot or digitMode or pattern or hexPattern or dot)
+        if (inField)
+            segment = {decPattern, ~decDot};    // decimal field
+        else
+            case (digitMode)
+                2'b00, 2'b01:   segment = 8'hFF;    // all segments off
+                2'b10:          segment = ~pattern;  // raw mode
+                2'b11:          segment = {hexPattern, ~dot}; // hex mode
+            endcase
    
 endmodule
@@ -0,0 +1,356 @@
+`timescale 1ns / 1ns
+//////////////////////////////////////////////////////////////////////////////////
+// Company: UCD School of Electrical and Electronic Engineering
+// Engineer: Aidan O'Sullivan
+//
+// Create Date:     April 2021
+// Design Name:     Cortex-M0 DesignStart system
+// Module Name:     AHBdma
+// Description: 	Two channel DMA controller.  A bus master of its own, so
+//                  blocks of data move between memory and peripherals
+//                  while the processor sleeps or gets on with other work.
+//		Each channel has eight word addresses, channel 0 at 0x00, channel 1
+//		at 0x20:
+//		Address 0x00 - read/write, source address, advanced as data moves
+//		Address 0x04 - read/write, destination address, advanced as data moves
+//		Address 0x08 - read/write, transfers remaining (16 bits)
+//		Address 0x0C - read/write, control register:
+//			bit 0 - enable, set to start, cleared by the channel when the
+//				count reaches 0.  Clearing it stops the channel after the
+//				transfer in progress.
+//			bit 1 - increment the source address after each transfer
+//			bit 2 - increment the destination address after each transfer
+//			bits 5:4 - transfer size, 0 = byte, 1 = halfword, 2 = word
+//			bit 6 - paced: before each transfer, read the poll address
+//				and wait until the flags match, see below
+//			bit 7 - interrupt enable, request when the channel is done
+//		Address 0x10 - read/write, poll address, a peripheral status register
+//		Address 0x14 - read/write, poll match: transfer when
+//			(status & bits 7:0) == bits 15:8
+//		Address 0x40 - status register:
+//			bits 1:0 - channel done (sticky), write 1 to clear
+//			bits 5:4 - channel enabled, read only
+//		This version only handles 32-bit bus transactions on this port.
+//
+//		Each transfer is a read then a write, the data put on every byte
+//		lane of the write so that peripherals reading bits 7:0 get a byte
+//		from any source alignment.  The channels take turns transfer by
+//		transfer.  A paced channel whose flags do not match waits POLL_WAIT
+//		cycles before polling again, so waiting on a slow peripheral costs
+//		little bus time: with the default 20 us, four or five polls for each
+//		86.8 us character at 115200 baud, and the 16 byte UART FIFO never runs dry
+//		waiting for the next poll.  Example, TxBuf to the UART: source TxBuf, source
+//		increment, byte size, destination UART TxData, poll UART Status,
+//		match 0x0001 (transmit FIFO full bit must be 0).
+//
+//////////////////////////////////////////////////////////////////////////////////
+module AHBdma #(POLL_WAIT = 1000) (
+			// Bus signals, slave port
+			input wire HCLK,			// bus clock
+			input wire HRESETn,			// bus reset, active low
+			input wire HSEL,			// selects this slave
+			input wire HREADY,			// indicates previous transaction completing
+			input wire [31:0] HADDR,	// address
+			input wire [1:0] HTRANS,	// transaction type (only bit 1 used)
+			input wire HWRITE,			// write transaction
+//			input wire [2:0] HSIZE,		// transaction width ignored
+			input wire [31:0] HWDATA,	// write data
+			output wire [31:0] HRDATA,	// read data from slave
+			output wire HREADYOUT,		// ready output from slave
+			// Master port, through AHBarbiter
+			output wire mReq,			// wants the next address phase
+			input wire mGrant,			// owns the address phase this cycle
+			output wire [31:0] mHADDR,	// address
+			output wire [1:0] mHTRANS,	// transaction type, idle or non-sequential
+			output wire mHWRITE,		// write transaction
+			output wire [2:0] mHSIZE,	// transaction width
+			output reg [31:0] mHWDATA,	// write data
+			input wire [31:0] mHRDATA,	// read data from the bus
+			// Interrupt
+			output wire dma_IRQ			// interrupt request, active high
+	);
+
+//================================  AHB-Lite Bus Interface =============================
+	// Address bits for registers, in each channel
+	localparam [2:0] SRC = 3'h0, DST = 3'h1, COUNT = 3'h2, CTRL = 3'h3, POLL = 3'h4, MATCH = 3'h5;
+	// control register bits
+	localparam EN = 0, SRC_INC = 1, DST_INC = 2, PACED = 6, INT_EN = 7;
+
+	// Registers to hold signals from address phase
+	reg [4:0] rHADDR;			// bit 4 status, bit 3 channel, bits 2:0 register
+	reg rWrite;					// write enable signal
+	reg rRead;					// read enable signal
+
+	// Internal signals
+	reg [31:0] readData;		// ouptut of read multiplexer
+
+	// Capture bus signals in address phase
+	always @ (posedge HCLK)
+		if (!HRESETn)
+			begin
+				rHADDR <= 5'b0;
+				rWrite <= 1'b0;
+				rRead  <= 1'b0;
+			end
+		else if (HREADY)	// previous bus transaction is completing
+			begin
+				rHADDR <= HADDR[6:2];  // capture address bits for for use in data phase
+				rWrite <= HSEL & HWRITE & HTRANS[1];   // slave selected for write transfer
+				rRead  <= HSEL & ~HWRITE & HTRANS[1];  // slave selected for read transfer
+			end
+
+//================================  Channel Registers and Transfer Engine ===============================
+
+	localparam [2:0] IDLE = 3'd0, POLL_A = 3'd1, POLL_D = 3'd2, READ_A = 3'd3, READ_D = 3'd4,
+					 WRITE_A = 3'd5, WRITE_D = 3'd6, PAUSE = 3'd7;
+
+	reg [31:0] src [0:1];
+	reg [31:0] dst [0:1];
+	reg [15:0] count [0:1];
+	reg [7:0]  control [0:1];
+	reg [31:0] poll [0:1];
+	reg [15:0] match [0:1];
+	reg [1:0]  done;			// sticky, channel finished
+
+	reg [2:0] state;
+	reg       ch;				// channel being served
+	reg [15:0] waitCount;		// cycles left before polling again
+
+	wire [1:0] size     = control[ch][5:4];
+	wire [2:0] step     = (size == 2'd0) ? 3'd1 : (size == 2'd1) ? 3'd2 : 3'd4;
+	wire       accepted = mGrant & HREADY;		// our address phase is taken this cycle
+	wire [1:0] ready    = {control[1][EN] & (count[1] != 16'd0), control[0][EN] & (count[0] != 16'd0)};
+	wire [31:0] shifted = mHRDATA >> {src[ch][1:0], 3'b0};	// read data moved down to bit 0
+	wire       chWrite  = rWrite & ~rHADDR[4];
+	wire       cw       = rHADDR[3];					// channel written by the processor
+	integer i;
+
+	always @ (posedge HCLK)
+		if (!HRESETn)
+			begin
+				for (i = 0; i < 2; i = i + 1)
+					begin
+						src[i]     <= 32'd0;
+						dst[i]     <= 32'd0;
+						count[i]   <= 16'd0;
+						control[i] <= 8'd0;
+						poll[i]    <= 32'd0;
+						match[i]   <= 16'd0;
+					end
+				done      <= 2'b0;
+				state     <= IDLE;
+				ch        <= 1'b0;
+				waitCount <= 16'd0;
+				mHWDATA   <= 32'd0;
+			end
+		else
+			begin
+				// Transfer engine
+				case (state)
+					IDLE:
+						if (ready[~ch])			// other channel first, so they take turns
+							begin
+								ch    <= ~ch;
+								state <= control[~ch][PACED] ? POLL_A : READ_A;
+							end
+						else if (ready[ch])
+							state <= control[ch][PACED] ? POLL_A : READ_A;
+					POLL_A:  if (accepted) state <= POLL_D;
+					POLL_D:
+						if (HREADY)
+							begin
+								if ((mHRDATA[7:0] & match[ch][7:0]) == match[ch][15:8])
+									state <= READ_A;
+								else
+									begin
+										waitCount <= POLL_WAIT;
+										state     <= PAUSE;
+									end
+							end
+					PAUSE:
+						if (waitCount == 16'd0) state <= IDLE;
+						else waitCount <= waitCount - 1'b1;
+					READ_A:  if (accepted) state <= READ_D;
+					READ_D:
+						if (HREADY)
+							begin
+								case (size)		// on every byte lane of the write
+									2'd0:    mHWDATA <= {4{shifted[7:0]}};
+									2'd1:    mHWDATA <= {2{shifted[15:0]}};
+									default: mHWDATA <= mHRDATA;
+								endcase
+								state <= WRITE_A;
+							end
+					WRITE_A: if (accepted) state <= WRITE_D;
+					WRITE_D:
+						if (HREADY)
+							begin
+								if (control[ch][SRC_INC]) src[ch] <= src[ch] + step;
+								if (control[ch][DST_INC]) dst[ch] <= dst[ch] + step;
+								count[ch] <= count[ch] - 1'b1;
+								if (count[ch] == 16'd1)
+									begin
+										control[ch][EN] <= 1'b0;
+										done[ch]        <= 1'b1;
+									end
+								state <= IDLE;
+							end
+				endcase
+
+				// An enabled channel with nothing to do is done straight away
+				for (i = 0; i < 2; i = i + 1)
+					if (control[i][EN] && count[i] == 16'd0 && !(state != IDLE && ch == i))
+						begin
+							control[i][EN] <= 1'b0;
+							done[i]        <= 1'b1;
+						end
+
+				// Processor writes, after the engine so that they take priority
+				if (chWrite)
+					case (rHADDR[2:0])
+						SRC:    src[cw]     <= HWDATA;
+						DST:    dst[cw]     <= HWDATA;
+						COUNT:  count[cw]   <= HWDATA[15:0];
+						CTRL:   control[cw] <= HWDATA[7:0];
+						POLL:   poll[cw]    <= HWDATA;
+						MATCH:  match[cw]   <= HWDATA[15:0];
+					endcase
+				if (rWrite & rHADDR[4])			// status, write 1 to clear done
+					done <= done & ~HWDATA[1:0];
+			end
+
+	// Master port - address phase from the state, data held in mHWDATA through the write data phase
+	wire addrPhase = (state == POLL_A) | (state == READ_A) | (state == WRITE_A);
+	assign mReq    = addrPhase;
+	assign mHTRANS = addrPhase ? 2'b10 : 2'b00;		// non-sequential or idle
+	assign mHWRITE = (state == WRITE_A);
+	assign mHSIZE  = (state == POLL_A) ? 3'b010 : {1'b0, size};
+	assign mHADDR  = (state == POLL_A) ? poll[ch] : (state == WRITE_A) ? dst[ch] : src[ch];
+
+//================================  Read Data and Interrupt ===============================
+
+	// Bus read data
+	always @(rHADDR, src[0], src[1], dst[0], dst[1], count[0], count[1], control[0], control[1],
+			poll[0], poll[1], match[0], match[1], done)
+		if (rHADDR[4])
+			readData = {26'b0, control[1][EN], control[0][EN], 2'b0, done};
+		else
+			case (rHADDR[2:0])		// select on word address (stored from address phase)
+				SRC:		readData = src[rHADDR[3]];
+				DST:		readData = dst[rHADDR[3]];
+				COUNT:		readData = {16'b0, count[rHADDR[3]]};
+				CTRL:		readData = {24'b0, control[rHADDR[3]]};
+				POLL:		readData = poll[rHADDR[3]];
+				MATCH:		readData = {16'b0, match[rHADDR[3]]};
+				default:	readData = 32'b0;
+			endcase
+
+	assign HRDATA = readData;
+	assign HREADYOUT = 1'b1;	// always ready - transaction is never delayed
+
+	assign dma_IRQ = |(done & {control[1][INT_EN], control[0][INT_EN]});
+
+endmodule
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Module Name:     AHBarbiter
+// Description: 	Shares the bus between the processor and the DMA master.
+//                  Ownership of the address phase changes only when HREADY
+//                  is high; when both want the bus they take turns transfer
+//                  by transfer, so neither is ever locked out.
+//                  The processor cannot be told to wait before it starts a
+//                  transfer, so a transfer it starts while the DMA owns the
+//                  address phase is accepted and held here, and put on the
+//                  bus at the next turn with the processor's HREADY low
+//                  until its data phase completes.
+//////////////////////////////////////////////////////////////////////////////////
+module AHBarbiter (
+			input wire HCLK,
+			input wire HRESETn,
+			// Processor
+			input wire [31:0] cHADDR,
+			input wire [1:0] cHTRANS,
+			input wire cHWRITE,
+			input wire [2:0] cHSIZE,
+			input wire [31:0] cHWDATA,
+			output wire cHREADY,		// ready to the processor
+			// DMA master
+			input wire dReq,			// wants the next address phase
+			output wire dGrant,			// owns the address phase this cycle
+			input wire [31:0] dHADDR,
+			input wire [1:0] dHTRANS,
+			input wire dHWRITE,
+			input wire [2:0] dHSIZE,
+			input wire [31:0] dHWDATA,
+			// Bus to decoder and slaves
+			output wire [31:0] HADDR,
+			output wire [1:0] HTRANS,
+			output wire HWRITE,
+			output wire [2:0] HSIZE,
+			output wire [31:0] HWDATA,
+			input wire HREADY			// from the multiplexer
+	);
+
+	reg        dmaOwn;			// DMA owns the address phase
+	reg        cpuData;			// data phase on the bus belongs to the processor
+	reg        dmaData;			// data phase on the bus belongs to the DMA
+	reg        pend;			// processor transfer held, not yet on the bus
+	reg [31:0] pAddr;
+	reg [1:0]  pTrans;
+	reg        pWrite;
+	reg [2:0]  pSize;
+
+	// Processor address phase, held or live
+	wire [31:0] cAddr  = pend ? pAddr  : cHADDR;
+	wire [1:0]  cTrans = pend ? pTrans : cHTRANS;
+	wire        cWrite = pend ? pWrite : cHWRITE;
+	wire [2:0]  cSize  = pend ? pSize  : cHSIZE;
+	wire        cpuWants = pend | cHTRANS[1];
+
+	assign HADDR  = dmaOwn ? dHADDR  : cAddr;
+	assign HTRANS = dmaOwn ? dHTRANS : cTrans;
+	assign HWRITE = dmaOwn ? dHWRITE : cWrite;
+	assign HSIZE  = dmaOwn ? dHSIZE  : cSize;
+	assign HWDATA = dmaData ? dHWDATA : cHWDATA;
+	assign dGrant = dmaOwn;
+
+	// The processor sees the bus HREADY while its transfer is on the bus, waits while one is
+	// held, and otherwise has its next transfer accepted - by the bus or by the holding register
+	assign cHREADY = cpuData ? HREADY : pend ? 1'b0 : dmaOwn ? 1'b1 : HREADY;
+
+	always @ (posedge HCLK)
+		if (!HRESETn)
+			begin
+				dmaOwn  <= 1'b0;
+				cpuData <= 1'b0;
+				dmaData <= 1'b0;
+				pend    <= 1'b0;
+				pAddr   <= 32'b0;
+				pTrans  <= 2'b0;
+				pWrite  <= 1'b0;
+				pSize   <= 3'b0;
+			end
+		else
+			begin
+				if (pend)
+					begin
+						if (!dmaOwn & HREADY) pend <= 1'b0;		// held transfer put on the bus
+					end
+				else if (dmaOwn & cHTRANS[1] & cHREADY)		// processor transfer while the DMA owns the bus
+					begin
+						pend   <= 1'b1;
+						pAddr  <= cHADDR;
+						pTrans <= cHTRANS;
+						pWrite <= cHWRITE;
+						pSize  <= cHSIZE;
+					end
+				if (HREADY)
+					begin
+						cpuData <= ~dmaOwn & cTrans[1];
+						dmaData <= dmaOwn & dHTRANS[1];
+						dmaOwn  <= dReq & (~cpuWants | ~dmaOwn);	// turns when both want it
+					end
+			end
+
+endmodule
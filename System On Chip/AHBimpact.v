@@ -0,0 +1,358 @@
+`timescale 1ns / 1ns
+//////////////////////////////////////////////////////////////////////////////////
+// Company: UCD School of Electrical and Electronic Engineering
+// Engineer: Aidan O'Sullivan
+//
+// Create Date:     April 2021
+// Design Name:     Cortex-M0 DesignStart system
+// Module Name:     AHBimpact
+// Description: 	High impact detector.  Watches the accelerometer data as
+//                  it passes through the SPI master, and optionally the
+//                  ADXL362 INT1 pin, and records an event with a timestamp
+//                  whenever an axis goes beyond its threshold.
+//		Address 0x00 - read/write, X threshold, 12-bit magnitude in sensor
+//			LSB (1 mG at +-2G), 0 = axis not checked
+//		Address 0x04 - read/write, Y threshold
+//		Address 0x08 - read/write, Z threshold
+//		Address 0x0C - read/write, control register:
+//			bit 0 - check the sensor data stream against the thresholds
+//			bit 1 - a rising edge on the INT1 pin is an event
+//			bit 2 - interrupt enable, request while an event is waiting
+//		Address 0x10 - read/write, hold off time in microseconds: after an
+//			event, no other event is recorded until this time has passed
+//		Address 0x14 - read, number of events since reset (write clears)
+//		Address 0x18 - read, status register:
+//			bit 0 - event waiting in FIFO
+//			bit 1 - event FIFO full
+//			bit 2 - overflow, event lost because FIFO full (sticky)
+//			bits 6:4 - axes over threshold in oldest event, Z Y X
+//			bit 7 - oldest event came from the INT1 pin
+//			Any write to this address clears the overflow bit.
+//		Address 0x1C - read, timestamp of the oldest event, removing it
+//			from the FIFO.  Read the status first to get its axes.
+//		Address 0x20 - read, free running timestamp in microseconds
+//		This version only handles 32-bit bus transactions.
+//
+//		Samples are taken from ADXL362 read commands (0x0B) of the 8-bit
+//		data registers 0x08 - 0x0A and the 12-bit registers 0x0E - 0x13,
+//		and from FIFO reads (0x0D), where each entry carries its own axis.
+//		Detection does not depend on when the software reads the results,
+//		only on the data being read from the sensor.
+//
+//		FIFO depth is 2^F_ADDR events, default 8.  T_DIV is the number of
+//		clock cycles in a microsecond.
+//
+//////////////////////////////////////////////////////////////////////////////////
+module AHBimpact #(F_ADDR = 3, T_DIV = 50) (
+			// Bus signals
+			input wire HCLK,			// bus clock
+			input wire HRESETn,			// bus reset, active low
+			input wire HSEL,			// selects this slave
+			input wire HREADY,			// indicates previous transaction completing
+			input wire [31:0] HADDR,	// address
+			input wire [1:0] HTRANS,	// transaction type (only bit 1 used)
+			input wire HWRITE,			// write transaction
+//			input wire [2:0] HSIZE,		// transaction width ignored
+			input wire [31:0] HWDATA,	// write data
+			output wire [31:0] HRDATA,	// read data from slave
+			output wire HREADYOUT,		// ready output from slave
+			// Sensor data stream, from the SPI master monitor outputs
+			input wire spiSSn,			// slave select, each transaction starts with a command
+			input wire byteValid,		// one cycle strobe, a byte has been exchanged
+			input wire [7:0] byteTx,	// byte sent to the sensor
+			input wire [7:0] byteRx,	// byte received from the sensor
+			input wire extInt,			// ADXL362 INT1 pin, active high, asynchronous
+			// Interrupt
+			output wire impact_IRQ		// interrupt request, active high
+	);
+
+//================================  AHB-Lite Bus Interface =============================
+	// Address bits for registers
+	localparam [3:0] THRX = 4'h0, THRY = 4'h1, THRZ = 4'h2, CTRL = 4'h3, HOLD = 4'h4,
+					 COUNT = 4'h5, STAT = 4'h6, TIME = 4'h7, NOW = 4'h8;
+
+	// Registers to hold signals from address phase
+	reg [3:0] rHADDR;			// only need four bits of address
+	reg rWrite;					// write enable signal
+	reg rRead;					// read enable signal
+
+	// Internal signals
+	reg [31:0] readData;		// ouptut of read multiplexer
+
+	// Capture bus signals in address phase
+	always @ (posedge HCLK)
+		if (!HRESETn)
+			begin
+				rHADDR <= 4'b0;
+				rWrite <= 1'b0;
+				rRead  <= 1'b0;
+			end
+		else if (HREADY)	// previous bus transaction is completing
+			begin
+				rHADDR <= HADDR[5:2];  // capture address bits for for use in data phase
+				rWrite <= HSEL & HWRITE & HTRANS[1];   // slave selected for write transfer
+				rRead  <= HSEL & ~HWRITE & HTRANS[1];  // slave selected for read transfer
+			end
+
+	// Registers visible on the AHB-Lite bus, as described above
+	reg [11:0] thrX, thrY, thrZ;	// thresholds
+	reg [2:0]  control;
+	reg [31:0] holdOff;				// hold off time in microseconds
+
+	always @ (posedge HCLK)
+		if (!HRESETn)
+			begin
+				thrX    <= 12'd0;
+				thrY    <= 12'd0;
+				thrZ    <= 12'd0;
+				control <= 3'b0;
+				holdOff <= 32'd0;
+			end
+		else if (rWrite)  // writing to a register
+			case (rHADDR)
+				THRX:   thrX    <= HWDATA[11:0];
+				THRY:   thrY    <= HWDATA[11:0];
+				THRZ:   thrZ    <= HWDATA[11:0];
+				CTRL:   control <= HWDATA[2:0];
+				HOLD:   holdOff <= HWDATA;
+			endcase
+
+//================================  Timestamp ===============================
+
+	reg [7:0]  preCount;		// clock cycles in the current microsecond
+	reg [31:0] now;				// free running microsecond count
+
+	always @ (posedge HCLK)
+		if (!HRESETn)
+			begin
+				preCount <= 8'd0;
+				now      <= 32'd0;
+			end
+		else if (preCount == T_DIV - 1)
+			begin
+				preCount <= 8'd0;
+				now      <= now + 1'b1;
+			end
+		else
+			preCount <= preCount + 1'b1;
+
+	wire usTick = (preCount == T_DIV - 1);
+
+//================================  Sensor Data Stream ===============================
+
+	localparam [7:0] CMD_READ = 8'h0B, CMD_FIFO = 8'h0D;
+
+	reg [1:0]  byteIdx;			// 0 = command, 1 = address or first data, 2 = rest
+	reg [7:0]  cmd;				// command of this transaction
+	reg [7:0]  regAddr;			// register the next data byte comes from
+	reg [7:0]  lowByte;			// first byte of a 12-bit value
+	reg        lowValid;		// lowByte belongs to the next byte
+	reg        sampleValid;		// one cycle strobe, new sample below
+	reg [1:0]  sampleAxis;		// 0 = X, 1 = Y, 2 = Z
+	reg [11:0] sample;			// 12-bit two's complement
+	wire [7:0] offset12 = regAddr - 8'h0E;	// position in the 12-bit data registers
+
+	always @ (posedge HCLK)
+		if (!HRESETn)
+			begin
+				byteIdx     <= 2'd0;
+				cmd         <= 8'd0;
+				regAddr     <= 8'd0;
+				lowByte     <= 8'd0;
+				lowValid    <= 1'b0;
+				sampleValid <= 1'b0;
+				sampleAxis  <= 2'd0;
+				sample      <= 12'd0;
+			end
+		else
+			begin
+				sampleValid <= 1'b0;
+				if (byteValid)		// last byte of a frame arrives as chip select goes high
+					begin
+						if (byteIdx != 2'd2) byteIdx <= byteIdx + 1'b1;
+						if (byteIdx == 2'd0)
+							begin
+								cmd      <= byteTx;
+								lowValid <= 1'b0;
+							end
+						else if (cmd == CMD_FIFO)		// two bytes per entry, low first, axis in bits 15:14
+							begin
+								if (!lowValid)
+									begin
+										lowByte  <= byteRx;
+										lowValid <= 1'b1;
+									end
+								else
+									begin
+										lowValid    <= 1'b0;
+										sampleValid <= (byteRx[7:6] != 2'b11);		// 3 = temperature
+										sampleAxis  <= byteRx[7:6];
+										sample      <= {byteRx[3:0], lowByte};
+									end
+							end
+						else if (cmd == CMD_READ)
+							begin
+								if (byteIdx == 2'd1)
+									regAddr <= byteTx;
+								else
+									begin
+										regAddr <= regAddr + 1'b1;
+										if ((regAddr >= 8'h08) && (regAddr <= 8'h0A))	// 8-bit data, top bits of 12
+											begin
+												sampleValid <= 1'b1;
+												sampleAxis  <= regAddr[1:0];
+												sample      <= {byteRx, 4'b0};
+											end
+										else if ((regAddr >= 8'h0E) && (regAddr <= 8'h13))
+											begin
+												if (!offset12[0])			// low byte
+													begin
+														lowByte  <= byteRx;
+														lowValid <= 1'b1;
+													end
+												else						// high byte completes the sample
+													begin
+														lowValid    <= 1'b0;
+														sampleValid <= lowValid;
+														sampleAxis  <= offset12[2:1];
+														sample      <= {byteRx[3:0], lowByte};
+													end
+											end
+									end
+							end
+					end
+				else if (spiSSn)	// between transactions
+					byteIdx <= 2'd0;
+			end
+
+	// Compare magnitude with the threshold for this axis
+	wire [11:0] magnitude = sample[11] ? (~sample + 1'b1) : sample;	// -2048 gives 2048
+	reg  [11:0] threshold;
+	always @ (sampleAxis or thrX or thrY or thrZ)
+		case (sampleAxis)
+			2'd0:		threshold = thrX;
+			2'd1:		threshold = thrY;
+			default:	threshold = thrZ;
+		endcase
+
+	wire streamHit = control[0] & sampleValid & (threshold != 12'd0) & (magnitude >= threshold);
+
+	// INT1 pin, synchronised, rising edge
+	reg [2:0] pinSync;
+	always @ (posedge HCLK)
+		if (!HRESETn) pinSync <= 3'b0;
+		else pinSync <= {pinSync[1:0], extInt};
+	wire pinHit = control[1] & pinSync[1] & ~pinSync[2];
+
+//================================  Events ===============================
+
+	reg [31:0] holdCount;		// microseconds until the next event can be recorded
+	reg [31:0] eventCount;
+	reg        overflow;
+	wire       evFull, evEmpty;
+	wire [35:0] evHead;			// oldest event: pin, axes Z Y X, timestamp
+	wire       evPush = (streamHit | pinHit) & (holdCount == 32'd0);
+	wire       evPop  = rRead & (rHADDR == TIME);
+	wire [2:0] hitAxes = streamHit ? (3'b001 << sampleAxis) : 3'b000;
+
+	always @ (posedge HCLK)
+		if (!HRESETn)
+			begin
+				holdCount  <= 32'd0;
+				eventCount <= 32'd0;
+				overflow   <= 1'b0;
+			end
+		else
+			begin
+				if (evPush)
+					begin
+						holdCount  <= holdOff;
+						eventCount <= eventCount + 1'b1;
+						if (evFull) overflow <= 1'b1;
+					end
+				else if (usTick & (holdCount != 32'd0))
+					holdCount <= holdCount - 1'b1;
+				if (rWrite & (rHADDR == COUNT)) eventCount <= 32'd0;
+				if (rWrite & (rHADDR == STAT)) overflow <= 1'b0;
+			end
+
+	impact_fifo #(.A_WIDTH(F_ADDR)) eventFIFO (
+			.clk    (HCLK),
+			.reset  (~HRESETn),
+			.push   (evPush),
+			.din    ({pinHit, hitAxes, now}),
+			.pop    (evPop),
+			.dout   (evHead),
+			.full   (evFull),
+			.empty  (evEmpty)
+			);
+
+//================================  Read Data and Interrupt ===============================
+
+	wire [7:0] status = {evHead[35:32] & {4{~evEmpty}}, 1'b0, overflow, evFull, ~evEmpty};
+
+	// Bus read data
+	always @(rHADDR, thrX, thrY, thrZ, control, holdOff, eventCount, status, evHead, now)
+		case (rHADDR)		// select on word address (stored from address phase)
+			THRX:		readData = {20'b0, thrX};
+			THRY:		readData = {20'b0, thrY};
+			THRZ:		readData = {20'b0, thrZ};
+			CTRL:		readData = {29'b0, control};
+			HOLD:		readData = holdOff;
+			COUNT:		readData = eventCount;
+			STAT:		readData = {24'b0, status};
+			TIME:		readData = evHead[31:0];
+			NOW:		readData = now;
+			default:	readData = 32'b0;
+		endcase
+
+	assign HRDATA = readData;
+	assign HREADYOUT = 1'b1;	// always ready - transaction is never delayed
+
+	assign impact_IRQ = control[2] & ~evEmpty;	// request while any event is waiting
+
+endmodule
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Module Name:     impact_fifo
+// Description: 	Synchronous first-word-fall-through FIFO, 36 bits wide and
+//                  2^A_WIDTH words deep.  Push when full and pop when empty
+//                  are ignored.
+//////////////////////////////////////////////////////////////////////////////////
+module impact_fifo #(A_WIDTH = 3) (
+			input wire clk,
+			input wire reset,			// synchronous, active high
+			input wire push,			// add din to FIFO
+			input wire [35:0] din,
+			input wire pop,				// remove oldest word
+			output wire [35:0] dout,	// oldest word, valid when not empty
+			output wire full,
+			output wire empty
+	);
+
+	reg [35:0] mem [0:(1<<A_WIDTH)-1];
+	reg [A_WIDTH:0] wrPtr, rdPtr;		// extra bit distinguishes full from empty
+
+	assign empty = (wrPtr == rdPtr);
+	assign full  = (wrPtr == {~rdPtr[A_WIDTH], rdPtr[A_WIDTH-1:0]});
+	assign dout  = mem[rdPtr[A_WIDTH-1:0]];
+
+	always @ (posedge clk)
+		if (reset)
+			begin
+				wrPtr <= {(A_WIDTH+1){1'b0}};
+				rdPtr <= {(A_WIDTH+1){1'b0}};
+			end
+		else
+			begin
+				if (push & ~full)
+					begin
+						mem[wrPtr[A_WIDTH-1:0]] <= din;
+						wrPtr <= wrPtr + 1'b1;
+					end
+				if (pop & ~empty)
+					rdPtr <= rdPtr + 1'b1;
+			end
+
+endmodule
@@ -44,24 +44,31 @@ module AHBliteTop (
 // Note that signals HMASTLOCK and HBURST are omitted - not used by processor
     wire        HCLK;       // 50 MHz clock 
     wire        HRESETn;    // active low reset
-// Signals from processor
+// Signals from the bus arbiter, the processor or the DMA controller
     wire [31:0]	HWDATA;     // write data
     wire [31:0]	HADDR;      // address
     wire 		HWRITE;     // write signal
     wire [1:0] 	HTRANS;     // transaction type
     wire [3:0] 	HPROT;      // protection
     wire [2:0] 	HSIZE;      // transaction width
-// Signals to processor    
+// Signals to masters
     wire [31:0] HRDATA;     // read data
     wire		HREADY;     // ready signal from active slave
     wire 		HRESP;      // error response
+// Processor and DMA master signals, to and from the arbiter
+    wire [31:0]	HWDATA_cpu, HADDR_cpu, HWDATA_dma, HADDR_dma;
+    wire 		HWRITE_cpu, HWRITE_dma;
+    wire [1:0] 	HTRANS_cpu, HTRANS_dma;
+    wire [2:0] 	HSIZE_cpu, HSIZE_dma;
+    wire        HREADY_cpu;     // ready to the processor, low while the DMA holds it off
+    wire        dmaReq, dmaGrant;   // DMA wants, and owns, the address phase
     
 // ========================= Signals to-from individual slaves ==================
 // Slave select signals (one per slave)
-    wire        HSEL_rom, HSEL_ram, HSEL_gpio, HSEL_uart, HSEL_display;
+    wire        HSEL_rom, HSEL_ram, HSEL_gpio, HSEL_uart, HSEL_display, HSEL_spi, HSEL_impact, HSEL_perfmon, HSEL_dma;
 // Slave output signals (one per slave)
-    wire [31:0] HRDATA_rom, HRDATA_ram, HRDATA_gpio, HRDATA_uart,HRDATA_display;     // read data from slave
-    wire        HREADYOUT_rom, HREADYOUT_ram, HREADY_gpio, HREADY_uart, HREADY_display;   // ready output from slave
+    wire [31:0] HRDATA_rom, HRDATA_ram, HRDATA_gpio, HRDATA_uart,HRDATA_display, HRDATA_spi, HRDATA_impact, HRDATA_perfmon, HRDATA_dma;     // read data from slave
+    wire        HREADYOUT_rom, HREADYOUT_ram, HREADY_gpio, HREADY_uart, HREADY_display, HREADYOUT_spi, HREADYOUT_impact, HREADYOUT_perfmon, HREADYOUT_dma;   // ready output from slave
  
 
 // ======================== Other Interconnecting Signals =======================
@@ -71,6 +78,8 @@ module AHBliteTop (
     wire        ROMload;        // rom loader active
     wire [3:0]  muxSel;         // from address decoder to control the multiplexer
     wire [4:0]  buttons = {btnU, btnD, btnL, btnC, btnR};   // concatenate 5 pushbuttons
+    wire        spiByteValid;   // from SPI master, a byte has been exchanged with the accelerometer
+    wire [7:0]  spiByteTx, spiByteRx;   // the bytes sent and received
 
 // Wires and multiplexer to drive LEDs from two different sources - needed for ROM loader
     wire [11:0] led_rom;        // status output from ROM loader
@@ -130,7 +139,7 @@ module AHBliteTop (
     assign HRESP = 1'b0;    // no slaves use this signal yet
 
 // Connect appropriate bits of IRQ to any interrupt signals used, others 0
-    assign IRQ[15:2] = 14'b0;     // no interrupts in use yet, so all 0
+    assign IRQ[15:5] = 11'b0;     // no interrupts in use yet, so all 0
     assign IRQ[0] = 1'b0;
 
 // Instantiate Cortex-M0 DesignStart processor and connect signals 
@@ -138,17 +147,17 @@ module AHBliteTop (
         .HCLK       (HCLK),
         .HRESETn    (HRESETn), 
         // Outputs to bus
-        .HWDATA      (HWDATA), 
-        .HADDR       (HADDR), 
-        .HWRITE      (HWRITE), 
-        .HTRANS      (HTRANS), 
+        .HWDATA      (HWDATA_cpu), 
+        .HADDR       (HADDR_cpu), 
+        .HWRITE      (HWRITE_cpu), 
+        .HTRANS      (HTRANS_cpu), 
         .HPROT       (HPROT),
-        .HSIZE       (HSIZE),
+        .HSIZE       (HSIZE_cpu),
         .HMASTLOCK   (),        // not used, not connected
         .HBURST      (),        // not used, not connected
         // Inputs from bus	
         .HRDATA      (HRDATA),			
-        .HREADY      (HREADY),					
+        .HREADY      (HREADY_cpu),					
         .HRESP       (HRESP),					
         // Other signals
         .NMI         (NMI),
@@ -170,10 +179,10 @@ module AHBliteTop (
         .HSEL_S2    (HSEL_gpio),
         .HSEL_S3    (HSEL_uart),
         .HSEL_S4    (HSEL_display),
-        .HSEL_S5    (),
-        .HSEL_S6    (),
-        .HSEL_S7    (),
-        .HSEL_S8    (),
+        .HSEL_S5    (HSEL_spi),
+        .HSEL_S6    (HSEL_impact),
+        .HSEL_S7    (HSEL_perfmon),
+        .HSEL_S8    (HSEL_dma),
         .HSEL_S9    (),
         .HSEL_NOMAP (),             // indicates invalid address selected
         .MUX_SEL    (muxSel)        // multiplexer control signal out
@@ -192,10 +201,10 @@ module AHBliteTop (
         .HRDATA_S2      (HRDATA_gpio),
         .HRDATA_S3      (HRDATA_uart),
         .HRDATA_S4      (HRDATA_display),
-        .HRDATA_S5      (BAD_DATA),
-        .HRDATA_S6      (BAD_DATA),
-        .HRDATA_S7      (BAD_DATA),
-        .HRDATA_S8      (BAD_DATA),
+        .HRDATA_S5      (HRDATA_spi),
+        .HRDATA_S6      (HRDATA_impact),
+        .HRDATA_S7      (HRDATA_perfmon),
+        .HRDATA_S8      (HRDATA_dma),
         .HRDATA_S9      (BAD_DATA),
         .HRDATA_NOMAP   (BAD_DATA),
         .HRDATA         (HRDATA),           // read data output to master
@@ -205,10 +214,10 @@ module AHBliteTop (
         .HREADYOUT_S2   (HREADYOUT_gpio),
         .HREADYOUT_S3   (HREADYOUT_uart),             
         .HREADYOUT_S4   (HREADYOUT_display),                 // unused inputs tied to 1
-        .HREADYOUT_S5   (1'b1),
-        .HREADYOUT_S6   (1'b1),
-        .HREADYOUT_S7   (1'b1),
-        .HREADYOUT_S8   (1'b1),
+        .HREADYOUT_S5   (HREADYOUT_spi),
+        .HREADYOUT_S6   (HREADYOUT_impact),
+        .HREADYOUT_S7   (HREADYOUT_perfmon),
+        .HREADYOUT_S8   (HREADYOUT_dma),
         .HREADYOUT_S9   (1'b1),
         .HREADYOUT_NOMAP(1'b1),
         .HREADY         (HREADY)            // ready output to master and all slaves
@@ -268,7 +277,7 @@ module AHBliteTop (
                    .HRDATA      (HRDATA_gpio),         // read data 
                    .HREADYOUT   (HREADYOUT_gpio),    // ready output
                    .gpio_out0   (led_gpio),
-                   .gpio_out1   ({aclSCK,aclMOSI,aclSSn}),
+                   .gpio_out1   (),                 // accelerometer pins now driven by SPI block
                    .gpio_in0    (sw),
                    .gpio_in1    ({10'b0,aclMISO,buttons})   //concatentating
                    );
@@ -305,5 +314,112 @@ module AHBliteTop (
                    .segment     (segment)
                    );
 
+// ======================= SPI master for accelerometer ======================================
+    AHBspi SPI(
+                   .HCLK        (HCLK),            // bus clock
+                   .HRESETn     (HRESETn),            // bus reset, active low
+                   .HSEL        (HSEL_spi),        // selects this slave
+                   .HREADY      (HREADY),           // indicates previous transaction completing
+                   .HADDR       (HADDR),            // address
+                   .HTRANS      (HTRANS),           // transaction type (only bit 1 used)
+                   .HWRITE      (HWRITE),            // write transaction
+                   .HWDATA      (HWDATA),           // write data
+                   .HRDATA      (HRDATA_spi),         // read data 
+                   .HREADYOUT   (HREADYOUT_spi),    // ready output
+                   .spiMISO     (aclMISO),
+                   .spiMOSI     (aclMOSI),
+                   .spiSCK      (aclSCK),
+                   .spiSSn      (aclSSn),
+                   .spi_IRQ     (IRQ[2]),
+                   .monValid    (spiByteValid),
+                   .monTx       (spiByteTx),
+                   .monRx       (spiByteRx)
+                   );
+
+// ======================= High impact detector ======================================
+    AHBimpact Impact(
+                   .HCLK        (HCLK),            // bus clock
+                   .HRESETn     (HRESETn),            // bus reset, active low
+                   .HSEL        (HSEL_impact),        // selects this slave
+                   .HREADY      (HREADY),           // indicates previous transaction completing
+                   .HADDR       (HADDR),            // address
+                   .HTRANS      (HTRANS),           // transaction type (only bit 1 used)
+                   .HWRITE      (HWRITE),            // write transaction
+                   .HWDATA      (HWDATA),           // write data
+                   .HRDATA      (HRDATA_impact),         // read data 
+                   .HREADYOUT   (HREADYOUT_impact),    // ready output
+                   .spiSSn      (aclSSn),           // watches the accelerometer data stream
+                   .byteValid   (spiByteValid),
+                   .byteTx      (spiByteTx),
+                   .byteRx      (spiByteRx),
+                   .extInt      (1'b0),             // ADXL362 INT1 not yet in the pin constraints
+                   .impact_IRQ  (IRQ[3])
+                   );
+
+// ======================= Performance monitor ======================================
+    AHBperfmon PerfMon(
+                   .HCLK        (HCLK),            // bus clock
+                   .HRESETn     (HRESETn),            // bus reset, active low
+                   .HSEL        (HSEL_perfmon),        // selects this slave
+                   .HREADY      (HREADY),           // indicates previous transaction completing
+                   .HADDR       (HADDR),            // address
+                   .HTRANS      (HTRANS),           // transaction type (only bit 1 used)
+                   .HWRITE      (HWRITE),            // write transaction
+                   .HWDATA      (HWDATA),           // write data
+                   .HRDATA      (HRDATA_perfmon),         // read data 
+                   .HREADYOUT   (HREADYOUT_perfmon),    // ready output
+                   .slaveSel    ({HSEL_impact, HSEL_spi, HSEL_display, HSEL_uart, HSEL_gpio, HSEL_ram, HSEL_rom}),
+                   .sleeping    (CPUsleep)          // processor waiting for interrupt
+                   );
+
+// ======================= DMA controller ======================================
+    AHBdma DMA(
+                   .HCLK        (HCLK),            // bus clock
+                   .HRESETn     (HRESETn),            // bus reset, active low
+                   .HSEL        (HSEL_dma),        // selects this slave
+                   .HREADY      (HREADY),           // indicates previous transaction completing
+                   .HADDR       (HADDR),            // address
+                   .HTRANS      (HTRANS),           // transaction type (only bit 1 used)
+                   .HWRITE      (HWRITE),            // write transaction
+                   .HWDATA      (HWDATA),           // write data
+                   .HRDATA      (HRDATA_dma),         // read data 
+                   .HREADYOUT   (HREADYOUT_dma),    // ready output
+                   .mReq        (dmaReq),           // master port, to the arbiter
+                   .mGrant      (dmaGrant),
+                   .mHADDR      (HADDR_dma),
+                   .mHTRANS     (HTRANS_dma),
+                   .mHWRITE     (HWRITE_dma),
+                   .mHSIZE      (HSIZE_dma),
+                   .mHWDATA     (HWDATA_dma),
+                   .mHRDATA     (HRDATA),           // read data from the multiplexer
+                   .dma_IRQ     (IRQ[4])
+                   );
+
+// ======================= Bus arbiter ======================================
+// Shares the bus between the processor and the DMA controller
+    AHBarbiter Arbiter(
+                   .HCLK        (HCLK),
+                   .HRESETn     (HRESETn),
+                   .cHADDR      (HADDR_cpu),        // processor
+                   .cHTRANS     (HTRANS_cpu),
+                   .cHWRITE     (HWRITE_cpu),
+                   .cHSIZE      (HSIZE_cpu),
+                   .cHWDATA     (HWDATA_cpu),
+                   .cHREADY     (HREADY_cpu),
+                   .dReq        (dmaReq),           // DMA controller
+                   .dGrant      (dmaGrant),
+                   .dHADDR      (HADDR_dma),
+                   .dHTRANS     (HTRANS_dma),
+                   .dHWRITE     (HWRITE_dma),
+                   .dHSIZE      (HSIZE_dma),
+                   .dHWDATA     (HWDATA_dma),
+                   .HADDR       (HADDR),            // bus to decoder and slaves
+                   .HTRANS      (HTRANS),
+                   .HWRITE      (HWRITE),
+                   .HSIZE       (HSIZE),
+                   .HWDATA      (HWDATA),
+                   .HREADY      (HREADY)            // from the multiplexer
+                   );
+
 
 endmodule
@@ -0,0 +1,147 @@
+`timescale 1ns / 1ns
+//////////////////////////////////////////////////////////////////////////////////
+// Company: UCD School of Electrical and Electronic Engineering
+// Engineer: Aidan O'Sullivan
+//
+// Create Date:     April 2021
+// Design Name:     Cortex-M0 DesignStart system
+// Module Name:     AHBperfmon
+// Description: 	Performance monitor.  Watches every transfer on the bus
+//                  and counts where the time goes, so the firmware can
+//                  measure its own cost without disturbing it.
+//		Address 0x00 - read/write, control register:
+//			bit 0 - run, counters advance while set
+//			bit 1 - write only, clear all counters
+//			bit 2 - write only, snapshot: copy all counters to the
+//				registers below in one clock cycle
+//			Snapshot and clear in the same write start a new window with
+//			no cycle lost between windows: the cycle of the write counts
+//			in the new window.
+//		Address 0x04 - read, live cycle counter, for timing short sections
+//		Snapshot of the counters, read only:
+//		Address 0x08 - clock cycles
+//		Address 0x0C - idle cycles, processor awake with no transfer
+//		Address 0x10 - sleep cycles, processor in WFI
+//		Address 0x14 - wait states, cycles with HREADY low
+//		Address 0x18 - read transfers
+//		Address 0x1C - write transfers
+//		Address 0x20 - transfers to ROM		(S0)
+//		Address 0x24 - transfers to RAM		(S1)
+//		Address 0x28 - transfers to GPIO		(S2)
+//		Address 0x2C - transfers to UART		(S3)
+//		Address 0x30 - transfers to display	(S4)
+//		Address 0x34 - transfers to SPI		(S5)
+//		Address 0x38 - transfers to impact	(S6)
+//		Address 0x3C - transfers to anything else: this monitor (S7),
+//			the DMA controller's registers (S8) and unmapped addresses
+//		This version only handles 32-bit bus transactions.
+//
+//		A transfer is counted in its address phase, when HTRANS is
+//		non-sequential or sequential and HREADY is high.  Busy cycles are
+//		cycles - idle - sleep, so bus utilisation is busy / cycles.  The
+//		counters are 32 bits and wrap after 86 s at 50 MHz, so take a
+//		snapshot well within that.
+//
+//////////////////////////////////////////////////////////////////////////////////
+module AHBperfmon (
+			// Bus signals
+			input wire HCLK,			// bus clock
+			input wire HRESETn,			// bus reset, active low
+			input wire HSEL,			// selects this slave
+			input wire HREADY,			// indicates previous transaction completing
+			input wire [31:0] HADDR,	// address
+			input wire [1:0] HTRANS,	// transaction type (only bit 1 used)
+			input wire HWRITE,			// write transaction
+//			input wire [2:0] HSIZE,		// transaction width ignored
+			input wire [31:0] HWDATA,	// write data
+			output wire [31:0] HRDATA,	// read data from slave
+			output wire HREADYOUT,		// ready output from slave
+			// Signals watched
+			input wire [6:0] slaveSel,	// slave selects S6 to S0 from the address decoder
+			input wire sleeping			// processor SLEEPING output
+	);
+
+//================================  AHB-Lite Bus Interface =============================
+	// Address bits for registers, snapshot registers follow NOW
+	localparam [3:0] CTRL = 4'h0, NOW = 4'h1;
+	localparam NCOUNT = 14;		// counters, in the order of the snapshot registers
+
+	// Registers to hold signals from address phase
+	reg [3:0] rHADDR;			// only need four bits of address
+	reg rWrite;					// write enable signal
+	reg rRead;					// read enable signal
+
+	// Capture bus signals in address phase
+	always @ (posedge HCLK)
+		if (!HRESETn)
+			begin
+				rHADDR <= 4'b0;
+				rWrite <= 1'b0;
+				rRead  <= 1'b0;
+			end
+		else if (HREADY)	// previous bus transaction is completing
+			begin
+				rHADDR <= HADDR[5:2];  // capture address bits for for use in data phase
+				rWrite <= HSEL & HWRITE & HTRANS[1];   // slave selected for write transfer
+				rRead  <= HSEL & ~HWRITE & HTRANS[1];  // slave selected for read transfer
+			end
+
+	// Control register, as described above
+	reg  run;
+	wire ctrlWrite = rWrite & (rHADDR == CTRL);
+	wire clear     = ctrlWrite & HWDATA[1];
+	wire snap      = ctrlWrite & HWDATA[2];
+
+	always @ (posedge HCLK)
+		if (!HRESETn)
+			run <= 1'b0;
+		else if (ctrlWrite)
+			run <= HWDATA[0];
+
+//================================  Counters ===============================
+
+	wire transfer = HREADY & HTRANS[1];		// address phase of a transfer
+	wire [NCOUNT-1:0] tally;				// one bit for each counter, counts while high
+
+	assign tally[0]  = 1'b1;									// cycles
+	assign tally[1]  = HREADY & ~HTRANS[1] & ~sleeping;			// idle
+	assign tally[2]  = sleeping;								// sleep
+	assign tally[3]  = ~HREADY;									// wait states
+	assign tally[4]  = transfer & ~HWRITE;						// reads
+	assign tally[5]  = transfer & HWRITE;						// writes
+	assign tally[12:6]  = {7{transfer}} & slaveSel;				// per slave
+	assign tally[13] = transfer & ~|slaveSel;					// anything else
+
+	reg [31:0] count [0:NCOUNT-1];
+	reg [31:0] snapshot [0:NCOUNT-1];
+	integer i;
+
+	always @ (posedge HCLK)
+		if (!HRESETn)
+			for (i = 0; i < NCOUNT; i = i + 1)
+				begin
+					count[i]    <= 32'd0;
+					snapshot[i] <= 32'd0;
+				end
+		else
+			for (i = 0; i < NCOUNT; i = i + 1)
+				begin
+					if (snap)
+						snapshot[i] <= count[i];
+					if (clear)			// this cycle is the first of the new window
+						count[i] <= {31'b0, run & tally[i]};
+					else if (run & tally[i])
+						count[i] <= count[i] + 1'b1;
+				end
+
+//================================  Read Data ===============================
+
+	wire [3:0] snapIdx = rHADDR - 4'd2;		// snapshot register addressed
+
+	assign HRDATA = (rHADDR == CTRL) ? {31'b0, run} :
+					(rHADDR == NOW)  ? count[0] :
+					snapshot[snapIdx];
+
+	assign HREADYOUT = 1'b1;	// always ready - transaction is never delayed
+
+endmodule
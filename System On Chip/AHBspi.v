@@ -0,0 +1,330 @@
+`timescale 1ns / 1ns
+//////////////////////////////////////////////////////////////////////////////////
+// Company: UCD School of Electrical and Electronic Engineering
+// Engineer: Aidan O'Sullivan
+//
+// Create Date:     April 2021
+// Design Name:     Cortex-M0 DesignStart system
+// Module Name:     AHBspi
+// Description: 	SPI master (mode 0: clock idles low, data sampled on the
+//                  rising edge) for the ADXL362 accelerometer, with transmit
+//                  and receive FIFOs so that a whole transaction can be queued
+//                  with a few bus writes instead of bit-banging the GPIO pins.
+//		Address 0x00 - read, oldest byte in receive FIFO (read removes it)
+//		Address 0x04 - write, byte added to transmit FIFO, sent as soon as
+//			the shifter is free
+//		Address 0x08 - read, status register:
+//			bit 0 - transmit FIFO full
+//			bit 1 - transmit FIFO empty
+//			bit 2 - receive FIFO full
+//			bit 3 - receive FIFO not empty (data available)
+//			bit 4 - busy, a byte is being shifted
+//			bit 5 - done, transfer complete (sticky)
+//			bit 6 - receive overrun, byte lost because FIFO full (sticky)
+//			Any write to this address clears the sticky bits 5 and 6.
+//		Address 0x0C - read/write, control register:
+//			bits 6:0 - interrupt enables, one for each status bit above
+//		Address 0x10 - read/write, clock divider. SCK half period is
+//			(value + 1) HCLK cycles, so 4 gives 5 MHz with a 50 MHz clock.
+//		Address 0x14 - read/write, bit 0 - chip select level used when no
+//			frame is active (1 = deasserted)
+//		Address 0x18 - write, frame length: chip select is asserted for
+//			exactly this number of bytes and released half an SCK period
+//			after the last falling edge, for the ADXL362 hold time (tCSH).
+//			Read gives the number of bytes remaining in the frame.
+//		The done bit is set when a frame completes and chip select is
+//		released.  Outside a frame it is
+//		set when the shifter goes idle with the transmit FIFO empty, so a
+//		frame is never reported done early if the FIFO runs dry mid-frame.
+//		This version only handles 32-bit bus transactions.
+//
+//		Each byte exchanged is also presented on the monitor outputs, sent
+//		and received bytes with a one cycle strobe, for peripherals that 
+//		watch the sensor data stream.
+//
+//		FIFO depth is 2^F_ADDR, with default value 4 (16 bytes), enough
+//		to hold a full ADXL362 burst read of all axes at 12-bit resolution.
+//
+//////////////////////////////////////////////////////////////////////////////////
+module AHBspi #(F_ADDR = 4) (
+			// Bus signals
+			input wire HCLK,			// bus clock
+			input wire HRESETn,			// bus reset, active low
+			input wire HSEL,			// selects this slave
+			input wire HREADY,			// indicates previous transaction completing
+			input wire [31:0] HADDR,	// address
+			input wire [1:0] HTRANS,	// transaction type (only bit 1 used)
+			input wire HWRITE,			// write transaction
+//			input wire [2:0] HSIZE,		// transaction width ignored
+			input wire [31:0] HWDATA,	// write data
+			output wire [31:0] HRDATA,	// read data from slave
+			output wire HREADYOUT,		// ready output from slave
+			// SPI signals
+			input wire spiMISO,			// serial data from slave
+			output reg spiMOSI,			// serial data to slave
+			output reg spiSCK,			// serial clock, idles low
+			output wire spiSSn,			// slave select, active low
+			// Interrupt
+			output wire spi_IRQ,		// interrupt request, active high
+			// Monitor of the data stream
+			output reg monValid,		// one cycle strobe, a byte has been exchanged
+			output reg [7:0] monTx,		// byte sent
+			output wire [7:0] monRx		// byte received
+	);
+
+//================================  AHB-Lite Bus Interface =============================
+	// Address bits for registers
+	localparam [2:0] RXD = 3'h0, TXD = 3'h1, STAT = 3'h2, CTRL = 3'h3,
+					 CDIV = 3'h4, CSEL = 3'h5, FRAME = 3'h6;
+
+	// Registers to hold signals from address phase
+	reg [2:0] rHADDR;			// only need three bits of address
+	reg rWrite;					// write enable signal
+	reg rRead;					// read enable signal
+
+	// Internal signals
+	reg [31:0] readData;		// ouptut of read multiplexer
+
+	// Capture bus signals in address phase
+	always @ (posedge HCLK)
+		if (!HRESETn)
+			begin
+				rHADDR <= 3'b0;
+				rWrite <= 1'b0;
+				rRead  <= 1'b0;
+			end
+		else if (HREADY)	// previous bus transaction is completing
+			begin
+				rHADDR <= HADDR[4:2];  // capture address bits for for use in data phase
+				rWrite <= HSEL & HWRITE & HTRANS[1];   // slave selected for write transfer
+				rRead  <= HSEL & ~HWRITE & HTRANS[1];  // slave selected for read transfer
+			end
+
+	// Registers visible on the AHB-Lite bus, as described above
+	reg [6:0] control;			// interrupt enables
+	reg [7:0] clkDiv;			// SCK half period - 1, in HCLK cycles
+	reg       csLevel;			// chip select level outside a frame
+	reg [7:0] frameCount;		// bytes remaining in current frame
+	reg       done, overrun;	// sticky status bits
+	wire [6:0] status;			// assembled status register
+
+	always @ (posedge HCLK)
+		if (!HRESETn)
+			begin
+				control <= 7'b0;
+				clkDiv  <= 8'd4;
+				csLevel <= 1'b1;
+			end
+		else if (rWrite)  // writing to a register
+			case (rHADDR)
+				CTRL:   control <= HWDATA[6:0];
+				CDIV:   clkDiv  <= HWDATA[7:0];
+				CSEL:   csLevel <= HWDATA[0];
+			endcase
+
+//================================  FIFOs ===============================
+
+	wire       txFull, txEmpty, rxFull, rxEmpty;
+	wire [7:0] txHead, rxHead;		// oldest byte in each FIFO
+	wire       txPush = rWrite & (rHADDR == TXD);	// write to transmit data address
+	wire       rxPop  = rRead & (rHADDR == RXD);	// read from receive data address
+	reg        txPop, rxPush;		// from shift engine
+	reg  [7:0] rxByte;				// byte to put in receive FIFO
+
+	spi_fifo #(.A_WIDTH(F_ADDR)) txFIFO (
+			.clk    (HCLK),
+			.reset  (~HRESETn),
+			.push   (txPush),
+			.din    (HWDATA[7:0]),
+			.pop    (txPop),
+			.dout   (txHead),
+			.full   (txFull),
+			.empty  (txEmpty)
+			);
+
+	spi_fifo #(.A_WIDTH(F_ADDR)) rxFIFO (
+			.clk    (HCLK),
+			.reset  (~HRESETn),
+			.push   (rxPush),
+			.din    (rxByte),
+			.pop    (rxPop),
+			.dout   (rxHead),
+			.full   (rxFull),
+			.empty  (rxEmpty)
+			);
+
+//================================  Shift Engine ===============================
+
+	reg [7:0] divCount;		// counts HCLK cycles in each half period of SCK
+	reg [7:0] txShift;		// byte being sent, MSB first
+	reg [7:0] rxShift;		// byte being received, MSB first
+	reg [2:0] bitCount;		// bit within the current byte
+	reg       busy;			// shifter active
+	reg       csHold;		// last byte of a frame sent, chip select held for a half period
+	wire      halfTick = (divCount == clkDiv);	// end of SCK half period
+	wire      frameWrite = rWrite & (rHADDR == FRAME);
+
+	always @ (posedge HCLK)
+		if (!HRESETn)
+			begin
+				spiSCK     <= 1'b0;
+				spiMOSI    <= 1'b0;
+				busy       <= 1'b0;
+				csHold     <= 1'b0;
+				divCount   <= 8'd0;
+				bitCount   <= 3'd0;
+				txShift    <= 8'd0;
+				rxShift    <= 8'd0;
+				rxByte     <= 8'd0;
+				frameCount <= 8'd0;
+				done       <= 1'b0;
+				overrun    <= 1'b0;
+				txPop      <= 1'b0;
+				rxPush     <= 1'b0;
+				monValid   <= 1'b0;
+				monTx      <= 8'd0;
+			end
+		else
+			begin
+				txPop  <= 1'b0;		// default - single cycle strobes
+				rxPush <= 1'b0;
+				monValid <= 1'b0;
+				if (rWrite & (rHADDR == STAT))	// clear sticky bits
+					begin
+						done    <= 1'b0;
+						overrun <= 1'b0;
+					end
+				if (frameWrite)
+					frameCount <= HWDATA[7:0];
+				if (!busy)
+					begin
+						divCount <= 8'd0;
+						if (!txEmpty & !txPop)	// byte waiting, start shifting it
+							begin
+								busy     <= 1'b1;
+								txShift  <= txHead;
+								monTx    <= txHead;
+								spiMOSI  <= txHead[7];	// first bit valid before first rising edge
+								bitCount <= 3'd0;
+								txPop    <= 1'b1;
+							end
+					end
+				else if (!halfTick)
+					divCount <= divCount + 1'b1;
+				else
+					begin
+						divCount <= 8'd0;
+						if (csHold)			// end of chip select hold - frame complete
+							begin
+								csHold <= 1'b0;
+								busy   <= 1'b0;
+								if (!frameWrite) frameCount <= 8'd0;
+								done   <= 1'b1;
+							end
+						else if (!spiSCK)	// rising edge - sample MISO
+							begin
+								spiSCK  <= 1'b1;
+								rxShift <= {rxShift[6:0], spiMISO};
+							end
+						else				// falling edge - next bit or end of byte
+							begin
+								spiSCK <= 1'b0;
+								if (bitCount == 3'd7)
+									begin
+										rxByte <= rxShift;
+										rxPush <= ~rxFull;
+										monValid <= 1'b1;
+										if (rxFull) overrun <= 1'b1;
+										if (frameCount == 8'd1)
+											csHold <= 1'b1;		// last byte of the frame, still busy
+										else
+											begin
+												busy <= 1'b0;
+												if (frameCount != 8'd0)
+													begin
+														if (!frameWrite) frameCount <= frameCount - 1'b1;
+													end
+												else if (txEmpty) done <= 1'b1;	// no frame, nothing more to send
+											end
+									end
+								else
+									begin
+										bitCount <= bitCount + 1'b1;
+										txShift  <= {txShift[6:0], 1'b0};
+										spiMOSI  <= txShift[6];
+									end
+							end
+					end
+			end
+
+	// Chip select is held low for the whole of a frame, otherwise follows csLevel
+	assign spiSSn = (frameCount != 8'd0) ? 1'b0 : csLevel;
+
+//================================  Status, Read Data and Interrupt ===============================
+
+	assign status = {overrun, done, busy, ~rxEmpty, rxFull, txEmpty, txFull};
+
+	// Bus read data
+	always @(rHADDR, rxHead, status, control, clkDiv, csLevel, frameCount)
+		case (rHADDR)		// select on word address (stored from address phase)
+			RXD:		readData = {24'b0, rxHead};
+			STAT:		readData = {25'b0, status};
+			CTRL:		readData = {25'b0, control};
+			CDIV:		readData = {24'b0, clkDiv};
+			CSEL:		readData = {31'b0, csLevel};
+			FRAME:		readData = {24'b0, frameCount};
+			default:	readData = 32'b0;	// transmit data is write only
+		endcase
+
+	assign HRDATA = readData;
+	assign HREADYOUT = 1'b1;	// always ready - transaction is never delayed
+
+	assign spi_IRQ = |(status & control);	// any enabled status bit requests interrupt
+
+	assign monRx = rxByte;		// valid with monValid
+
+endmodule
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Module Name:     spi_fifo
+// Description: 	Synchronous first-word-fall-through FIFO, 8 bits wide and
+//                  2^A_WIDTH words deep.  Push when full and pop when empty
+//                  are ignored.
+//////////////////////////////////////////////////////////////////////////////////
+module spi_fifo #(A_WIDTH = 4) (
+			input wire clk,
+			input wire reset,			// synchronous, active high
+			input wire push,			// add din to FIFO
+			input wire [7:0] din,
+			input wire pop,				// remove oldest word
+			output wire [7:0] dout,		// oldest word, valid when not empty
+			output wire full,
+			output wire empty
+	);
+
+	reg [7:0] mem [0:(1<<A_WIDTH)-1];
+	reg [A_WIDTH:0] wrPtr, rdPtr;		// extra bit distinguishes full from empty
+
+	assign empty = (wrPtr == rdPtr);
+	assign full  = (wrPtr == {~rdPtr[A_WIDTH], rdPtr[A_WIDTH-1:0]});
+	assign dout  = mem[rdPtr[A_WIDTH-1:0]];
+
+	always @ (posedge clk)
+		if (reset)
+			begin
+				wrPtr <= {(A_WIDTH+1){1'b0}};
+				rdPtr <= {(A_WIDTH+1){1'b0}};
+			end
+		else
+			begin
+				if (push & ~full)
+					begin
+						mem[wrPtr[A_WIDTH-1:0]] <= din;
+						wrPtr <= wrPtr + 1'b1;
+					end
+				if (pop & ~empty)
+					rdPtr <= rdPtr + 1'b1;
+			end
+
+endmodule
@@ -52,13 +52,35 @@ typedef struct {
 	};
 } NVIC_t;
 #define NVIC_UART_BIT_POS		1      // bit position of UART in ARM's interrupt control register
+#define NVIC_SPI_BIT_POS		2      // bit position of SPI master in ARM's interrupt control register
+#define NVIC_IMPACT_BIT_POS		3      // bit position of impact detector in ARM's interrupt control register
+#define NVIC_DMA_BIT_POS		4      // bit position of DMA controller in ARM's interrupt control register
+
+typedef struct {
+	volatile uint32	CTRL;      // control and status
+	volatile uint32	LOAD;      // reload value, counter runs LOAD down to 0
+	volatile uint32	VAL;       // current value, any write clears it
+	volatile uint32	CALIB;     // calibration, read only
+} SysTick_t;
+#define SYSTICK_ENABLE			(1 << 0)     // counter enable
+#define SYSTICK_TICKINT			(1 << 1)     // SysTick exception when counter reaches 0
+#define SYSTICK_CLKSOURCE		(1 << 2)     // count processor clock cycles
+#define SYSTICK_COUNTFLAG		(1 << 16)    // counter reached 0 since last read
 
 typedef struct{
 		volatile uint32	rawLow;
 		volatile uint32 rawHigh;
 		volatile uint32 hexData;
 		volatile uint32 control; //this is supposed to be a 24 bit value
+		volatile uint32 decData;  // signed number shown in decimal
+		volatile uint32 decConfig; // decimal field position, width and decimal point
 } Display_t;
+#define DISPLAY_DEC_OFFSET_POS		0            // digit holding the units of the decimal field
+#define DISPLAY_DEC_WIDTH_POS		4            // field width in digits, 0 to 8
+#define DISPLAY_DEC_DP_POS			8            // decimal point, digits left of the units digit
+#define DISPLAY_DEC_DP_ENABLE		(1 << 11)
+#define DISPLAY_DEC_ENABLE			(1 << 16)    // field shows decData, overriding control
+#define DISPLAY_DEC_BUSY			(1UL << 31)  // read only, conversion in progress
 
 
 typedef struct {
@@ -84,10 +106,136 @@ typedef struct {
 
 
 
+typedef struct {
+	union {
+		volatile uint8   RxData;
+		volatile uint32  reserved0;
+	};
+	union {
+		volatile uint8   TxData;
+		volatile uint32  reserved1;
+	};
+	union {
+		volatile uint8   Status;
+		volatile uint32  reserved2;
+	};
+	union {
+		volatile uint8   Control;
+		volatile uint32  reserved3;
+	};
+	union {
+		volatile uint8   ClkDiv;     // SCK half period = ClkDiv+1 bus clock cycles
+		volatile uint32  reserved4;
+	};
+	union {
+		volatile uint8   ChipSel;    // chip select level outside a frame, 1 = deasserted
+		volatile uint32  reserved5;
+	};
+	union {
+		volatile uint8   Frame;      // number of bytes to hold chip select low for
+		volatile uint32  reserved6;
+	};
+} SPI_t;
+// bit position defs for the SPI status register - first four match the UART
+#define SPI_TX_FIFO_FULL_BIT_POS		0			// Tx FIFO full
+#define SPI_TX_FIFO_EMPTY_BIT_POS		1			// Tx FIFO empty
+#define SPI_RX_FIFO_FULL_BIT_POS		2			// Rx FIFO full
+#define SPI_RX_FIFO_EMPTY_BIT_POS		3			// Rx FIFO not empty (data available)
+#define SPI_BUSY_BIT_POS				4			// byte being shifted
+#define SPI_DONE_BIT_POS				5			// transfer complete, cleared by writing Status
+#define SPI_OVERRUN_BIT_POS				6			// Rx byte lost, cleared by writing Status
+// interrupt enables in the control register use the same bit positions as the status register
+#define SPI_FIFO_SIZE					16			// bytes in each FIFO, must match F_ADDR in AHBspi.v
+
+typedef struct {
+	volatile uint32	ThresholdX;  // 12-bit magnitude in sensor LSB, 0 = axis not checked
+	volatile uint32	ThresholdY;
+	volatile uint32	ThresholdZ;
+	union {
+		volatile uint8   Control;
+		volatile uint32  reserved3;
+	};
+	volatile uint32	HoldOff;     // microseconds after an event before another is recorded
+	volatile uint32	Count;       // events since reset, write to clear
+	union {
+		volatile uint8   Status;
+		volatile uint32  reserved6;
+	};
+	volatile uint32	Time;        // timestamp of oldest event, reading removes it
+	volatile uint32	Now;         // free running microsecond timestamp
+} Impact_t;
+// bit defs for the impact detector control register
+#define IMPACT_STREAM_ENABLE	(1 << 0)     // check sensor data read over SPI
+#define IMPACT_PIN_ENABLE		(1 << 1)     // ADXL362 INT1 rising edge is an event
+#define IMPACT_INT_ENABLE		(1 << 2)     // interrupt while an event is waiting
+// bit defs for the impact detector status register
+#define IMPACT_EVENT_WAITING	(1 << 0)
+#define IMPACT_FIFO_FULL		(1 << 1)
+#define IMPACT_OVERFLOW			(1 << 2)     // event lost, cleared by writing Status
+#define IMPACT_AXES_POS			4            // axes of oldest event, bit 4 = X, 5 = Y, 6 = Z
+#define IMPACT_FROM_PIN			(1 << 7)     // oldest event came from the INT1 pin
+
+typedef struct {
+	volatile uint32	Control;     // run, clear and snapshot
+	volatile uint32	Now;         // live cycle count
+	volatile uint32	Cycles;      // snapshot registers from here on
+	volatile uint32	Idle;        // awake with no bus transfer
+	volatile uint32	Sleep;       // in WFI
+	volatile uint32	Wait;        // wait states
+	volatile uint32	Reads;
+	volatile uint32	Writes;
+	volatile uint32	Slave[8];    // transfers to each slave, indexed by PERFMON_ROM etc.
+} PerfMon_t;
+// bit defs for the performance monitor control register
+#define PERFMON_RUN				(1 << 0)     // counters advance
+#define PERFMON_CLEAR			(1 << 1)     // write only, all counters to 0
+#define PERFMON_SNAP			(1 << 2)     // write only, copy counters to the snapshot registers
+// index of each slave in Slave[], the decoder slot number
+#define PERFMON_ROM				0
+#define PERFMON_RAM				1
+#define PERFMON_GPIO			2
+#define PERFMON_UART			3
+#define PERFMON_DISPLAY			4
+#define PERFMON_SPI				5
+#define PERFMON_IMPACT			6
+#define PERFMON_OTHER			7            // the monitor itself, the DMA registers and unmapped addresses
+
+typedef struct {
+	volatile uint32	Src;         // source address, advanced as data moves
+	volatile uint32	Dst;         // destination address, advanced as data moves
+	volatile uint32	Count;       // transfers remaining, 16 bits
+	volatile uint32	Control;
+	volatile uint32	Poll;        // status register polled before each transfer, if paced
+	volatile uint32	Match;       // transfer when (*Poll & mask) == value, see DMA_MATCH
+	volatile uint32	reserved[2];
+} DMAChannel_t;
+typedef struct {
+	DMAChannel_t	Ch[2];
+	volatile uint32	Status;      // done bits, write 1 to clear, and enabled bits
+} DMA_t;
+// bit defs for the DMA channel control register
+#define DMA_ENABLE				(1 << 0)     // start, cleared by the channel when done
+#define DMA_SRC_INC				(1 << 1)     // increment source address
+#define DMA_DST_INC				(1 << 2)     // increment destination address
+#define DMA_BYTE				(0 << 4)     // transfer size
+#define DMA_HALF				(1 << 4)
+#define DMA_WORD				(2 << 4)
+#define DMA_PACED				(1 << 6)     // wait for the poll register to match before each transfer
+#define DMA_INT_ENABLE			(1 << 7)     // interrupt when done
+#define DMA_MATCH(mask, value)	((mask) | ((value) << 8))
+// bit defs for the DMA status register, n is the channel
+#define DMA_DONE(n)				(1 << (n))
+#define DMA_ACTIVE(n)			(1 << (4 + (n)))
+
 // use above typedefs to define the memory map.
 #define pt2NVIC ((NVIC_t *)0xE000E100)
+#define pt2SysTick ((SysTick_t *)0xE000E010)
 #define pt2UART ((UART_t *)0x51000000)
 #define pt2GPIO ((GPIO_t *)0x50000000)
 #define pt2Display ((Display_t *) 0x52000000) // insert address from AHBCD.v
+#define pt2SPI ((SPI_t *)0x53000000)
+#define pt2Impact ((Impact_t *)0x54000000)
+#define pt2PerfMon ((PerfMon_t *)0x55000000)
+#define pt2DMA ((DMA_t *)0x56000000)
 
 #endif
@@ -0,0 +1,16 @@
+//------------------------------------------------------------------------------------------------------
+// main.c built for the host simulation harness, sim_host.c.
+// Its entry point is renamed so the harness can start it, printf goes through the firmware's own
+// fputc, and the compiler intrinsics are provided by the harness.
+//------------------------------------------------------------------------------------------------------
+#undef _FORTIFY_SOURCE
+#pragma GCC diagnostic ignored "-Wpointer-to-int-cast"   // DMA addresses, below 4 GB with -no-pie
+
+void __wfi(void);
+void __disable_irq(void);
+void __enable_irq(void);
+int sim_printf(const char *fmt, ...);
+
+#define main firmware_main
+#define printf sim_printf
+#include "../main.c"
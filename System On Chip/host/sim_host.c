@@ -0,0 +1,920 @@
+//------------------------------------------------------------------------------------------------------
+// Host simulation harness for the Cortex-M0 SoC firmware
+//
+// Builds main.c unchanged for x86-64 Linux.  The peripheral addresses used by the pt2* macros in
+// DES_M0_SoC.h are mapped at the same addresses here, with no access allowed, so every register
+// read or write by the firmware traps.  The trap handler lets the single instruction complete
+// under the processor's trap flag, then passes the access to a model of the peripheral:
+//   GPIO     - switches set on the command line, LEDs captured
+//   UART     - transmit FIFO drained at the baud rate, output captured in a buffer
+//   Display  - registers captured
+//   SPI      - AHBspi model with a behavioural ADXL362 on the end of it
+//   Impact   - AHBimpact, parsing the SPI byte stream the same way as the hardware
+//   PerfMon  - AHBperfmon counters, for the transfers the harness can see
+//   DMA      - AHBdma channels, moving data between host memory and the models above
+//   NVIC and SysTick
+// Interrupts are delivered between instructions, after a trapped access, at __enable_irq() and
+// __WFI(), and from a watchdog timer if the firmware spins on memory with no register accesses.
+//
+// Simulated time: each bus access costs BUS_CYCLES, each SPI byte costs its shift time, WFI skips
+// to the next event.  Instruction time between accesses is not modelled, so results are a lower
+// bound on CPU time but exact for bus, SPI and UART traffic.
+//
+// Build and run from the "System On Chip" directory (firmware.c wraps main.c):
+//   gcc -O1 -fno-inline -rdynamic -no-pie -o sim_host host/sim_host.c host/firmware.c -ldl -lm
+// (-no-pie keeps the firmware's variables below 4 GB, so their addresses fit the 32-bit DMA registers)
+//   ./sim_host -t 2 -s 8001        (2 simulated seconds, switches 0x8001)
+// Options: -t seconds, -s switches (hex), -b baud, -r "text" sent to the UART receiver, -v echo UART,
+//          -o file to save the UART output, e.g. binary telemetry for host/telemetry_decode
+//------------------------------------------------------------------------------------------------------
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <math.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <time.h>
+#include <ucontext.h>
+
+#include "../DES_M0_SoC.h"
+
+// ---------------- firmware entry points, see firmware.c ----------------
+int firmware_main(void);
+void SysTick_Handler(void);
+void UART_ISR(void);
+void SPI_ISR(void);
+void Impact_ISR(void);
+void DMA_ISR(void);
+
+// ---------------- simulation parameters ----------------
+#define CLK_HZ          50000000ULL
+#define BUS_CYCLES      2           // cycles charged for each peripheral access
+#define PAGE            4096UL
+#define UART_FIFO       16
+#define ADXL_FIFO       512
+
+enum { P_GPIO, P_UART, P_DISPLAY, P_SPI, P_IMPACT, P_PERFMON, P_DMA, P_NVIC, P_SYSTICK, P_COUNT };
+static const char *periph_name[P_COUNT] = {"GPIO", "UART", "Display", "SPI", "Impact", "PerfMon", "DMA", "NVIC", "SysTick"};
+
+static const struct { uintptr_t base; } pages[] = {
+	{0x50000000}, {0x51000000}, {0x52000000}, {0x53000000}, {0x54000000}, {0x55000000}, {0x56000000}, {0xE000E000},
+};
+#define NPAGES (sizeof(pages)/sizeof(pages[0]))
+
+static uint64_t sim_cycles;         // simulated time
+static uint64_t idle_cycles;        // time spent in WFI
+static uint64_t end_cycles;
+static uint16_t switches = 0x8001;
+static unsigned baud = 19200;
+static int verbose;
+static const char *rx_text;
+static const char *out_file;
+static size_t rx_pos;
+
+// ---------------- access statistics ----------------
+static uint64_t reads[P_COUNT], writes[P_COUNT];
+static uint64_t dma_periph;         // of the reads[] and writes[], those made by the DMA controller
+typedef struct { const char *name; uint64_t reads, writes; } func_stat;
+static func_stat funcs[64];
+static int nfuncs;
+static uint64_t samples;            // XYZ or single-axis readings delivered by the ADXL362 model
+static volatile uint64_t trap_count;
+
+static void count_access(int p, int is_write, void *pc)
+{
+	Dl_info info;
+	const char *name = "?";
+	int i;
+	if (is_write) writes[p]++; else reads[p]++;
+	if (dladdr(pc, &info) && info.dli_sname) name = info.dli_sname;
+	for (i = 0; i < nfuncs; i++)
+		if (funcs[i].name == name) break;
+	if (i == nfuncs && nfuncs < 64) funcs[nfuncs++].name = name;
+	if (i < 64) { if (is_write) funcs[i].writes++; else funcs[i].reads++; }
+}
+
+// ---------------- ADXL362 model ----------------
+static uint8_t adxl_reg[0x40];
+static uint16_t adxl_fifo[ADXL_FIFO];
+static unsigned adxl_fifo_n, adxl_fifo_rd;
+static uint64_t adxl_next_odr;      // time of next output data sample
+static int16_t adxl_now[3];         // latest sample, raw 12-bit
+static uint8_t adxl_cmd, adxl_addr, adxl_idx, adxl_half;
+static uint16_t adxl_fifo_word;
+
+static uint64_t adxl_odr_cycles(void)
+{
+	return (CLK_HZ * 8) / (100ULL << (adxl_reg[0x2C] & 0x07));   // 12.5 Hz << ODR bits
+}
+
+static void adxl_sample(uint64_t t)  // sensor output at time t: slow tilt on X, gravity on Z, a 1-sample impact on Y every second
+{
+	double s = (double)t / CLK_HZ;
+	int range = (adxl_reg[0x2C] >> 6) & 3;      // 1, 2, 4 mG per LSB
+	int mg[3], i;
+	mg[0] = (int)(300 * sin(2 * M_PI * 0.5 * s));
+	mg[1] = (t % CLK_HZ) < adxl_odr_cycles() ? 4000 : -100;
+	mg[2] = 1000;
+	for (i = 0; i < 3; i++) {
+		int raw = mg[i] >> range;
+		if (raw > 2047) raw = 2047;
+		if (raw < -2048) raw = -2048;
+		adxl_now[i] = (int16_t)raw;
+	}
+}
+
+static void adxl_update(void)       // bring the output registers and FIFO up to the current time
+{
+	while (adxl_next_odr <= sim_cycles) {
+		adxl_sample(adxl_next_odr);
+		if (adxl_reg[0x28] & 0x03) {
+			int i;
+			for (i = 0; i < 3; i++) {
+				if (adxl_fifo_n == ADXL_FIFO) {          // stream mode, oldest overwritten
+					adxl_fifo_rd = (adxl_fifo_rd + 1) % ADXL_FIFO;
+					adxl_fifo_n--;
+				}
+				adxl_fifo[(adxl_fifo_rd + adxl_fifo_n) % ADXL_FIFO] = (uint16_t)((i << 14) | (adxl_now[i] & 0x3FFF));
+				adxl_fifo_n++;
+			}
+		}
+		adxl_next_odr += adxl_odr_cycles();
+	}
+	adxl_reg[0x0C] = adxl_fifo_n & 0xFF;
+	adxl_reg[0x0D] = adxl_fifo_n >> 8;
+}
+
+static void adxl_latch(void)        // data registers hold one consistent sample for a burst read
+{
+	int i;
+	for (i = 0; i < 3; i++) {
+		adxl_reg[0x08 + i] = (uint8_t)(adxl_now[i] >> 4);
+		adxl_reg[0x0E + 2*i] = adxl_now[i] & 0xFF;
+		adxl_reg[0x0F + 2*i] = (adxl_now[i] >> 8) & 0xFF;
+	}
+}
+
+static void adxl_select(void) { adxl_idx = 0; adxl_half = 0; adxl_update(); adxl_latch(); }
+
+static uint8_t adxl_byte(uint8_t mosi)   // one byte exchanged while chip select is low
+{
+	uint8_t miso = 0;
+	if (adxl_idx == 0) {
+		adxl_cmd = mosi;
+	} else if (adxl_cmd == 0x0D) {          // FIFO read, two bytes per word
+		if (!adxl_half) {
+			adxl_fifo_word = 0;
+			if (adxl_fifo_n) {
+				adxl_fifo_word = adxl_fifo[adxl_fifo_rd];
+				adxl_fifo_rd = (adxl_fifo_rd + 1) % ADXL_FIFO;
+				adxl_fifo_n--;
+				if ((adxl_fifo_word >> 14) == 2) samples++;   // Z completes a set
+			}
+			miso = adxl_fifo_word & 0xFF;
+		} else {
+			miso = adxl_fifo_word >> 8;
+		}
+		adxl_half ^= 1;
+	} else if (adxl_idx == 1) {
+		adxl_addr = mosi;
+		if (adxl_cmd == 0x0B && adxl_addr >= 0x08 && adxl_addr <= 0x13) samples++;
+	} else if (adxl_cmd == 0x0B) {
+		miso = adxl_reg[adxl_addr++ & 0x3F];
+	} else if (adxl_cmd == 0x0A) {
+		if (adxl_addr >= 0x1F) adxl_reg[adxl_addr & 0x3F] = mosi;
+		adxl_addr++;
+	}
+	adxl_idx++;
+	return miso;
+}
+
+// ---------------- impact detector model (AHBimpact) ----------------
+static uint32_t imp_thr[3], imp_control, imp_holdoff, imp_count, imp_overflow;
+static uint64_t imp_hold_until;     // no event recorded before this time
+static struct { uint32_t time; uint8_t axes; } imp_fifo[8];
+static unsigned imp_fifo_n, imp_fifo_rd;
+static unsigned imp_idx;            // 0 = command, 1 = address or first data, 2 = rest
+static uint8_t imp_cmd, imp_addr, imp_low, imp_low_valid;
+
+static uint32_t imp_now(void) { return (uint32_t)(sim_cycles / (CLK_HZ / 1000000)); }
+
+static void imp_sample(unsigned axis, uint16_t raw12)
+{
+	int v = (raw12 & 0x800) ? (int)raw12 - 4096 : raw12;
+	unsigned mag = v < 0 ? -v : v;
+	if (!(imp_control & 1) || axis > 2 || !imp_thr[axis] || mag < imp_thr[axis] || sim_cycles < imp_hold_until) return;
+	imp_count++;
+	imp_hold_until = sim_cycles + (uint64_t)imp_holdoff * (CLK_HZ / 1000000);
+	if (imp_fifo_n == 8) { imp_overflow = 1; return; }
+	imp_fifo[(imp_fifo_rd + imp_fifo_n) % 8].time = imp_now();
+	imp_fifo[(imp_fifo_rd + imp_fifo_n) % 8].axes = 1 << axis;
+	imp_fifo_n++;
+}
+
+static void imp_byte(uint8_t tx, uint8_t rx)   // same decoding as the sensor data stream section of AHBimpact.v
+{
+	unsigned idx = imp_idx;
+	if (imp_idx < 2) imp_idx++;
+	if (idx == 0) {
+		imp_cmd = tx;
+		imp_low_valid = 0;
+	} else if (imp_cmd == 0x0D) {
+		if (!imp_low_valid) { imp_low = rx; imp_low_valid = 1; }
+		else { imp_low_valid = 0; if ((rx >> 6) != 3) imp_sample(rx >> 6, (uint16_t)(((rx & 0x0F) << 8) | imp_low)); }
+	} else if (imp_cmd == 0x0B) {
+		if (idx == 1) { imp_addr = tx; return; }
+		if (imp_addr >= 0x08 && imp_addr <= 0x0A) imp_sample(imp_addr & 3, (uint16_t)(rx << 4));
+		else if (imp_addr >= 0x0E && imp_addr <= 0x13) {
+			unsigned o = imp_addr - 0x0E;
+			if (!(o & 1)) { imp_low = rx; imp_low_valid = 1; }
+			else { if (imp_low_valid) imp_sample(o >> 1, (uint16_t)(((rx & 0x0F) << 8) | imp_low)); imp_low_valid = 0; }
+		}
+		imp_addr++;
+	}
+}
+
+static int imp_irq(void) { return (imp_control & 4) && imp_fifo_n; }
+
+static uint32_t imp_read(unsigned off)
+{
+	uint32_t head = imp_fifo_n ? imp_fifo[imp_fifo_rd].axes : 0;
+	switch (off) {
+	case 0x00: case 0x04: case 0x08: return imp_thr[off >> 2];
+	case 0x0C: return imp_control;
+	case 0x10: return imp_holdoff;
+	case 0x14: return imp_count;
+	case 0x18: return (head << 4) | (imp_overflow << 2) | ((imp_fifo_n == 8) << 1) | (imp_fifo_n != 0);
+	case 0x1C: return imp_fifo_n ? imp_fifo[imp_fifo_rd].time : 0;
+	case 0x20: return imp_now();
+	}
+	return 0;
+}
+
+static void imp_after_read(unsigned off)
+{
+	if (off == 0x1C && imp_fifo_n) { imp_fifo_rd = (imp_fifo_rd + 1) % 8; imp_fifo_n--; }
+}
+
+static void imp_write(unsigned off, uint32_t v)
+{
+	switch (off) {
+	case 0x00: case 0x04: case 0x08: imp_thr[off >> 2] = v & 0xFFF; break;
+	case 0x0C: imp_control = v & 7; break;
+	case 0x10: imp_holdoff = v; break;
+	case 0x14: imp_count = 0; break;
+	case 0x18: imp_overflow = 0; break;
+	}
+}
+
+// ---------------- SPI model (AHBspi) ----------------
+static uint8_t spi_rx[16];
+static unsigned spi_rx_n, spi_rx_rd;
+static uint8_t spi_control, spi_clkdiv = 4, spi_cslevel = 1, spi_frame, spi_done, spi_overrun;
+
+static int spi_selected(void) { return spi_frame != 0 || spi_cslevel == 0; }
+
+static void spi_select(void) { adxl_select(); imp_idx = 0; }   // chip select goes low
+
+static uint8_t spi_status(void)
+{
+	return (uint8_t)(((spi_rx_n == 16) << 2) | ((spi_rx_n != 0) << 3) | (1 << 1)
+		| (spi_done << 5) | (spi_overrun << 6));
+}
+
+static int spi_irq(void) { return (spi_status() & spi_control) != 0; }
+
+static void spi_tx(uint8_t b)       // transmit FIFO never fills here - the byte is shifted straight away
+{
+	uint8_t r = spi_selected() ? adxl_byte(b) : 0;
+	if (spi_selected()) imp_byte(b, r);
+	sim_cycles += 16ULL * (spi_clkdiv + 1) + 1;
+	if (spi_rx_n < 16) { spi_rx[(spi_rx_rd + spi_rx_n) % 16] = r; spi_rx_n++; }
+	else spi_overrun = 1;
+	if (spi_frame) {
+		if (--spi_frame == 0) spi_done = 1;
+	} else {
+		spi_done = 1;
+	}
+}
+
+static uint32_t spi_read(unsigned off)
+{
+	switch (off) {
+	case 0x00: return spi_rx_n ? spi_rx[spi_rx_rd] : 0;
+	case 0x08: return spi_status();
+	case 0x0C: return spi_control;
+	case 0x10: return spi_clkdiv;
+	case 0x14: return spi_cslevel;
+	case 0x18: return spi_frame;
+	}
+	return 0;
+}
+
+static void spi_after_read(unsigned off)
+{
+	if (off == 0x00 && spi_rx_n) { spi_rx_rd = (spi_rx_rd + 1) % 16; spi_rx_n--; }
+}
+
+static void spi_write(unsigned off, uint32_t v)
+{
+	switch (off) {
+	case 0x04: spi_tx(v & 0xFF); break;
+	case 0x08: spi_done = 0; spi_overrun = 0; break;
+	case 0x0C: spi_control = v & 0x7F; break;
+	case 0x10: spi_clkdiv = v & 0xFF; break;
+	case 0x14: if (spi_cslevel && !(v & 1) && !spi_frame) spi_select(); spi_cslevel = v & 1; break;
+	case 0x18: if (!spi_selected() && (v & 0xFF)) spi_select(); spi_frame = v & 0xFF; break;
+	}
+}
+
+// ---------------- UART model ----------------
+static char uart_out[1 << 20];
+static size_t uart_out_n;
+static unsigned uart_tx_n;          // characters in transmit FIFO
+static uint64_t uart_tx_next;       // time the character being sent finishes
+static uint8_t uart_control, uart_rx_char;
+static int uart_rx_valid;
+static uint64_t uart_rx_next;
+
+static uint64_t uart_char_cycles(void) { return CLK_HZ * 10 / baud; }
+
+static void uart_update(void)
+{
+	while (uart_tx_n && uart_tx_next <= sim_cycles) {
+		uart_tx_n--;
+		uart_tx_next += uart_char_cycles();
+	}
+	if (!uart_rx_valid && rx_text && rx_text[rx_pos] && uart_rx_next <= sim_cycles) {
+		uart_rx_char = rx_text[rx_pos++];
+		uart_rx_valid = 1;
+		uart_rx_next = sim_cycles + uart_char_cycles();
+	}
+}
+
+static uint8_t uart_status(void)
+{
+	return (uint8_t)((uart_tx_n == UART_FIFO) | ((uart_tx_n == 0) << 1) | (uart_rx_valid << 3));
+}
+
+static int uart_irq(void) { return (uart_status() & uart_control) != 0; }
+
+static uint32_t uart_read(unsigned off)
+{
+	switch (off) {
+	case 0x00: return uart_rx_char;
+	case 0x08: return uart_status();
+	case 0x0C: return uart_control;
+	}
+	return 0;
+}
+
+static void uart_after_read(unsigned off) { if (off == 0x00) uart_rx_valid = 0; }
+
+static void uart_write(unsigned off, uint32_t v)
+{
+	if (off == 0x04) {
+		if (uart_tx_n == UART_FIFO) return;          // lost, as the hardware would lose it
+		if (uart_tx_n == 0) uart_tx_next = sim_cycles + uart_char_cycles();
+		uart_tx_n++;
+		if (uart_out_n < sizeof(uart_out) - 1) uart_out[uart_out_n++] = (char)v;
+		if (verbose) fputc_unlocked((char)v, stdout);
+	} else if (off == 0x0C) {
+		uart_control = v & 0x0F;
+	}
+}
+
+// ---------------- GPIO, display, NVIC and SysTick models ----------------
+static uint32_t gpio_led, gpio_acc_out;
+static uint32_t display_reg[8];
+static uint64_t display_writes;
+static uint32_t nvic_enable;
+static uint32_t systick_ctrl, systick_load;
+static uint64_t systick_start, systick_next;
+static int systick_pending;
+static uint64_t systick_lost;
+
+// Decimal field as AHBdisplay shows it: leading zeros blank, zeros kept up to
+// the decimal point, sign left of the top digit, dashes if it does not fit.
+// Conversion time (33 clocks) is not modelled, so the busy bit reads as 0.
+static void display_decimal(char *out)
+{
+	uint32_t cfg = display_reg[5], mag = display_reg[4];
+	unsigned offset = cfg & 7, width = (cfg >> 4) & 15, dp = (cfg >> 8) & 7;
+	int dp_en = (cfg >> 11) & 1, neg = (int32_t)mag < 0, d, sig, pos;
+	unsigned char bcd[10];
+	if (neg) mag = -mag;
+	for (d = 0; d < 10; d++, mag /= 10) bcd[d] = mag % 10;
+	sig = dp_en ? dp + 1 : 1;
+	for (d = 1; d < 10; d++) if (bcd[d] && sig < d + 1) sig = d + 1;
+	for (d = 7; d >= 0; d--) {
+		char c = '.';								// outside the field
+		pos = d - (int)offset;
+		if ((cfg & (1 << 16)) && pos >= 0 && pos < (int)width) {
+			if (sig + neg > (int)width) c = '-';
+			else if (pos < sig) c = '0' + bcd[pos];
+			else if (neg && pos == sig) c = '-';
+			else c = ' ';
+		}
+		*out++ = c;
+		if (dp_en && pos == (int)dp && sig + neg <= (int)width) *out++ = '.';
+	}
+	*out = 0;
+}
+
+static void systick_update(void)
+{
+	if (!(systick_ctrl & 1) || systick_load == 0) return;
+	if (sim_cycles >= systick_next) {
+		uint64_t period = systick_load + 1ULL;
+		uint64_t n = (sim_cycles - systick_next) / period + 1;
+		if (systick_ctrl & 2) {
+			if (systick_pending || n > 1) systick_lost += n - 1 + systick_pending;
+			systick_pending = 1;
+		}
+		systick_next += n * period;
+	}
+}
+
+static uint32_t systick_val(void)
+{
+	uint64_t period = systick_load + 1ULL;
+	if (!(systick_ctrl & 1) || systick_load == 0) return 0;
+	return (uint32_t)(systick_load - ((sim_cycles - systick_start) % period));
+}
+
+static uint32_t scs_read(unsigned off)
+{
+	switch (off) {
+	case 0x010: return systick_ctrl;
+	case 0x014: return systick_load;
+	case 0x018: return systick_val();
+	case 0x100: return nvic_enable;
+	}
+	return 0;
+}
+
+static void scs_write(unsigned off, uint32_t v)
+{
+	switch (off) {
+	case 0x010:
+		if (!(systick_ctrl & 1) && (v & 1)) { systick_start = sim_cycles; systick_next = sim_cycles + systick_load + 1ULL; }
+		systick_ctrl = v & 7;
+		break;
+	case 0x014: systick_load = v & 0xFFFFFF; break;
+	case 0x018: systick_start = sim_cycles; systick_next = sim_cycles + systick_load + 1ULL; break;
+	case 0x100: nvic_enable |= v; break;
+	case 0x180: nvic_enable &= ~v; break;
+	}
+}
+
+// ---------------- performance monitor model ----------------
+// ROM and RAM transfers are not visible here, so they read 0 and idle is the awake time
+// less the processor's peripheral transfers; DMA transfers are taken to fall while it sleeps.
+// NVIC and SysTick are not on the AHB and not counted.
+enum { PM_CYCLES, PM_IDLE, PM_SLEEP, PM_WAIT, PM_READS, PM_WRITES, PM_SLAVE, PM_COUNT = PM_SLAVE + 8 };
+static uint32_t pm_run;
+static uint64_t pm_held[PM_COUNT];  // count accumulated up to pm_mark
+static uint64_t pm_mark[PM_COUNT];  // total when counting last started, or was cleared
+static uint32_t pm_snap[PM_COUNT];
+
+static uint64_t pm_total(int i)     // since reset, whether counting or not
+{
+	uint64_t r = 0, w = 0;
+	int p;
+	for (p = P_GPIO; p <= P_DMA; p++) { r += reads[p]; w += writes[p]; }
+	switch (i) {
+	case PM_CYCLES: return sim_cycles;
+	case PM_IDLE:   return sim_cycles - idle_cycles - (r + w - dma_periph);
+	case PM_SLEEP:  return idle_cycles;
+	case PM_READS:  return r;
+	case PM_WRITES: return w;
+	}
+	if (i >= PM_SLAVE + 2 && i <= PM_SLAVE + 7) {      // GPIO at slot 2 to the monitor itself at 7
+		p = i - (PM_SLAVE + 2);
+		if (p == P_PERFMON) return reads[p] + writes[p] + reads[P_DMA] + writes[P_DMA];   // other
+		return reads[p] + writes[p];
+	}
+	return 0;                                           // wait states, ROM, RAM
+}
+
+static uint64_t pm_count(int i) { return pm_held[i] + (pm_run ? pm_total(i) - pm_mark[i] : 0); }
+
+static uint32_t pm_read(unsigned off)
+{
+	if (off == 0x00) return pm_run;
+	if (off == 0x04) return (uint32_t)pm_count(PM_CYCLES);
+	return off < 0x40 ? pm_snap[(off >> 2) - 2] : 0;
+}
+
+static void pm_write(unsigned off, uint32_t v)
+{
+	int i;
+	if (off != 0x00) return;
+	for (i = 0; i < PM_COUNT; i++) {
+		if (v & 4) pm_snap[i] = (uint32_t)pm_count(i);
+		pm_held[i] = (v & 2) ? 0 : pm_count(i);
+		pm_mark[i] = pm_total(i);
+	}
+	pm_run = v & 1;
+}
+
+// ---------------- DMA controller model ----------------
+// Registers as AHBdma.  A channel moves data as soon as update_time() finds it enabled, and a
+// paced channel as soon as its poll matches, so the hardware's wait of up to POLL_WAIT cycles
+// is not modelled; the polls that would fail while it waits are counted from the time waited.
+// Its peripheral transfers are counted in reads[] and writes[] and so by the performance
+// monitor, but not against any firmware function.
+#define DMA_POLL_WAIT   1000        // AHBdma parameter
+static uint32_t dma_reg[2][8];      // Src, Dst, Count, Control, Poll, Match
+static uint32_t dma_done;
+static uint64_t dma_wait_from[2];   // time a paced channel started waiting, 0 if it is not
+static uint64_t dma_transfers, dma_polls;
+
+static int dma_irq(void)
+{
+	int c, irq = 0;
+	for (c = 0; c < 2; c++)
+		if ((dma_done >> c & 1) && (dma_reg[c][3] & 0x80)) irq = 1;
+	return irq;
+}
+
+static uint32_t dma_read(unsigned off)
+{
+	if (off == 0x40) return dma_done | (dma_reg[1][3] & 1) << 5 | (dma_reg[0][3] & 1) << 4;
+	return off < 0x40 ? dma_reg[off >> 5][(off >> 2) & 7] : 0;
+}
+
+static void dma_write(unsigned off, uint32_t v)
+{
+	static const uint32_t mask[8] = {0xFFFFFFFF, 0xFFFFFFFF, 0xFFFF, 0xFF, 0xFFFFFFFF, 0xFFFF, 0, 0};
+	if (off == 0x40) dma_done &= ~(v & 3);
+	else if (off < 0x40) dma_reg[off >> 5][(off >> 2) & 7] = v & mask[(off >> 2) & 7];
+}
+
+static uint32_t periph_read(int p, unsigned off)
+{
+	switch (p) {
+	case P_GPIO:    return off == 0x00 ? gpio_led : off == 0x04 ? gpio_acc_out : off == 0x08 ? switches : 0;
+	case P_UART:    return uart_read(off);
+	case P_DISPLAY: return display_reg[(off >> 2) & 7];
+	case P_SPI:     return spi_read(off);
+	case P_IMPACT:  return imp_read(off);
+	case P_PERFMON: return pm_read(off);
+	case P_DMA:     return dma_read(off);
+	default:        return scs_read(off);
+	}
+}
+
+static void periph_after_read(int p, unsigned off)
+{
+	if (p == P_UART) uart_after_read(off);
+	if (p == P_SPI) spi_after_read(off);
+	if (p == P_IMPACT) imp_after_read(off);
+}
+
+static void periph_write(int p, unsigned off, uint32_t v)
+{
+	switch (p) {
+	case P_GPIO:    if (off == 0x00) gpio_led = v & 0xFFFF; if (off == 0x04) gpio_acc_out = v & 0xFFFF; break;
+	case P_UART:    uart_write(off, v); break;
+	case P_DISPLAY: display_reg[(off >> 2) & 7] = off == 0x14 ? v & 0x10FF7 : v; display_writes++; break;
+	case P_SPI:     spi_write(off, v); break;
+	case P_IMPACT:  imp_write(off, v); break;
+	case P_PERFMON: pm_write(off, v); break;
+	case P_DMA:     dma_write(off, v); break;
+	default:        scs_write(off, v); break;
+	}
+}
+
+static int find_periph(uintptr_t a, uintptr_t *page, unsigned *off);
+
+static uint32_t dma_bus_read(uint32_t addr, unsigned size)     // a DMA read, from a model or host memory
+{
+	uintptr_t page;
+	unsigned off;
+	uint32_t v = 0;
+	int p = find_periph(addr, &page, &off);
+	if (p >= 0) {
+		v = periph_read(p, off) >> (8 * (addr & 3));
+		periph_after_read(p, off);
+		reads[p]++;
+		dma_periph++;
+	} else {
+		memcpy(&v, (void *)(uintptr_t)addr, 1u << size);
+	}
+	return v;
+}
+
+static void dma_bus_write(uint32_t addr, unsigned size, uint32_t v)
+{
+	uintptr_t page;
+	unsigned off;
+	int p = find_periph(addr, &page, &off);
+	if (p >= 0) {
+		periph_write(p, off, v);
+		writes[p]++;
+		dma_periph++;
+	} else {
+		memcpy((void *)(uintptr_t)addr, &v, 1u << size);
+	}
+}
+
+static void dma_update(void)
+{
+	int c;
+	for (c = 0; c < 2; c++) {
+		uint32_t *r = dma_reg[c];
+		unsigned size = (r[3] >> 4) & 3;
+		if (!(r[3] & 1)) continue;
+		while (r[2]) {
+			if (r[3] & 0x40) {                      // paced
+				uint32_t status = dma_bus_read(r[4], 2);
+				dma_polls++;
+				if ((status & r[5] & 0xFF) != ((r[5] >> 8) & 0xFF)) {
+					if (!dma_wait_from[c]) dma_wait_from[c] = sim_cycles;
+					break;
+				}
+				if (dma_wait_from[c]) {                // polls that failed while it waited
+					uint64_t n = (sim_cycles - dma_wait_from[c]) / (DMA_POLL_WAIT + 3 * BUS_CYCLES);
+					uintptr_t page;
+					unsigned off;
+					int p = find_periph(r[4], &page, &off);
+					if (p >= 0) { reads[p] += n; dma_periph += n; }
+					dma_polls += n;
+					dma_wait_from[c] = 0;
+				}
+			}
+			dma_bus_write(r[1], size, dma_bus_read(r[0], size));
+			dma_transfers++;
+			if (r[3] & 2) r[0] += 1u << size;
+			if (r[3] & 4) r[1] += 1u << size;
+			r[2]--;
+		}
+		if (!r[2]) {
+			r[3] &= ~1u;
+			dma_done |= 1u << c;
+		}
+	}
+}
+
+// ---------------- interrupts ----------------
+static int primask;
+static int in_isr;
+static jmp_buf stop_env;
+
+static void update_time(void)
+{
+	systick_update();
+	uart_update();
+	adxl_update();
+	dma_update();
+}
+
+static void deliver_interrupts(void)
+{
+	int guard = 0;
+	if (in_isr || primask) return;
+	update_time();
+	while (guard++ < 16) {
+		in_isr = 1;
+		if (systick_pending) { systick_pending = 0; SysTick_Handler(); }
+		else if (uart_irq() && (nvic_enable & (1 << NVIC_UART_BIT_POS))) UART_ISR();
+		else if (spi_irq() && (nvic_enable & (1 << NVIC_SPI_BIT_POS))) SPI_ISR();
+		else if (imp_irq() && (nvic_enable & (1 << NVIC_IMPACT_BIT_POS))) Impact_ISR();
+		else if (dma_irq() && (nvic_enable & (1 << NVIC_DMA_BIT_POS))) DMA_ISR();
+		else { in_isr = 0; break; }
+		in_isr = 0;
+		update_time();
+	}
+}
+
+static uint64_t next_event(void)    // earliest time anything can change on its own
+{
+	uint64_t t = end_cycles;
+	if ((systick_ctrl & 3) == 3 && systick_next < t) t = systick_next;
+	if (uart_tx_n && uart_tx_next < t) t = uart_tx_next;
+	if (rx_text && rx_text[rx_pos] && uart_rx_next < t) t = uart_rx_next;
+	return t > sim_cycles ? t : sim_cycles;
+}
+
+static int pending_enabled(void)
+{
+	update_time();
+	return systick_pending
+		|| (uart_irq() && (nvic_enable & (1 << NVIC_UART_BIT_POS)))
+		|| (spi_irq() && (nvic_enable & (1 << NVIC_SPI_BIT_POS)))
+		|| (imp_irq() && (nvic_enable & (1 << NVIC_IMPACT_BIT_POS)))
+		|| (dma_irq() && (nvic_enable & (1 << NVIC_DMA_BIT_POS)));
+}
+
+void __disable_irq(void) { primask = 1; }
+void __enable_irq(void) { primask = 0; deliver_interrupts(); }
+
+void __wfi(void)
+{
+	if (sim_cycles >= end_cycles) longjmp(stop_env, 1);
+	if (!pending_enabled()) {
+		uint64_t t = next_event();
+		idle_cycles += t - sim_cycles;
+		sim_cycles = t;
+	}
+	deliver_interrupts();
+}
+
+int sim_printf(const char *fmt, ...)  // printf goes through the firmware's retargeted fputc
+{
+	char buf[512];
+	int n, i;
+	va_list ap;
+	va_start(ap, fmt);
+	n = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+	for (i = 0; i < n && i < (int)sizeof(buf) - 1; i++) fputc(buf[i], stdout);
+	return n;
+}
+
+// ---------------- access trapping ----------------
+typedef struct { int p; unsigned off; int is_write; uintptr_t page; } pending_access;
+static pending_access stack[8];     // nests when an interrupt is delivered from a trap
+static int depth;
+
+static int find_periph(uintptr_t a, uintptr_t *page, unsigned *off)
+{
+	unsigned i;
+	for (i = 0; i < NPAGES; i++) {
+		if (a >= pages[i].base && a < pages[i].base + PAGE) {
+			*page = pages[i].base;
+			*off = (unsigned)(a - pages[i].base) & ~3u;
+			if (i < P_NVIC) return (int)i;
+			return *off < 0x100 ? P_SYSTICK : P_NVIC;
+		}
+	}
+	return -1;
+}
+
+static void on_segv(int sig, siginfo_t *si, void *ctx)
+{
+	ucontext_t *uc = ctx;
+	uintptr_t page;
+	unsigned off;
+	int p = find_periph((uintptr_t)si->si_addr, &page, &off);
+	pending_access *a;
+	(void)sig;
+	if (p < 0 || depth == 8) {
+		fprintf(stderr, "sim_host: bad access to %p\n", si->si_addr);
+		signal(SIGSEGV, SIG_DFL);
+		return;
+	}
+	a = &stack[depth++];
+	a->p = p; a->off = off & 0xFFF; a->page = page;
+	a->is_write = (uc->uc_mcontext.gregs[REG_ERR] & 2) != 0;
+	count_access(p, a->is_write, (void *)uc->uc_mcontext.gregs[REG_RIP]);
+	sim_cycles += BUS_CYCLES;
+	trap_count++;
+	update_time();
+	mprotect((void *)page, PAGE, PROT_READ | PROT_WRITE);
+	if (!a->is_write) {
+		uint32_t v = periph_read(p, a->off);
+		memcpy((void *)(page + a->off), &v, 4);
+	}
+	uc->uc_mcontext.gregs[REG_EFL] |= 0x100;            // single step the faulting instruction
+	sigaddset(&uc->uc_sigmask, SIGALRM);                // no watchdog in the middle of an access
+}
+
+static void on_trap(int sig, siginfo_t *si, void *ctx)
+{
+	ucontext_t *uc = ctx;
+	pending_access *a = &stack[--depth];
+	(void)sig; (void)si;
+	uc->uc_mcontext.gregs[REG_EFL] &= ~0x100;
+	if (a->is_write) {
+		uint32_t v;
+		memcpy(&v, (void *)(a->page + a->off), 4);
+		periph_write(a->p, a->off, v);
+	} else {
+		periph_after_read(a->p, a->off);
+	}
+	mprotect((void *)a->page, PAGE, PROT_NONE);
+	if (depth == 0) sigdelset(&uc->uc_sigmask, SIGALRM);
+	if (depth == 0) deliver_interrupts();
+}
+
+static void on_alarm(int sig)       // firmware spinning on memory only - let time move on
+{
+	static uint64_t last;
+	(void)sig;
+	if (trap_count == last && depth == 0 && !in_isr && !primask) {
+		uint64_t t = next_event();
+		idle_cycles += t - sim_cycles;
+		sim_cycles = t;
+		deliver_interrupts();
+	}
+	last = trap_count;
+}
+
+static int by_total(const void *a, const void *b)
+{
+	const func_stat *x = a, *y = b;
+	uint64_t tx = x->reads + x->writes, ty = y->reads + y->writes;
+	return tx < ty ? 1 : tx > ty ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct sigaction sa;
+	struct itimerval it = {{0, 10000}, {0, 10000}};
+	struct timespec w0, w1;
+	double seconds = 2.0, wall;
+	static uint64_t total_r, total_w;   // static, so the longjmp out of the firmware cannot clobber them
+	uint64_t total;
+	unsigned i;
+	int opt;
+	char field[20];
+
+	while ((opt = getopt(argc, argv, "t:s:b:r:vo:")) != -1) {
+		switch (opt) {
+		case 't': seconds = atof(optarg); break;
+		case 's': switches = (uint16_t)strtoul(optarg, NULL, 16); break;
+		case 'b': baud = (unsigned)atoi(optarg); break;
+		case 'r': rx_text = optarg; break;
+		case 'v': verbose = 1; break;
+		case 'o': out_file = optarg; break;
+		default:
+			fprintf(stderr, "usage: %s [-t seconds] [-s switches] [-b baud] [-r text] [-v] [-o file]\n", argv[0]);
+			return 1;
+		}
+	}
+	end_cycles = (uint64_t)(seconds * CLK_HZ);
+	if ((uintptr_t)&sim_cycles >> 32) {
+		fprintf(stderr, "sim_host: build with -no-pie, the DMA registers hold 32-bit addresses\n");
+		return 1;
+	}
+
+	for (i = 0; i < NPAGES; i++) {
+		if (mmap((void *)pages[i].base, PAGE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0)
+				!= (void *)pages[i].base) {
+			perror("sim_host: mmap peripheral page");
+			return 1;
+		}
+	}
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+	sa.sa_sigaction = on_segv;
+	sigaction(SIGSEGV, &sa, NULL);
+	sa.sa_sigaction = on_trap;
+	sigaction(SIGTRAP, &sa, NULL);
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_alarm;
+	sa.sa_flags = SA_RESTART;
+	sigaction(SIGALRM, &sa, NULL);
+	setitimer(ITIMER_REAL, &it, NULL);
+
+	adxl_reg[0x00] = 0xAD; adxl_reg[0x01] = 0x1D; adxl_reg[0x02] = 0xF2; adxl_reg[0x03] = 0x01;
+	adxl_reg[0x2C] = 0x13;                              // power-on default, 100 Hz +-2G
+	uart_rx_next = CLK_HZ / 10;                         // receive text starts after 100 ms
+
+	clock_gettime(CLOCK_MONOTONIC, &w0);
+	if (!setjmp(stop_env)) firmware_main();
+	clock_gettime(CLOCK_MONOTONIC, &w1);
+	it.it_value.tv_sec = it.it_value.tv_usec = 0;
+	setitimer(ITIMER_REAL, &it, NULL);
+	wall = (w1.tv_sec - w0.tv_sec) + (w1.tv_nsec - w0.tv_nsec) / 1e9;
+
+	if (verbose) fputc('\n', stdout);
+	if (out_file) {
+		FILE *f = fopen(out_file, "wb");
+		if (!f || fwrite(uart_out, 1, uart_out_n, f) != uart_out_n) perror(out_file);
+		if (f) fclose(f);
+	}
+	for (i = 0; i < P_COUNT; i++) { total_r += reads[i]; total_w += writes[i]; }
+	total = total_r + total_w;
+	printf("Simulated %.3f s, CPU awake %.2f%% (instruction time not modelled)\n",
+		(double)sim_cycles / CLK_HZ, 100.0 * (sim_cycles - idle_cycles) / (sim_cycles ? sim_cycles : 1));
+	printf("Samples %llu, %.1f per simulated second, %.1f per host second\n",
+		(unsigned long long)samples, samples * (double)CLK_HZ / (sim_cycles ? sim_cycles : 1), samples / wall);
+	printf("Bus accesses %llu (%llu reads, %llu writes), %.1f per sample\n",
+		(unsigned long long)total, (unsigned long long)total_r, (unsigned long long)total_w,
+		samples ? (double)total / samples : 0.0);
+	printf("UART bytes %zu, %.1f per sample, %llu SysTick interrupts lost\n",
+		uart_out_n, samples ? (double)uart_out_n / samples : 0.0, (unsigned long long)systick_lost);
+	printf("DMA %llu transfers, %llu polls, %llu peripheral accesses of the above\n",
+		(unsigned long long)dma_transfers, (unsigned long long)dma_polls, (unsigned long long)dma_periph);
+	printf("\n%-10s %10s %10s\n", "peripheral", "reads", "writes");
+	for (i = 0; i < P_COUNT; i++)
+		printf("%-10s %10llu %10llu\n", periph_name[i], (unsigned long long)reads[i], (unsigned long long)writes[i]);
+	qsort(funcs, nfuncs, sizeof(funcs[0]), by_total);
+	printf("\n%-24s %10s %10s\n", "function", "reads", "writes");
+	for (i = 0; i < (unsigned)nfuncs; i++)
+		printf("%-24s %10llu %10llu\n", funcs[i].name, (unsigned long long)funcs[i].reads, (unsigned long long)funcs[i].writes);
+	display_decimal(field);
+	printf("\nDisplay: rawLow %08X rawHigh %08X hexData %08X control %06X, %llu writes; LEDs %04X\n",
+		display_reg[0], display_reg[1], display_reg[2], display_reg[3], (unsigned long long)display_writes, gpio_led);
+	printf("Decimal field [%s] from decData %d, decConfig %05X\n", field, (int32_t)display_reg[4], display_reg[5]);
+	return 0;
+}
@@ -0,0 +1,132 @@
+//------------------------------------------------------------------------------------------------------
+// Decoder for the binary telemetry frames sent by main.c when switch 6 is on in FIFO mode
+//
+// Reads the UART byte stream from a file or stdin and writes one CSV line per sample:
+//   seq,timestamp,x_mg,y_mg,z_mg
+// Text mixed into the stream (impact reports, scheduler statistics) is skipped.  A frame is only
+// accepted if its CRC matches; after a bad frame the search for the next sync word restarts one
+// byte after the bad one, so a corrupted or truncated frame costs at most itself.
+//
+// The summary on stderr counts frames decoded, frames failing the CRC, frames missing from the
+// sequence numbers (dropped by the firmware when TxBuf was full, or lost on the line), samples
+// missing from the timestamps (lost before framing), and bytes that were not part of a frame.
+//
+// Frame layout - see the comment above TELEM_SYNC0 in main.c:
+//   A5 5A | seq:16 | n:8 | mG/LSB:8 | timestamp:32 | 3n x 12-bit values, (9n+1)/2 bytes | CRC:16
+//
+// Build and run from the "System On Chip" directory:
+//   gcc -O2 -o telemetry_decode host/telemetry_decode.c
+//   ./sim_host -t 10 -s 8060 -o uart.bin && ./telemetry_decode uart.bin > samples.csv
+//------------------------------------------------------------------------------------------------------
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define SYNC0       0xA5
+#define SYNC1       0x5A
+#define HEADER      10
+#define MAX_FRAME   (HEADER + (9 * 255 + 1) / 2 + 2)
+
+static uint16_t crc16_ccitt(const uint8_t *p, size_t n)    // same as the firmware
+{
+	uint16_t crc = 0xFFFF;
+	uint8_t x;
+	while (n--) {
+		x = (uint8_t)((crc >> 8) ^ *p++);
+		x ^= x >> 4;
+		crc = (uint16_t)((crc << 8) ^ ((uint16_t)x << 12) ^ ((uint16_t)x << 5) ^ x);
+	}
+	return crc;
+}
+
+static unsigned long frames, corrupt, dropped, missing, samples, skipped, bytes;
+static int have_seq;
+static uint16_t next_seq;
+static uint32_t next_ts;
+
+static int16_t value12(const uint8_t *d, unsigned i)       // i-th packed 12-bit value, sign extended
+{
+	const uint8_t *p = d + (i / 2) * 3;
+	unsigned v = (i & 1) ? (p[1] >> 4) | (p[2] << 4) : p[0] | ((p[1] & 0x0F) << 8);
+	return (int16_t)(v << 4) >> 4;
+}
+
+static void frame_out(const uint8_t *f)
+{
+	uint16_t seq = f[2] | (f[3] << 8);
+	unsigned n = f[4], mg = f[5], i;
+	uint32_t ts = f[6] | (f[7] << 8) | (f[8] << 16) | ((uint32_t)f[9] << 24);
+
+	if (have_seq) {
+		dropped += (uint16_t)(seq - next_seq);
+		if (ts > next_ts) missing += ts - next_ts;          // earlier timestamp - the FIFO was restarted
+	}
+	have_seq = 1;
+	next_seq = seq + 1;
+	next_ts = ts + n;
+	for (i = 0; i < n; i++)
+		printf("%u,%lu,%d,%d,%d\n", seq, (unsigned long)(ts + i), value12(f + HEADER, 3 * i) * (int)mg,
+			value12(f + HEADER, 3 * i + 1) * (int)mg, value12(f + HEADER, 3 * i + 2) * (int)mg);
+	frames++;
+	samples += n;
+}
+
+// Decodes every complete frame in buf, returns the number of bytes used.  Bytes that might be the
+// start of a frame not yet complete are left for the next call unless at_end.
+static size_t decode(const uint8_t *buf, size_t len, int at_end)
+{
+	size_t pos = 0, flen;
+	while (pos < len) {
+		if (buf[pos] != SYNC0 || (pos + 1 < len && buf[pos + 1] != SYNC1)) {
+			pos++;
+			skipped++;
+			continue;
+		}
+		if (pos + HEADER > len) break;
+		flen = HEADER + (9 * buf[pos + 4] + 1) / 2 + 2;
+		if (pos + flen > len) break;
+		if (buf[pos + 4] != 0 && crc16_ccitt(buf + pos + 2, flen - 4)
+				== (buf[pos + flen - 2] | (buf[pos + flen - 1] << 8))) {
+			frame_out(buf + pos);
+			pos += flen;
+		}
+		else {
+			corrupt++;
+			pos++;
+			skipped++;
+		}
+	}
+	if (at_end) {
+		skipped += len - pos;
+		pos = len;
+	}
+	return pos;
+}
+
+int main(int argc, char **argv)
+{
+	static uint8_t buf[4 * MAX_FRAME];
+	FILE *in = stdin;
+	size_t len = 0, n, used;
+
+	if (argc > 2 || (argc == 2 && !(in = fopen(argv[1], "rb")))) {
+		if (argc == 2) perror(argv[1]);
+		else fprintf(stderr, "usage: %s [file] > samples.csv\n", argv[0]);
+		return 1;
+	}
+	printf("seq,timestamp,x_mg,y_mg,z_mg\n");
+	while ((n = fread(buf + len, 1, sizeof(buf) - len, in)) > 0) {
+		bytes += n;
+		len += n;
+		used = decode(buf, len, 0);
+		memmove(buf, buf + used, len - used);
+		len -= used;
+	}
+	decode(buf, len, 1);
+
+	fprintf(stderr, "%lu bytes, %lu frames, %lu samples, %.2f bytes per sample\n",
+		bytes, frames, samples, samples ? (double)bytes / samples : 0.0);
+	fprintf(stderr, "%lu frames failed CRC, %lu frames dropped, %lu samples missing, %lu bytes skipped\n",
+		corrupt, dropped, missing, skipped);
+	return corrupt || dropped ? 2 : 0;
+}
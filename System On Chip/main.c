@@ -9,109 +9,586 @@
 // Version 4 - October 2015
 //------------------------------------------------------------------------------------------------------
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "DES_M0_SoC.h"
+#include "acc_tables.h"         // generated scale factors and LED table, see tools/gen_tables.c
 
 #define BUF_SIZE						100
+#define CMD_QUEUE						8			// sentences waiting for task_command, must be a power of 2, one slot is kept free
 #define ASCII_CR						'\r'
 #define nLOOPS_per_DELAY		1000000
 
+#define TX_BUF_SIZE					256		// UART transmit ring buffer, must be a power of 2
+#define TX_POLICY_DROP			0			// Characters discarded when the transmit buffer is full
+#define TX_POLICY_BLOCK			1			// Caller waits for the DMA to make room
+#define TX_DMA_CHUNK				32		// most bytes handed to the DMA at once, so room in TxBuf comes back steadily
+#define TX_DMA_CH						0			// DMA channel that feeds the UART
+
+#define SYS_CLK_HZ					50000000	// processor and bus clock
+#define TICK_HZ							1000			// scheduler tick, all task periods are in ticks
+#define TICK_CYCLES					(SYS_CLK_HZ / TICK_HZ)
+#define SYSTICK_RELOAD			(TICK_CYCLES - 1)
+#define ACQ_PERIOD_MS				100				// sensor read
+#define DISPLAY_PERIOD_MS		100				// 7-segment display and LEDs
+#define REPORT_PERIOD_MS		100				// UART output
+#define STATS_PERIOD_MS			10000			// scheduler statistics
+#define COMMAND_PERIOD_MS		20				// check for a command line from the UART
+#define IMPACT_HOLDOFF_MS		500				// one impact is not counted twice within this time
+#define IMPACT_QUEUE			8				// impact events waiting to be reported, must be a power of 2
+
+#define __WFI								__wfi			// compiler intrinsic for the wait for interrupt instruction
+
 #define ARRAY_SIZE(__x__)       (sizeof(__x__)/sizeof(__x__[0]))
-#define MOSI 0x00
-#define MISO 0x00
 #define write_data 0x0A     // Byte sent on MOSI when writing to ADXL362
 #define read_data 0x0B      // Byte sent on MOSI when reading to ADXL362
-#define delay_val 10        // For short delays between clock changing state
-#define clock_low 0x00      // Used to set the SPI clock low
-#define clock_high 0x01     // Used to set the SPI clock high
-#define cs_high 0x01        // sed to set Chip select high
-#define cs_low 0x00         // Used to set Chip select low
+#define spi_clk_div 4       // SPI clock = 50 MHz / (2*(4+1)) = 5 MHz, within ADXL362 limit of 8 MHz
+#define cs_high 0x01        // Used to set Chip select high
 #define deviceID_reg0 0x00  // Device addresses used while testing
 #define deviceID_reg1 0x01  // Device addresses used while testing
+#define fifo_read 0x0D      // Byte sent on MOSI when reading the ADXL362 FIFO
+#define xdata8_reg 0x08     // First of the 8-bit data registers, X, Y, Z in order
+#define xdata12_reg 0x0E    // First of the 12-bit data registers, X low, X high, Y low ... Z high
+#define fifo_entries_reg 0x0C  // Number of 16-bit words in the ADXL362 FIFO, low then high byte
+#define fifo_control_reg 0x28
+#define fifo_samples_reg 0x29
+#define fifo_stream 0x02    // FIFO_CONTROL: stream mode, oldest samples overwritten when full
+#define fifo_off 0x00       // FIFO_CONTROL: FIFO disabled
+#define fifo_chunk 126      // FIFO words read per SPI frame - multiple of 3, and 2*126+1 fits the frame register
+#define filter_ctl_reg 0x2C // FILTER_CTL: range in bits 7:6, half bandwidth bit 4, output data rate in bits 2:0
+#define power_ctl_reg 0x2D
+#define power_measure 0x12  // POWER_CTL: measurement mode and low noise mode
+#define power_standby 0x00  // POWER_CTL: standby, for changing the filter settings
+#define filter_default 0x13 // FILTER_CTL power-on value: +-2G, half bandwidth, 100 Hz
+
+#define ACQ_BURST8  0x0008  // Switch 3: read all three 8-bit axes in one burst
+#define ACQ_BURST12 0x0010  // Switch 4: read all three 12-bit axes in one burst
+#define ACQ_FIFO    0x0020  // Switch 5: stream samples through the ADXL362 FIFO
+#define REPORT_BINARY 0x0040  // Switch 6: FIFO samples sent as binary telemetry frames instead of text
+
+#define SAMPLE_BUF_SIZE 64  // Samples held in the ring buffer, must be a power of 2
+
+#define FILT_NONE   0       // samples pass straight through
+#define FILT_AVG    1       // moving average of the last 2^filt_shift samples
+#define FILT_IIR    2       // first order low pass, y += (x - y) / 2^filt_shift
+#define FILT_BOX    3       // boxcar, average of each block of 2^filt_shift samples, one output per block
+#define FILT_CIC    4       // second order CIC, decimates by 2^filt_shift
+#define FILT_FRAC   4       // fraction bits in filter outputs, so averaging gains resolution below one LSB
+#define FILT_AVG_MAX 16     // longest moving average, sets the history kept for each axis
+#define FILT_DECIM_MAX_SHIFT 6  // decimation after the filter is up to 64
+#define FILT_BENCH_N 256    // samples run through each filter by the bench command
+#define FILT_BENCH_SHIFT 8  // log2 of FILT_BENCH_N
+
+typedef struct {
+	uint32 timestamp;         // sample number since the FIFO was enabled, one per output data period
+	int16  xyz[3];            // raw 12-bit signed acceleration, see convert_acc12_value
+} sample_t;
 
 volatile uint8  counter  = 0; // current number of char received on UART currently in RxBuf[]
-volatile uint8  BufReady = 0; // Flag to indicate if there is a sentence worth of data in RxBuf
+volatile uint8  BufReady = 0; // Flag to indicate if there is a sentence worth of data in CmdBuf
 volatile uint8  RxBuf[BUF_SIZE];
+volatile uint8  CmdBuf[CMD_QUEUE][BUF_SIZE];  // Completed sentences, copied from RxBuf by UART_ISR
+volatile uint8  cmd_head = 0;      // Next slot UART_ISR fills
+volatile uint8  cmd_tail = 0;      // Oldest sentence not yet run
+volatile uint32 cmd_lost = 0;      // Sentences discarded because CmdBuf was full
+volatile uint8  spi_done = 0; // Set by SPI_ISR when the hardware has finished a frame
 
-void send_bit(uint8 mosi_bit, uint8 clock_state){    // USed to send bits on MOSI line and simultaneously change state of clock
-	pt2GPIO->acc_out = clock_state<<2 | mosi_bit<<1;   // Pointer used to address the bit assigned to clock and MOSI
-}
+volatile uint8  TxBuf[TX_BUF_SIZE];  // Characters waiting for the UART, filled by fputc, emptied by the DMA controller
+volatile uint16 tx_head = 0;         // Next slot to be written
+volatile uint16 tx_tail = 0;         // Next slot to be sent
+volatile uint16 tx_dma_len = 0;      // Bytes from tx_tail the DMA is sending, 0 when it is idle
+volatile uint32 tx_dropped = 0;      // Characters discarded because TxBuf was full
+volatile uint32 tx_blocked = 0;      // Times a caller had to wait for room in TxBuf
+uint8 tx_policy = TX_POLICY_DROP;    // What to do when TxBuf is full - acquisition never stalls by default
+uint8 tx_reply = 0;                  // Set while a command reply is printed, which always waits for room
+
+sample_t sample_buf[SAMPLE_BUF_SIZE];   // Ring buffer of samples drained from the ADXL362 FIFO
+uint16 sample_head = 0;       // Next slot to be written
+uint16 sample_tail = 0;       // Next slot to be read
+uint32 sample_lost = 0;       // Samples discarded because the ring buffer was full
+uint32 fifo_timestamp = 0;    // Timestamp for the next complete XYZ set
+uint32 samples_read = 0;      // Samples read from the sensor in the current statistics window
+
+// Binary telemetry frame, all fields little endian:
+//   0  sync word 0xA5 0x5A
+//   2  sequence number, uint16, one per frame whether sent or dropped
+//   4  number of samples n, consecutive in timestamp
+//   5  mG per LSB of the sample values
+//   6  timestamp of the first sample, uint32
+//  10  3n 12-bit two's complement values X, Y, Z for each sample, packed two to three bytes,
+//      first value in the low 12 bits, so (9n+1)/2 bytes
+//  ..  CRC-16-CCITT (0x1021, start 0xFFFF) of everything after the sync word
+// host/telemetry_decode.c turns the stream back into CSV.
+#define TELEM_SYNC0         0xA5
+#define TELEM_SYNC1         0x5A
+#define TELEM_SAMPLES       16        // samples per frame, 5.25 bytes per sample instead of about 30 as text
+#define TELEM_HEADER        10
+#define TELEM_MAX           (TELEM_HEADER + (9*TELEM_SAMPLES+1)/2 + 2)
+
+uint8  telem_frame[TELEM_MAX];  // Frame being built
+uint16 telem_len = TELEM_HEADER; // Bytes used in telem_frame
+uint8  telem_n = 0;           // Samples in telem_frame
+uint8  telem_odd = 0;         // Last byte of telem_frame holds only the low half of a value pair
+uint16 telem_seq = 0;         // Sequence number of the next frame
+uint32 telem_next = 0;        // Timestamp a sample must have to join the current frame
+uint32 telem_dropped = 0;     // Frames discarded because TxBuf did not have room for all of it
 
-void wait_n_loops(uint32 n) {         // Delay for half period of clock
+void wait_n_loops(uint32 n) {         // Simple software delay
 	volatile uint32 i;
 		for(i=0;i<n;i++){
 			;
 		}
 }
 
-void bit_gen(uint8 byte2send){         // Function removes LSB bit from byte to be sent on MOSI
-	volatile uint8 i;
-	volatile uint8 bit2send;
-	for(i=0; i<8; i++){
-		bit2send = (byte2send>>(7-i))&1;   // Bit removed from byte and asssigned to bitssend
-		send_bit(bit2send, clock_low);     // Bit sent and clock set low
-		wait_n_loops(delay_val);           //insert delay to hold state of clock at low for short time
-		send_bit(bit2send, clock_high);    // change the state of the clock to HIGH
-		wait_n_loops(delay_val);           // Hold clcok state at high for short time before the ext bit is generated and clock will go low again
+void spi_init(){                      // Configures the SPI master that drives the ADXL362 pins
+	pt2SPI->ChipSel = cs_high;          // cs deasserted outside a frame
+	pt2SPI->ClkDiv  = spi_clk_div;      // set SPI clock rate
+	pt2SPI->Status  = 0;                // clear any old done/overrun flags
+	pt2SPI->Control = (1 << SPI_DONE_BIT_POS);   // interrupt when a frame is complete, and no others
+}
+
+void spi_transfer(const uint8 *tx, uint8 *rx, uint8 n){  // Sends n bytes in one chip select frame, received bytes stored in rx if not NULL, zeros sent if tx is NULL
+	uint8 i;
+	uint8 sent = 0;
+	uint8 got = 0;
+	uint8 byte;
+	spi_done = 0;
+	pt2SPI->Frame = n;                  // cs held low for exactly n bytes, released by hardware
+	if (n <= SPI_FIFO_SIZE){            // whole frame fits in the FIFOs, queue it all then wait
+		for(i=0; i<n; i++){
+			pt2SPI->TxData = tx ? tx[i] : 0;  // shifting starts with the first byte
+		}
+		while(!spi_done){                 // SPI_ISR sets the flag when the frame is complete
+		}
+		for(i=0; i<n; i++){               // one byte received for every byte sent
+			byte = pt2SPI->RxData;
+			if (rx) rx[i] = byte;
+		}
+		return;
 	}
+	while(got < n){                     // longer frame - keep the transmit FIFO topped up and empty the receive FIFO as bytes arrive
+		if (sent < n && (uint8)(sent - got) < SPI_FIFO_SIZE && !(pt2SPI->Status & (1 << SPI_TX_FIFO_FULL_BIT_POS))){
+			pt2SPI->TxData = tx ? tx[sent] : 0;
+			sent++;
+		}
+		if (pt2SPI->Status & (1 << SPI_RX_FIFO_EMPTY_BIT_POS)){
+			byte = pt2SPI->RxData;
+			if (rx) rx[got] = byte;
+			got++;
+		}
+	}
+	while(!spi_done){
+	}
+}
+
+void adxl_write_reg(uint8 addr, uint8 data){   // Writes one ADXL362 register
+	uint8 tx[3];
+	tx[0] = write_data;
+	tx[1] = addr;
+	tx[2] = data;
+	spi_transfer(tx, NULL, 3);
+}
+
+uint8 adxl_read_reg(uint8 addr){     // Reads one ADXL362 register
+	uint8 tx[3];
+	uint8 rx[3];
+	tx[0] = read_data;
+	tx[1] = addr;
+	tx[2] = 0x00;                      // dummy byte, clocks out the register contents
+	spi_transfer(tx, rx, 3);
+	return rx[2];
+}
+
+uint8 adxl_filter = filter_default | ((ACC_RANGE_G >> 2) << 6);   // FILTER_CTL, range generated in acc_tables.h
+
+void adxl_configure(){            // Writes range and output data rate from adxl_filter, in standby as the data sheet requires
+	adxl_write_reg(power_ctl_reg, power_standby);
+	adxl_write_reg(filter_ctl_reg, adxl_filter);
+	adxl_write_reg(power_ctl_reg, power_measure);
 }
 
 void accel_setup(){               // Used to configure ADXL362
-	uint8 pow_con_add = 0x2D;      // Power control register address
-	uint8 pow_con_data = 0x12;     // Measurement mode and low noise mode
-	pt2GPIO->acc_out = cs_high;    //cs initiliased as high
-	wait_n_loops(delay_val);       // Dealy
-	pt2GPIO->acc_out = cs_low;     //cs set to 0 to begin data transfer
-	bit_gen(write_data);           // Write mode set by sending byte on MOSI
-	bit_gen(pow_con_add);          // Address of register to be written to
-	bit_gen(pow_con_data);				//measurement mode and low noise mode
-	pt2GPIO->acc_out = cs_high;   //cs iniliased as high
+	adxl_configure();              // Measurement mode and low noise mode at the configured range
 }
 
-void mosi_clock(uint8 clock_state){    // Function to change the state of clock while receiving MISO data
-	pt2GPIO->acc_out = clock_state<<2;   // clcok changed state
+void adxl_read_xyz8(int8 *xyz){    // Reads the X, Y and Z 8-bit registers in a single auto-incrementing burst
+	uint8 tx[5] = {read_data, xdata8_reg, 0, 0, 0};
+	uint8 rx[5];
+	spi_transfer(tx, rx, 5);
+	xyz[0] = (int8)rx[2];
+	xyz[1] = (int8)rx[3];
+	xyz[2] = (int8)rx[4];
 }
 
-uint8 read_miso(){                     // This function returns each bit, MSB first and LSB last and reurns it to the byte_gen() to be assembled
-	volatile uint8 r_bit;          
-	//clock low, delay
-	mosi_clock(clock_low);               // Clock set low
-	wait_n_loops(delay_val);             // delays clcok in low state
-	r_bit = pt2GPIO->Buttons>>5;         // Assigns r-bit to the address in GPIO input 1 that the MISO signal is assigned
-	//clock high_delay 
-	mosi_clock(clock_high);              // Clock set high causing the MISO bit to be received
-	wait_n_loops(delay_val);
-	return r_bit;
+void adxl_read_xyz12(int16 *xyz){  // Reads the X, Y and Z 12-bit registers (0x0E to 0x13) in a single burst
+	uint8 tx[8] = {read_data, xdata12_reg, 0, 0, 0, 0, 0, 0};
+	uint8 rx[8];
+	uint8 i;
+	spi_transfer(tx, rx, 8);
+	for(i=0; i<3; i++){              // low byte first, high byte already sign extended by the ADXL362
+		xyz[i] = (int16)(rx[2+2*i] | (rx[3+2*i] << 8));
+	}
+}
+
+void adxl_fifo_enable(uint8 on){   // Puts the ADXL362 FIFO into stream mode, or turns it off
+	adxl_write_reg(fifo_samples_reg, 0x80);                    // watermark not used, samples are polled
+	adxl_write_reg(fifo_control_reg, on ? fifo_stream : fifo_off);
+	fifo_timestamp = 0;
 }
 
-uint8 byte_gen(){                  // Receives MISO bits and assemebles as a byte, MSB received first and LSB last
-	volatile uint8 bit;
-	volatile uint8 byte;
-	volatile uint8 i;
-	for(i=0; i<8; i++){
-		bit = read_miso();             // Bit returned from read_miso()
-		byte = (byte)| bit<<(7-i);     // Assembled as a byte
+void sample_push(int16 *xyz){       // Adds one timestamped sample to the ring buffer, drops it if full
+	sample_t *s;
+	samples_read++;
+	if (((sample_head + 1) & (SAMPLE_BUF_SIZE-1)) == sample_tail){
+		sample_lost++;
+		fifo_timestamp++;
+		return;
 	}
-	return byte;
+	s = &sample_buf[sample_head];
+	s->timestamp = fifo_timestamp++;
+	s->xyz[0] = xyz[0];
+	s->xyz[1] = xyz[1];
+	s->xyz[2] = xyz[2];
+	sample_head = (sample_head + 1) & (SAMPLE_BUF_SIZE-1);
 }
 
-int32 convert_acc_value(int raw_value){ // Function to take the raw value of the adc on the accelerometer to meaningful values (in mg)
-	return raw_value * ( 2000/ 128); // assumes accelerometer mode of operation to have += 2G of tolerance. 
+uint8 sample_pop(sample_t *s){      // Takes the oldest sample from the ring buffer, returns 0 if empty
+	if (sample_tail == sample_head) return 0;
+	*s = sample_buf[sample_tail];
+	sample_tail = (sample_tail + 1) & (SAMPLE_BUF_SIZE-1);
+	return 1;
 }
 
-void set_display(int32 value){ // Function to write a value (in mGs) to the display. Unfortunately, displays the value in hex. 
-	int control;
-	value = value<<8; // Move over two hex display places to make space for units
-	if (value < 0){
-		pt2Display->rawHigh = 0x200; //write minus symbol
-		value*= -1; // invert value to make it wasier to work with
-		control = 0x3F1C00; // Control acounts for negative sign
+uint16 adxl_fifo_drain(){           // Moves every complete XYZ set in the ADXL362 FIFO into the ring buffer, returns number of sets
+	static uint8 frame[2*fifo_chunk+1];
+	static int16 xyz[3];
+	static uint8 have = 0;           // axes collected so far for the current set, one bit per axis
+	uint8 tx[4] = {read_data, fifo_entries_reg, 0, 0};
+	uint8 rx[4];
+	uint16 entries;
+	uint16 sets = 0;
+	uint8 n;
+	uint8 i;
+	spi_transfer(tx, rx, 4);
+	entries = (rx[2] | (rx[3] << 8)) & 0x3FF;
+	entries = (((uint32)entries * 0xAAAB) >> 17) * 3;   // only read whole sets, as recommended in the ADXL362 data sheet; / 3 by reciprocal, no hardware divider
+	while(entries){
+		n = (entries > fifo_chunk) ? fifo_chunk : entries;
+		frame[0] = fifo_read;
+		spi_transfer(frame, frame, 2*n+1);     // received bytes overwrite the command, data starts at frame[1]
+		for(i=0; i<n; i++){
+			uint16 word = frame[1+2*i] | (frame[2+2*i] << 8);   // low byte first
+			uint8 axis = word >> 14;               // bits 15:14 identify the axis, 3 = temperature
+			if (axis < 3){
+				xyz[axis] = (int16)(word << 2) >> 2;   // sign extend 14-bit field
+				have |= 1 << axis;
+				if (have == 0x07){
+					sample_push(xyz);
+					have = 0;
+					sets++;
+				}
+			}
+		}
+		entries -= n;
 	}
-	else{
-		control = 0x3F3C00; // Control does nto account for negative sign
+	return sets;
+}
+
+uint8 acc_range = ACC_RANGE_G;        // ADXL362 range in G, changed by the range command
+int32 acc8_scale = ACC8_MG_SCALE;     // mG scale factors for acc_range, sensitivity is proportional to the range
+int32 acc12_scale = ACC12_MG_SCALE;
+
+int32 convert_acc_value(int raw_value){ // Function to take the raw value of an 8-bit register on the accelerometer to meaningful values (in mg)
+	return (raw_value * acc8_scale) >> ACC8_MG_SHIFT; // generated for the range in tools/tables_config.h
+}
+
+int32 convert_acc12_value(int raw_value){ // Same for the 12-bit registers and the FIFO
+	return (raw_value * acc12_scale) >> ACC12_MG_SHIFT;
+}
+
+void display_init(void){ // Sets up the display once: mG units on digits 1 and 0, signed decimal field on digits 7 to 2
+	pt2Display->rawLow = 0x55BC; //mG
+	pt2Display->control = 0x030000; // digits 1 and 0 enabled in raw mode, the decimal field overrides the rest
+	pt2Display->decConfig = DISPLAY_DEC_ENABLE | (6 << DISPLAY_DEC_WIDTH_POS) | (2 << DISPLAY_DEC_OFFSET_POS);
+}
+
+void set_display(int32 value){ // Function to write a value (in mGs) to the display, converted to decimal with its sign by the hardware
+	pt2Display->decData = value;
+}
+
+//////////////////////////////////////////////////////////////////
+// Filter stage - between acquisition and output for the burst and FIFO
+// modes, on all three axes. Lengths and decimation are powers of 2, so
+// there is no division, which the M0 would do in software. Outputs are
+// in LSB << FILT_FRAC. Decimation follows the sample timestamps, so a
+// decimated output's timestamp is the input's shifted down and outputs
+// stay consecutive for the telemetry frames.
+//////////////////////////////////////////////////////////////////
+const char *const filter_names[] = {"none", "avg", "iir", "box", "cic"};
+const uint8 filter_max_shift[] = {0, 4, 8, 6, 6};   // longest of each, 2^shift samples
+
+uint8  filt_type = FILT_NONE;         // set by the filter command
+uint8  filt_shift = 0;                // log2 of the filter length
+uint8  filt_decim = 0;                // log2 of the decimation after the filter, set by the decimate command
+int32  filt_acc[3];                   // running sum for avg and box, state in LSB << (FILT_FRAC + filt_shift) for iir
+int16  filt_hist[3][FILT_AVG_MAX];    // moving average history
+uint8  filt_pos = 0;                  // oldest entry in filt_hist
+uint32 cic_int[3][2];                 // CIC integrators and comb delays, wrap around by design
+uint32 cic_comb[3][2];
+uint32 filt_count = 0;                // inputs since the filter was reset
+uint32 filt_next = 0;                 // timestamp the next input should have
+uint32 filt_in = 0;                   // inputs and outputs in the current statistics window
+uint32 filt_out = 0;
+uint32 filt_cycles = 0;               // cycles spent filtering in the current statistics window
+
+void filter_reset(){                  // Forgets the past, the next input starts new windows
+	memset(filt_acc, 0, sizeof(filt_acc));
+	memset(cic_int, 0, sizeof(cic_int));
+	memset(cic_comb, 0, sizeof(cic_comb));
+	filt_pos = 0;
+	filt_count = 0;
+}
+
+uint8 filter_block(){                 // log2 of the inputs per output of the filter itself
+	return (filt_type == FILT_BOX || filt_type == FILT_CIC) ? filt_shift : 0;
+}
+
+uint8 filter_run(const int16 *xyz, uint32 ts, int32 *q){  // Takes one sample, returns 1 with a filtered sample in q when one is due
+	uint8 k = filt_shift;
+	uint8 block = filter_block();
+	uint8 dump, due;
+	uint8 i, j;
+	if (ts != filt_next) filter_reset();   // lost samples or a restarted FIFO
+	filt_next = ts + 1;
+	filt_count++;
+	dump = ((ts + 1) & ((1 << block) - 1)) == 0;                 // end of a box or CIC block
+	due = ((ts + 1) & ((1 << (block + filt_decim)) - 1)) == 0;   // end of a decimation period
+	for (i = 0; i < 3; i++){
+		int32 x = xyz[i];
+		switch (filt_type){
+		case FILT_AVG:
+			if (filt_count == 1){                   // history starts full of the first sample, no ramp from zero
+				for (j = 0; j < (1 << k); j++) filt_hist[i][j] = x;
+				filt_acc[i] = x << k;
+			}
+			filt_acc[i] += x - filt_hist[i][filt_pos];
+			filt_hist[i][filt_pos] = x;
+			q[i] = (filt_acc[i] << FILT_FRAC) >> k;
+			break;
+		case FILT_IIR:
+			if (filt_count == 1) filt_acc[i] = (x << FILT_FRAC) << k;
+			filt_acc[i] += (x << FILT_FRAC) - (filt_acc[i] >> k);
+			q[i] = filt_acc[i] >> k;
+			break;
+		case FILT_BOX:
+			filt_acc[i] += x;
+			if (dump){
+				q[i] = (filt_acc[i] << FILT_FRAC) >> k;
+				filt_acc[i] = 0;
+			}
+			break;
+		case FILT_CIC:
+			cic_int[i][0] += x;
+			cic_int[i][1] += cic_int[i][0];
+			if (dump){                              // combs run at the output rate, gain 2^(2k)
+				uint32 c1 = cic_int[i][1] - cic_comb[i][0];
+				uint32 c2 = c1 - cic_comb[i][1];
+				cic_comb[i][0] = cic_int[i][1];
+				cic_comb[i][1] = c1;
+				q[i] = ((int32)c2 << FILT_FRAC) >> (2*k);
+			}
+			break;
+		default:
+			q[i] = x << FILT_FRAC;
+		}
+	}
+	if (filt_type == FILT_AVG) filt_pos = (filt_pos + 1) & ((1 << k) - 1);
+	if (filt_count < (uint32)(filt_type == FILT_CIC ? 2 : 1) << block)
+		return 0;                           // block started before a reset, or CIC still settling
+	return due;
+}
+
+int32 convert_filt_value(int32 q){    // Filter output to mG, keeping the fraction bits until the end
+	return (q * acc12_scale) >> (ACC12_MG_SHIFT + FILT_FRAC);
+}
+
+int16 filt_lsb(int32 q){              // Filter output rounded back to whole 12-bit LSBs, for telemetry
+	return (int16)((q + (1 << (FILT_FRAC-1))) >> FILT_FRAC);
+}
+
+#define UART_RX_INT  (1 << UART_RX_FIFO_EMPTY_BIT_INT_POS)		// rx data available interrupt
+
+void uart_dma_init(void){            // DMA channel writes TxBuf bytes to the UART whenever its transmit FIFO has room
+	pt2DMA->Ch[TX_DMA_CH].Dst = (uint32)&pt2UART->TxData;
+	pt2DMA->Ch[TX_DMA_CH].Poll = (uint32)&pt2UART->Status;
+	pt2DMA->Ch[TX_DMA_CH].Match = DMA_MATCH(1 << UART_TX_FIFO_FULL_BIT_POS, 0);   // not full
+}
+
+void uart_tx_start(void){            // Hands the next run of TxBuf to the DMA if it is idle. Call with interrupts off or from an ISR
+	uint16 n;
+	if (tx_dma_len || tx_tail == tx_head) return;
+	n = (tx_head > tx_tail) ? tx_head - tx_tail : TX_BUF_SIZE - tx_tail;   // contiguous, up to the end of the buffer
+	if (n > TX_DMA_CHUNK) n = TX_DMA_CHUNK;
+	tx_dma_len = n;
+	pt2DMA->Ch[TX_DMA_CH].Src = (uint32)&TxBuf[tx_tail];
+	pt2DMA->Ch[TX_DMA_CH].Count = n;
+	pt2DMA->Ch[TX_DMA_CH].Control = DMA_ENABLE | DMA_SRC_INC | DMA_BYTE | DMA_PACED | DMA_INT_ENABLE;
+}
+
+uint8 uart_tx_put(uint8 c){         // Adds a character to TxBuf, returns 0 if it was dropped. Call with interrupts off or from an ISR
+	uint16 next = (tx_head + 1) & (TX_BUF_SIZE-1);
+	if (next == tx_tail){              // buffer full
+		tx_dropped++;
+		return 0;
 	}
-	pt2Display->rawLow = 0x155BC; //mG
-	pt2Display->hexData = value; 
-	pt2Display->control = control;
+	TxBuf[tx_head] = c;
+	tx_head = next;
+	uart_tx_start();
+	return 1;
+}
+
+uint8 uart_tx_write(const uint8 *p, uint16 n){  // Adds n bytes to TxBuf all together, or none of them if there is not room. Returns 0 if dropped
+	uint16 i;
+	__disable_irq();                   // DMA_ISR moves tx_tail and UART_ISR adds the echo
+	if (((tx_tail - tx_head - 1) & (TX_BUF_SIZE-1)) < n){
+		__enable_irq();
+		return 0;
+	}
+	for (i=0; i<n; i++){
+		TxBuf[tx_head] = p[i];
+		tx_head = (tx_head + 1) & (TX_BUF_SIZE-1);
+	}
+	uart_tx_start();
+	__enable_irq();
+	return 1;
+}
+
+int fputc(int ch, FILE *f){           // Retargeted from the C library so printf goes through TxBuf
+	(void)f;                           // there is only the UART
+	if ((tx_policy == TX_POLICY_BLOCK || tx_reply) && ((tx_head + 1) & (TX_BUF_SIZE-1)) == tx_tail){
+		tx_blocked++;
+		while (((tx_head + 1) & (TX_BUF_SIZE-1)) == tx_tail){  // the DMA is already draining the buffer
+		}
+	}
+	__disable_irq();                   // UART_ISR also adds characters (the echo)
+	uart_tx_put((uint8)ch);
+	__enable_irq();
+	return ch;
+}
+
+uint16 crc16_ccitt(const uint8 *p, uint16 n){  // CRC-16-CCITT, a byte at a time without a table
+	uint16 crc = 0xFFFF;
+	uint8 x;
+	while (n--){
+		x = (crc >> 8) ^ *p++;
+		x ^= x >> 4;
+		crc = (crc << 8) ^ ((uint16)x << 12) ^ ((uint16)x << 5) ^ x;
+	}
+	return crc;
+}
+
+void telem_value(int16 v){          // Packs one 12-bit value into telem_frame, two values to three bytes
+	if (!telem_odd){
+		telem_frame[telem_len++] = (uint8)v;
+		telem_frame[telem_len++] = (v >> 8) & 0x0F;
+	}
+	else {
+		telem_frame[telem_len-1] |= (uint8)(v << 4);
+		telem_frame[telem_len++] = (uint8)(v >> 4);
+	}
+	telem_odd ^= 1;
+}
+
+void telem_flush(){                 // Finishes the current frame and queues it for the UART, whole or not at all
+	uint16 crc;
+	uint8 mg_per_lsb = (uint8)convert_acc12_value(1);
+	if (!telem_n) return;
+	telem_frame[0] = TELEM_SYNC0;
+	telem_frame[1] = TELEM_SYNC1;
+	telem_frame[2] = (uint8)telem_seq;
+	telem_frame[3] = (uint8)(telem_seq >> 8);
+	telem_frame[4] = telem_n;
+	telem_frame[5] = mg_per_lsb;
+	crc = crc16_ccitt(&telem_frame[2], telem_len - 2);   // timestamp already in place
+	telem_frame[telem_len++] = (uint8)crc;
+	telem_frame[telem_len++] = (uint8)(crc >> 8);
+	if (tx_policy == TX_POLICY_BLOCK && ((tx_tail - tx_head - 1) & (TX_BUF_SIZE-1)) < telem_len){
+		tx_blocked++;
+		while (((tx_tail - tx_head - 1) & (TX_BUF_SIZE-1)) < telem_len){  // the DMA drains TxBuf
+		}
+	}
+	if (!uart_tx_write(telem_frame, telem_len))
+		telem_dropped++;               // the sequence gap tells the decoder
+	telem_seq++;
+	telem_n = 0;
+	telem_len = TELEM_HEADER;
+	telem_odd = 0;
+}
+
+void telem_add(sample_t *s){        // Adds a sample to the current frame, sent when full or when the timestamps break
+	if (telem_n && s->timestamp != telem_next)
+		telem_flush();                  // samples were lost, or the FIFO restarted
+	if (!telem_n){
+		telem_frame[6] = (uint8)s->timestamp;
+		telem_frame[7] = (uint8)(s->timestamp >> 8);
+		telem_frame[8] = (uint8)(s->timestamp >> 16);
+		telem_frame[9] = (uint8)(s->timestamp >> 24);
+	}
+	telem_value(s->xyz[0]);
+	telem_value(s->xyz[1]);
+	telem_value(s->xyz[2]);
+	telem_n++;
+	telem_next = s->timestamp + 1;
+	if (telem_n == TELEM_SAMPLES)
+		telem_flush();
+}
+
+//////////////////////////////////////////////////////////////////
+// Interrupt service routine, runs when SPI frame completes - IRQ2 in cm0dsasm.s
+//////////////////////////////////////////////////////////////////
+void SPI_ISR(){
+	pt2SPI->Status = 0;    // clear done flag, which also removes the interrupt request
+	spi_done = 1;          // tell spi_transfer() that the received bytes are ready
+}
+
+//////////////////////////////////////////////////////////////////
+// Interrupt service routine, runs when the impact detector has recorded an event
+//////////////////////////////////////////////////////////////////
+typedef struct {
+	uint32 time;                        // hardware timestamp, microseconds
+	uint8  axes;                        // axes over threshold, bit 0 = X
+} impact_t;
+
+impact_t impact_queue[IMPACT_QUEUE];  // Events taken from the hardware FIFO, waiting for task_report
+volatile uint8  impact_head = 0;      // Next slot Impact_ISR fills
+volatile uint8  impact_tail = 0;      // Oldest event not yet reported
+volatile uint32 impact_lost = 0;      // Events discarded because impact_queue was full
+
+void Impact_ISR(){
+	uint8 status;
+	impact_t *e;
+	while ((status = pt2Impact->Status) & IMPACT_EVENT_WAITING){  // empty the event FIFO, which removes the interrupt request
+		e = &impact_queue[impact_head];
+		e->axes = (status >> IMPACT_AXES_POS) & 0x07;
+		e->time = pt2Impact->Time;        // reading the time removes the event from the hardware
+		if (((impact_head + 1) & (IMPACT_QUEUE-1)) != impact_tail)
+			impact_head = (impact_head + 1) & (IMPACT_QUEUE-1);
+		else impact_lost++;               // task_report is too far behind, the slot is used again
+	}
+}
+
+void impact_thresholds(void){ // Same threshold in mG whatever the range
+	uint32 lsb = ACC_IMPACT_LSB * ACC_RANGE_G / acc_range;
+	pt2Impact->ThresholdX = lsb;
+	pt2Impact->ThresholdY = lsb;
+	pt2Impact->ThresholdZ = lsb;
+}
+
+void impact_init(void){ // Hardware checks every sample read from the ADXL362, on all axes
+	impact_thresholds();
+	pt2Impact->HoldOff = IMPACT_HOLDOFF_MS * 1000;
+	pt2Impact->Count = 0;
+	pt2Impact->Control = IMPACT_STREAM_ENABLE | IMPACT_INT_ENABLE;
 }
 
 //////////////////////////////////////////////////////////////////
@@ -119,93 +596,581 @@ void set_display(int32 value){ // Function to write a value (in mGs) to the disp
 //////////////////////////////////////////////////////////////////
 void UART_ISR(){
 	char c;
-	c = pt2UART->RxData;	 // read a character from UART - interrupt only occurs when character waiting
-	RxBuf[counter]  = c;   // Store in buffer
-	counter++;             // Increment counter to indicate that there is now 1 more character in buffer
-	pt2UART->TxData = c;   // write (echo) the character to UART (assuming transmit queue not full!)
-	// counter is now the position that the next character should go into
-	// If this is the end of the buffer, i.e. if counter==BUF_SIZE-1, then null terminate
-	// and indicate the a complete sentence has been received.
-	// If the character just put in was a carriage return, do likewise.
-	if (counter == BUF_SIZE-1 || c == ASCII_CR)  {
-		counter--;							// decrement counter (CR will be over-written)
-		RxBuf[counter] = NULL;  // Null terminate
-		BufReady       = 1;	    // Indicate to rest of code that a full "sentence" has being received (and is in RxBuf)
+	uint8 i;
+	while (pt2UART->Status & (1 << UART_RX_FIFO_EMPTY_BIT_POS)){  // empty the receive FIFO, transmit is done by the DMA
+		c = pt2UART->RxData;	 // read a character from UART
+		RxBuf[counter]  = c;   // Store in buffer
+		counter++;             // Increment counter to indicate that there is now 1 more character in buffer
+		uart_tx_put(c);        // echo the character through TxBuf, never wait inside the interrupt
+		// counter is now the position that the next character should go into
+		// If this is the end of the buffer, i.e. if counter==BUF_SIZE-1, then null terminate
+		// and indicate the a complete sentence has been received.
+		// If the character just put in was a carriage return, do likewise.
+		if (counter == BUF_SIZE-1 || c == ASCII_CR)  {
+			counter--;							// decrement counter (CR will be over-written)
+			RxBuf[counter] = NULL;  // Null terminate
+			if (((cmd_head + 1) & (CMD_QUEUE-1)) != cmd_tail){   // hand the sentence over, so the next one can be received while it is handled
+				for (i = 0; i <= counter; i++) CmdBuf[cmd_head][i] = RxBuf[i];
+				cmd_head = (cmd_head + 1) & (CMD_QUEUE-1);
+				BufReady = 1;	        // Indicate to rest of code that a full "sentence" has being received (and is in CmdBuf)
+			}
+			else cmd_lost++;        // task_command is too far behind
+			counter = 0;            // next sentence starts at the beginning of RxBuf
+		}
 	}
 }
 
+//////////////////////////////////////////////////////////////////
+// Interrupt service routine, runs when a DMA channel is done - see cm0dsasm.s
+//////////////////////////////////////////////////////////////////
+void DMA_ISR(){
+	pt2DMA->Status = DMA_DONE(TX_DMA_CH);   // removes the interrupt request
+	tx_tail = (tx_tail + tx_dma_len) & (TX_BUF_SIZE-1);   // those bytes are in the UART now
+	tx_dma_len = 0;
+	uart_tx_start();                        // and the next run, if there is one
+}
+
 void set_LED(int8 acc_val){ // This function taskes the acceleration value from the ADC and determines the LED to illuminate
-	int8 acc_value_ranges[] = {-112, -96, -80, -64, -40, -32, -16, 0, 16, 32, 48, 64, 80, 96, 112}; // bins for acceleration ranges
-	int x;
-	int LED_value = 1; // holds the value of the LED. Loop moves the LED over one by one. 
-	for (x=0; x<15; x++){
-		if (acc_val > acc_value_ranges[x]){
-			LED_value = LED_value<<1; // Moves LED over by one
+	pt2GPIO->LED = led_table[(uint8)acc_val]; // One LED for each equal step of acceleration, looked up directly
+}
+
+//////////////////////////////////////////////////////////////////
+// Periodic scheduler - SysTick interrupt every TICK_CYCLES, tasks run
+// from main() when due, processor sleeps with WFI in between.
+//////////////////////////////////////////////////////////////////
+volatile uint32 sys_ticks = 0;        // SysTick interrupts since start
+volatile uint32 tick_lat_min = 0xFFFFFFFF;  // SysTick interrupt entry latency, in clock cycles after the reload
+volatile uint32 tick_lat_max = 0;
+uint32 idle_cycles = 0;               // cycles spent asleep in WFI in the current statistics window
+uint32 stats_start = 0;               // cycle time the statistics window started
+
+void SysTick_Handler(){
+	uint32 lat = SYSTICK_RELOAD - pt2SysTick->VAL;  // counter reloaded at the tick, so this is time since the tick
+	sys_ticks++;
+	if (lat < tick_lat_min) tick_lat_min = lat;
+	if (lat > tick_lat_max) tick_lat_max = lat;
+}
+
+uint32 cycle_time(){                  // Free-running cycle count built from the tick count and the SysTick counter
+	uint32 ticks, val;
+	do {
+		ticks = sys_ticks;
+		val = pt2SysTick->VAL;
+	} while (ticks != sys_ticks);       // tick happened while reading, try again
+	return ticks * TICK_CYCLES + (SYSTICK_RELOAD - val);
+}
+
+typedef struct {
+	void (*run)(void);                  // task function
+	uint32 period;                      // in ticks, 0 = task disabled
+	uint32 due;                         // tick at which it next runs
+} task_t;
+
+void task_acquire(void);
+void task_display(void);
+void task_report(void);
+void task_stats(void);
+void task_command(void);
+
+task_t tasks[] = {                    // in priority order, earlier tasks run first when due together
+	{task_acquire, ACQ_PERIOD_MS,     0},
+	{task_display, DISPLAY_PERIOD_MS, 0},
+	{task_report,  REPORT_PERIOD_MS,  0},
+	{task_stats,   STATS_PERIOD_MS,   0},
+	{task_command, COMMAND_PERIOD_MS, 0},
+};
+
+void scheduler_init(){
+	pt2SysTick->LOAD = SYSTICK_RELOAD;
+	pt2SysTick->VAL  = 0;               // any write clears the counter
+	pt2SysTick->CTRL = SYSTICK_ENABLE | SYSTICK_TICKINT | SYSTICK_CLKSOURCE;  // processor clock, interrupt on each reload
+	pt2PerfMon->Control = PERFMON_RUN | PERFMON_CLEAR;   // bus counters start with the statistics window
+}
+
+void scheduler_run(){                 // Never returns
+	uint32 i;
+	uint32 before;
+	stats_start = cycle_time();
+	while(1){
+		uint32 now = sys_ticks;
+		for (i = 0; i < ARRAY_SIZE(tasks); i++){
+			if (tasks[i].period && (int32)(now - tasks[i].due) >= 0){
+				tasks[i].due += tasks[i].period;
+				if ((int32)(now - tasks[i].due) >= 0) tasks[i].due = now + tasks[i].period;  // overran, skip missed runs rather than bunching
+				tasks[i].run();
+			}
+		}
+		before = cycle_time();
+		__disable_irq();                  // no interrupt can slip in between the check and the sleep
+		if (now == sys_ticks) __WFI();    // sleep until the next interrupt, which wakes WFI even with interrupts masked
+		__enable_irq();                   // pending interrupt handled here
+		idle_cycles += cycle_time() - before;
+	}
+}
+
+//////////////////////////////////////////////////////////////////
+// Tasks
+//////////////////////////////////////////////////////////////////
+uint16 acq_mode = 0;                  // switch settings for the current acquisition
+uint8  acq_axis = 1;                  // axis shown on display and LEDs: 0 = X, 1 = Y, 2 = Z
+uint16 fifo_on = 0;                   // ACQ_FIFO bit when the ADXL362 FIFO is streaming
+int8   acc_val;                       // latest sample in 8-bit register scale, for LEDs
+int32  scaled_acc;                    // latest sample in mG
+int32  last_xyz[3];                   // latest burst sample, in mG
+uint8  new_sample = 0;                // set by task_acquire, cleared by task_report
+uint8  report_binary = 0;             // FIFO samples sent as telemetry frames, from switch 6 or the format command
+uint8  report_axes = 0x07;            // axes printed in text reports, bit 0 = X, set by the axes command
+
+void print_xyz(const int32 *mg){      // Prints the enabled axes of one sample in mG
+	uint8 i;
+	for (i = 0; i < 3; i++)
+		if (report_axes & (1 << i)) printf("%c: %d ", 'x' + i, mg[i]);
+	printf("mG\n\r");
+}
+
+void task_acquire(){
+	uint16 mode = pt2GPIO->Switches;
+	uint8 data_add;
+	if((mode&0x01) == 0x01){            // Allows user to chose axis on which acceleration will be read
+		acq_axis = 1; }
+	else if((mode&0x02) == 0x02){
+		acq_axis = 0; }
+	else if((mode&0x04) == 0x04){
+		acq_axis = 2; }
+	data_add = xdata8_reg + acq_axis;   // 8-bit data registers are X, Y, Z in order
+	if ((mode ^ acq_mode) & REPORT_BINARY)   // switch moved, overrides the format command
+		report_binary = (mode & REPORT_BINARY) != 0;
+	acq_mode = mode;
+
+	if ((mode & ACQ_FIFO) != fifo_on){  // FIFO mode switched on or off
+		fifo_on = mode & ACQ_FIFO;
+		adxl_fifo_enable(fifo_on != 0);
+	}
+
+	if (fifo_on){                       // Stream mode - move everything the ADXL362 has buffered into the ring buffer
+		adxl_fifo_drain();                // task_report empties the ring buffer
+	}
+	else if (mode & (ACQ_BURST8 | ACQ_BURST12)){   // All three axes in one frame, through the filter
+		static uint32 burst_count = 0;  // timestamps for the filter, one per burst
+		int16 xyz[3];
+		int32 q[3];
+		uint32 t0;
+		uint8 due;
+		if (mode & ACQ_BURST12)
+			adxl_read_xyz12(xyz);
+		else {
+			int8 xyz8[3];
+			adxl_read_xyz8(xyz8);
+			xyz[0] = xyz8[0] << 4;          // 8-bit registers are the top of the 12-bit value
+			xyz[1] = xyz8[1] << 4;
+			xyz[2] = xyz8[2] << 4;
+		}
+		t0 = pt2PerfMon->Now;
+		due = filter_run(xyz, burst_count++, q);
+		filt_cycles += pt2PerfMon->Now - t0;
+		filt_in++;
+		if (due){
+			last_xyz[0] = convert_filt_value(q[0]);
+			last_xyz[1] = convert_filt_value(q[1]);
+			last_xyz[2] = convert_filt_value(q[2]);
+			scaled_acc = last_xyz[acq_axis];
+			acc_val = (int8)(q[acq_axis] >> (FILT_FRAC + 4));   // same scale as the 8-bit registers
+			new_sample = 1;
+			filt_out++;
+		}
+	}
+	else {
+		acc_val = (int8)adxl_read_reg(data_add);   // Reads acceleration byte in a single SPI frame
+		scaled_acc = convert_acc_value(acc_val);   // Data scaled to mG
+		new_sample = 1;
+	}
+	if (!fifo_on) samples_read++;
+}
+
+void task_display(){
+	set_display(scaled_acc);            // Sent to the display
+	set_LED(acc_val);                   // Set LED based on acceleration value
+}
+
+void task_report(){
+	if (!fifo_on || !report_binary)
+		telem_flush();                    // left over from binary streaming, send what there is
+	if (fifo_on){
+		sample_t smp;
+		sample_t out;
+		int32 q[3];
+		int32 shown[3];                   // last output that was due, q also holds partial sums between outputs
+		uint8 any = 0;
+		uint8 due;
+		uint32 t0;
+		if (!sample_pop(&smp)) return;    // nothing new yet
+		do {
+			t0 = pt2PerfMon->Now;
+			due = filter_run(smp.xyz, smp.timestamp, q);
+			filt_cycles += pt2PerfMon->Now - t0;
+			filt_in++;
+			if (!due) continue;             // decimated away
+			filt_out++;
+			any = 1;
+			shown[0] = q[0];
+			shown[1] = q[1];
+			shown[2] = q[2];
+			out.timestamp = smp.timestamp >> (filter_block() + filt_decim);
+			if (report_binary){
+				out.xyz[0] = filt_lsb(q[0]);
+				out.xyz[1] = filt_lsb(q[1]);
+				out.xyz[2] = filt_lsb(q[2]);
+				telem_add(&out);            // always all three axes
+			}
+			else {
+				int32 mg[3];
+				mg[0] = convert_filt_value(q[0]);
+				mg[1] = convert_filt_value(q[1]);
+				mg[2] = convert_filt_value(q[2]);
+				printf("%u ", out.timestamp);
+				print_xyz(mg);
+			}
+		} while (sample_pop(&smp));
+		if (any){                         // most recent output shown on display and LEDs
+			scaled_acc = convert_filt_value(shown[acq_axis]);
+			acc_val = (int8)(shown[acq_axis] >> (FILT_FRAC + 4));
+		}
+	}
+	else if (new_sample){
+		if (acq_mode & (ACQ_BURST8 | ACQ_BURST12))
+			print_xyz(last_xyz);
+		else
+			printf("acc_val: %d mG\n\r",scaled_acc);      // Shows the acceleration data in mG in the terminal
+		new_sample = 0;
+	}
+	if (impact_tail != impact_head){
+		do {                              // every event, in the order they happened
+			impact_t *e = &impact_queue[impact_tail];
+			printf("High impact detected at %u us, axes %c%c%c\n", e->time,
+				(e->axes & 1) ? 'X' : '-', (e->axes & 2) ? 'Y' : '-', (e->axes & 4) ? 'Z' : '-');
+			impact_tail = (impact_tail + 1) & (IMPACT_QUEUE-1);   // slot only handed back once printed
+		} while (impact_tail != impact_head);
+		printf("Number of impacts detected: %d\n\r", pt2Impact->Count);
+	}
+}
+
+uint32 percent(uint32 part, uint32 whole){   // No hardware divider, so one divide by a rounded-down hundredth
+	return (whole >= 100) ? part / (whole / 100) : 0;
+}
+
+void perfmon_report(){                // Bus use for the last window, measured by the performance monitor
+	uint32 cycles, awake, busy, periph, n;
+	pt2PerfMon->Control = PERFMON_RUN | PERFMON_SNAP | PERFMON_CLEAR;   // next window starts in the same cycle
+	cycles = pt2PerfMon->Cycles;
+	awake = cycles - pt2PerfMon->Sleep;
+	busy = awake - pt2PerfMon->Idle;
+	periph = pt2PerfMon->Reads + pt2PerfMon->Writes - pt2PerfMon->Slave[PERFMON_ROM] - pt2PerfMon->Slave[PERFMON_RAM];
+	n = samples_read;
+	samples_read = 0;
+	printf("bus: %u%% busy, %u%% asleep, %u wait states, %u reads %u writes\n\r",
+		percent(busy, cycles), percent(cycles - awake, cycles), pt2PerfMon->Wait, pt2PerfMon->Reads, pt2PerfMon->Writes);
+	printf("bus: rom %u ram %u gpio %u uart %u display %u spi %u impact %u other %u\n\r",
+		pt2PerfMon->Slave[PERFMON_ROM], pt2PerfMon->Slave[PERFMON_RAM], pt2PerfMon->Slave[PERFMON_GPIO],
+		pt2PerfMon->Slave[PERFMON_UART], pt2PerfMon->Slave[PERFMON_DISPLAY], pt2PerfMon->Slave[PERFMON_SPI],
+		pt2PerfMon->Slave[PERFMON_IMPACT], pt2PerfMon->Slave[PERFMON_OTHER]);
+	if (n) printf("per sample (%u): %u cycles awake, %u peripheral transfers\n\r", n, awake / n, periph / n);
+}
+
+void task_stats(){                    // Reports scheduler jitter, idle time and bus use for the last window
+	uint32 now = cycle_time();
+	printf("sched: tick latency %u-%u cycles (jitter %u), idle %u%%\n\r",
+		tick_lat_min, tick_lat_max, tick_lat_max - tick_lat_min, percent(idle_cycles, now - stats_start));
+	perfmon_report();
+	if (filt_in)
+		printf("filter: %u in, %u out, %u cycles per input\n\r", filt_in, filt_out, filt_cycles / filt_in);
+	filt_in = 0;
+	filt_out = 0;
+	filt_cycles = 0;
+	tick_lat_min = 0xFFFFFFFF;
+	tick_lat_max = 0;
+	idle_cycles = 0;
+	stats_start = now;
+}
+
+//////////////////////////////////////////////////////////////////
+// Command interface - one command per line from the UART, handled
+// by task_command when UART_ISR sets BufReady. Settings last until
+// the next command, or until the matching switch is moved.
+//////////////////////////////////////////////////////////////////
+typedef struct {
+	const char *name;
+	uint8 (*run)(char *arg);            // returns 0 if the argument was not accepted
+	const char *help;
+} command_t;
+
+void acq_restart(){                   // After a range or rate change, samples taken with the old settings are thrown away
+	telem_flush();
+	adxl_configure();
+	sample_tail = sample_head;
+	filter_reset();
+	if (fifo_on){                       // new timestamps, so a binary frame never mixes settings
+		adxl_fifo_enable(0);
+		adxl_fifo_enable(1);
+	}
+}
+
+void set_task_period(void (*run)(void), uint32 ms){
+	uint8 i;
+	for (i = 0; i < ARRAY_SIZE(tasks); i++)
+		if (tasks[i].run == run){
+			tasks[i].period = ms;
+			tasks[i].due = sys_ticks + ms;
+		}
+}
+
+uint8 cmd_odr(char *arg){             // 12, 25, 50, 100, 200 or 400 Hz, codes 0 to 5 are 12.5 Hz doubling
+	uint32 hz = strtoul(arg, NULL, 10);
+	uint8 code;
+	for (code = 0; code <= 5; code++){
+		if (hz == ((25u << code) >> 1) || (code == 0 && hz == 13)){
+			adxl_filter = (adxl_filter & ~0x07) | code;
+			acq_restart();
+			return 1;
 		}
 	}
-	pt2GPIO->LED = LED_value; // Write value to LED
+	return 0;
+}
+
+uint8 cmd_range(char *arg){           // 2, 4 or 8 G
+	uint32 g = strtoul(arg, NULL, 10);
+	if (g != 2 && g != 4 && g != 8) return 0;
+	acc_range = g;
+	acc8_scale = ACC8_MG_SCALE * acc_range / ACC_RANGE_G;
+	acc12_scale = ACC12_MG_SCALE * acc_range / ACC_RANGE_G;
+	adxl_filter = (adxl_filter & 0x3F) | ((acc_range >> 2) << 6);
+	acq_restart();
+	impact_thresholds();
+	return 1;
+}
+
+uint8 cmd_axes(char *arg){            // any of x, y and z, e.g. "axes xz"
+	uint8 mask = 0;
+	for (; *arg; arg++){
+		if (*arg >= 'x' && *arg <= 'z') mask |= 1 << (*arg - 'x');
+		else return 0;
+	}
+	if (!mask) return 0;
+	report_axes = mask;
+	return 1;
+}
+
+uint8 cmd_interval(char *arg){        // acquisition and report period in ms
+	uint32 ms = strtoul(arg, NULL, 10);
+	if (ms < 1 || ms > 60000) return 0;
+	set_task_period(task_acquire, ms);
+	set_task_period(task_report, ms);
+	return 1;
+}
+
+uint8 cmd_format(char *arg){
+	if (!strcmp(arg, "text")) report_binary = 0;
+	else if (!strcmp(arg, "binary")) report_binary = 1;
+	else return 0;
+	return 1;
+}
+
+uint8 cmd_tx(char *arg){              // what printf and telemetry do when TxBuf is full
+	if (!strcmp(arg, "drop")) tx_policy = TX_POLICY_DROP;
+	else if (!strcmp(arg, "block")) tx_policy = TX_POLICY_BLOCK;
+	else return 0;
+	return 1;
+}
+
+uint8 log2_exact(uint32 n){           // 0xFF if n is not a power of 2
+	uint8 k;
+	for (k = 0; k < 32; k++)
+		if (n == (1ul << k)) return k;
+	return 0xFF;
+}
+
+uint8 cmd_filter(char *arg){          // filter type and length, e.g. "filter iir 16"
+	char *len;
+	uint8 type, k;
+	for (len = arg; *len && *len != ' '; len++);
+	if (*len) *len++ = 0;
+	for (type = 0; type < ARRAY_SIZE(filter_names); type++)
+		if (!strcmp(arg, filter_names[type])) break;
+	if (type == ARRAY_SIZE(filter_names)) return 0;
+	k = (type == FILT_NONE) ? 0 : log2_exact(strtoul(len, NULL, 10));
+	if (k > filter_max_shift[type]) return 0;
+	telem_flush();                      // output timestamps change scale
+	filt_type = type;
+	filt_shift = k;
+	filter_reset();
+	return 1;
+}
+
+uint8 cmd_decimate(char *arg){        // one output for every n from the filter
+	uint8 k = log2_exact(strtoul(arg, NULL, 10));
+	if (k > FILT_DECIM_MAX_SHIFT) return 0;
+	telem_flush();
+	filt_decim = k;
+	filter_reset();
+	return 1;
+}
+
+volatile int32 bench_sink;            // keeps the divides in cmd_bench from being optimised away
+
+uint8 cmd_bench(char *arg){           // Cycles per sample for each filter, none shows the loop and call overhead
+	uint8 type_was = filt_type, shift_was = filt_shift, decim_was = filt_decim;
+	uint8 k = *arg ? log2_exact(strtoul(arg, NULL, 10)) : 4;
+	volatile int32 div = 1 << k;        // volatile, so the compiler cannot turn the divide into a shift
+	uint32 t0, i;
+	int16 xyz[3];
+	int32 q[3];
+	if (k > 8) return 0;
+	filt_shift = k;
+	filt_decim = 0;
+	for (filt_type = FILT_NONE; filt_type < ARRAY_SIZE(filter_names); filt_type++){
+		if (k > filter_max_shift[filt_type] && filt_type != FILT_NONE) continue;
+		filter_reset();
+		filt_next = 0;
+		__disable_irq();                  // interrupts would be counted in the results
+		t0 = pt2PerfMon->Now;
+		for (i = 0; i < FILT_BENCH_N; i++){
+			xyz[0] = (int16)((i * 73) & 0x7FF) - 1024;
+			xyz[1] = xyz[0] >> 1;
+			xyz[2] = -xyz[0];
+			filter_run(xyz, i, q);
+		}
+		t0 = pt2PerfMon->Now - t0;
+		__enable_irq();
+		printf("%s %u: %u cycles per sample\n\r", filter_names[filt_type], 1 << k, t0 >> FILT_BENCH_SHIFT);
+	}
+	filt_acc[0] = filt_acc[1] = filt_acc[2] = 0;
+	__disable_irq();                    // running sums divided by a variable, what an average of any length costs
+	t0 = pt2PerfMon->Now;
+	for (i = 0; i < FILT_BENCH_N; i++){
+		xyz[0] = (int16)((i * 73) & 0x7FF) - 1024;
+		xyz[1] = xyz[0] >> 1;
+		xyz[2] = -xyz[0];
+		filt_acc[0] += xyz[0];
+		filt_acc[1] += xyz[1];
+		filt_acc[2] += xyz[2];
+		bench_sink = filt_acc[0] / div + filt_acc[1] / div + filt_acc[2] / div;
+	}
+	t0 = pt2PerfMon->Now - t0;
+	__enable_irq();
+	printf("divide by %u: %u cycles per sample\n\r", 1 << k, t0 >> FILT_BENCH_SHIFT);
+	filt_type = type_was;
+	filt_shift = shift_was;
+	filt_decim = decim_was;
+	filter_reset();
+	return 1;
+}
+
+uint8 cmd_stats(char *arg){
+	uint32 odr_x10 = 125 << (adxl_filter & 0x07);
+	(void)arg;
+	printf("odr %u.%u Hz, range %uG, axes %c%c%c, interval %u ms, format %s, tx %s\n\r",
+		odr_x10 / 10, odr_x10 % 10, acc_range, (report_axes & 1) ? 'x' : '-', (report_axes & 2) ? 'y' : '-',
+		(report_axes & 4) ? 'z' : '-', tasks[0].period, report_binary ? "binary" : "text",
+		tx_policy == TX_POLICY_BLOCK ? "block" : "drop");
+	printf("filter %s %u, decimate %u\n\r", filter_names[filt_type], 1 << filt_shift, 1 << filt_decim);
+	printf("samples lost %u, tx dropped %u blocked %u, frames %u dropped %u, commands lost %u, impacts %u lost %u\n\r",
+		sample_lost, tx_dropped, tx_blocked, telem_seq, telem_dropped, cmd_lost, pt2Impact->Count, impact_lost);
+	task_stats();                       // scheduler figures, starts a new window
+	return 1;
+}
+
+uint8 cmd_help(char *arg);
+
+const command_t commands[] = {
+	{"odr",      cmd_odr,      "odr 12|25|50|100|200|400  - sensor output data rate, Hz"},
+	{"range",    cmd_range,    "range 2|4|8               - sensor range, G"},
+	{"axes",     cmd_axes,     "axes xyz                  - axes in text reports, any of x, y, z"},
+	{"interval", cmd_interval, "interval ms               - acquisition and report period"},
+	{"format",   cmd_format,   "format text|binary        - FIFO mode output, binary frames for host/telemetry_decode"},
+	{"tx",       cmd_tx,       "tx drop|block             - when the UART cannot keep up"},
+	{"filter",   cmd_filter,   "filter none|avg|iir|box|cic n - filter for burst and FIFO samples, n a power of 2"},
+	{"decimate", cmd_decimate, "decimate n                - one output for every n from the filter, 1 to 64"},
+	{"bench",    cmd_bench,    "bench [n]                 - cycles per sample for each filter of length n, default 16"},
+	{"stats",    cmd_stats,    "stats                     - settings, lost data, scheduler timing and bus use"},
+	{"help",     cmd_help,     "help                      - this list"},
+};
+
+uint8 cmd_help(char *arg){
+	uint8 i;
+	(void)arg;
+	for (i = 0; i < ARRAY_SIZE(commands); i++)
+		printf("%s\n\r", commands[i].help);
+	return 1;
+}
+
+void run_command(char *line){
+	char *name, *arg;
+	uint8 i;
+	for (name = line; *name == ' '; name++);
+	for (arg = name; *arg && *arg != ' '; arg++);
+	if (*arg) *arg++ = 0;
+	while (*arg == ' ') arg++;
+	printf("\n\r");
+	if (!*name) return;
+	for (i = 0; i < ARRAY_SIZE(commands); i++){
+		if (!strcmp(name, commands[i].name)){
+			if (!commands[i].run(arg)) printf("usage: %s\n\r", commands[i].help);
+			return;
+		}
+	}
+	printf("unknown command %s, try help\n\r", name);
+}
+
+void task_command(){                  // Runs the sentences UART_ISR has put in CmdBuf
+	static uint32 lost_reported = 0;
+	char line[BUF_SIZE];
+	uint8 i;
+	if (cmd_lost != lost_reported){     // typed faster than they could be run, say so rather than drop them silently
+		lost_reported = cmd_lost;
+		tx_reply = 1;
+		printf("command buffer full, %u commands lost\n\r", lost_reported);
+		tx_reply = 0;
+	}
+	while (BufReady){
+		for (i = 0; i < BUF_SIZE-1 && CmdBuf[cmd_tail][i]; i++){
+			char c = CmdBuf[cmd_tail][i];
+			line[i] = (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+		}
+		line[i] = 0;
+		__disable_irq();                  // UART_ISR may be adding the next one
+		cmd_tail = (cmd_tail + 1) & (CMD_QUEUE-1);
+		if (cmd_tail == cmd_head) BufReady = 0;
+		__enable_irq();
+		tx_reply = 1;                     // replies are never dropped, acquisition waits instead
+		run_command(line);
+		tx_reply = 0;
+	}
 }
 
 //////////////////////////////////////////////////////////////////
 // Main Function
 //////////////////////////////////////////////////////////////////
 int main(void) {
-	uint32 long_delay = 2000000;
-	int8 acc_val;
-	uint8 reg0_data;
-	int32 scaled_acc;
-	uint8 count = 0;
-	pt2UART->Control = (1 << UART_RX_FIFO_EMPTY_BIT_INT_POS);		// Enable rx data available interrupt, and no others.
-	pt2NVIC->Enable	 = (1 << NVIC_UART_BIT_POS);								// Enable interrupts for UART in the NVIC
+	pt2UART->Control = UART_RX_INT;		// Enable rx data available interrupt, transmit is fed by the DMA
+	uart_dma_init();
+	pt2NVIC->Enable	 = (1 << NVIC_UART_BIT_POS) | (1 << NVIC_SPI_BIT_POS) | (1 << NVIC_IMPACT_BIT_POS) | (1 << NVIC_DMA_BIT_POS);		// Enable interrupts for UART, SPI, impact detector and DMA in the NVIC
+	spi_init();                                                       // SPI master set up for the ADXL362
 	wait_n_loops(nLOOPS_per_DELAY);										// wait a little
 	printf("\r\nWelcome to to the Acceleration measurement program\r\n");			  // output welcome message in terminal followed by instructions
 	printf("Press the rightmost switch only to measure on the Y-axis\r\n");
 	printf("Press the 2nd rightmost switch only to measure on the X-axis\r\n");
 	printf("Press the 3rd rightmost switch only to measure on the Z-axis\r\n");
+	printf("Switch 3 reads all axes in one burst, switch 4 at 12-bit resolution, switch 5 streams through the sensor FIFO\r\n");
+	printf("Switch 6 sends the FIFO stream as binary frames, decode with host/telemetry_decode\r\n");
+	printf("Burst and FIFO samples can be filtered and decimated, see the filter and decimate commands\r\n");
+	printf("Type help for the commands that change the sensor and report settings\r\n");
 	printf("Press the leftmost switch to continue\r\n");                        
 	while ((pt2GPIO->Switches&0x8000) != 0x8000){                               // Holds messages on screen and waits for user input
 	}
 	accel_setup();                                  // Configures ADXL362
-	while(1){			                                  // loop forever]
-			uint8 y_data_add = 0x09;                    // Addresses for all 8-bit data register for each axis
-			uint8 x_data_add = 0X08;
-			uint8 z_data_add = 0X0A;
-			pt2GPIO->acc_out = cs_low;                  //cs set to 0 to begin data transfer
-			bit_gen(read_data);                         // Tells ADXL362 that data will be read
-			//bit_gen(deviceID_reg1);                   // Used to test SPI and confirm that the data was correct as these register's data were known
-			//reg1_data = byte_gen();
-		  if((pt2GPIO->Switches&0x01) == 0x01){       // Allows user to chose axis on which acceleration will be read
-			bit_gen(y_data_add); }
-			if((pt2GPIO->Switches&0x02) == 0x02){ 
-			bit_gen(x_data_add); } 
-			if((pt2GPIO->Switches&0x04) == 0x04){ 
-			bit_gen(z_data_add); } 
-		  acc_val = (int8)byte_gen();                 // Reads acceleration byte
-			pt2GPIO->acc_out = cs_high;                 //cs iniliased as high after data is read
-			
-		  //printf("acc_val: %d\n\r",acc_val);
-			//printf("Device ID: %d\n\r",reg0_data);
-			scaled_acc = convert_acc_value(acc_val);      // Data scaled to mG, uint32 bit used as data would later be shifted when put onto the display
-			printf("acc_val: %d mG\n\r",scaled_acc);      // Shows the acceleration data in mG in the terminal
-			set_display(scaled_acc);                      // Sent to the display
-			set_LED(acc_val);															// Set LED based on acceleration value
-		if (acc_val == 127 | acc_val == -127){
-				count++;
-				printf("High impact detected\n");
-				printf("Number of impacts detected: %d\n\r", count);
-				wait_n_loops(long_delay);
-				wait_n_loops(long_delay);
-				wait_n_loops(long_delay);
-			}
-			wait_n_loops(long_delay);
-			//wait_n_loops(long_delay);
-			
-			// ---- end of critical section ----		
-			
-			pt2NVIC->Enable	 = (1 << NVIC_UART_BIT_POS);		// Enable interrupts for UART in the NVIC
-
-		} // end of infinite loop
-
+	impact_init();                                  // Thresholds for the hardware impact detector
+	display_init();                                 // Units and decimal field
+	scheduler_init();                               // Start the tick
+	scheduler_run();                                // Run tasks forever, sleeping in between
+	return 0;                                       // not reached
 }  // end of main
 
-
@@ -0,0 +1,562 @@
+`timescale 1ns / 1ns
+//////////////////////////////////////////////////////////////////////////////////
+// Company: UCD School of Electrical and Electronic Engineering
+// Engineer: Aidan O'Sullivan
+//
+// Create Date:     April 2021
+// Design Name:     Cortex-M0 DesignStart system
+// Module Name:     AHBdma_tb
+// Description: 	Self-checking testbench for AHBdma and AHBarbiter, wired
+//                  as in AHBliteTop.  The processor is a pipelined master
+//                  model that only looks at its HREADY, as the Cortex-M0
+//                  does.  The bus has RAM at 0x20000000 and a slow UART-like
+//                  peripheral at 0x51000000 with two wait states on every
+//                  transfer and a status flag that stays set for a while.
+//                  Checks:
+//		- processor and DMA asking for the same address phase, and
+//		  processor reads and writes held while the DMA owns the bus,
+//		  all complete once with the right data
+//		- the address phase on the bus stays put while HREADY is low
+//		- a word copy in RAM, alongside processor traffic
+//		- byte transfers put the byte on every lane, from any alignment
+//		- halfword transfers to RAM land on the right lanes
+//		- reads from a slave with wait states take the data when it is ready
+//		- paced polling: no write while the flags do not match, and
+//		  POLL_WAIT cycles between polls that fail
+//		- done flags, interrupt and clearing them
+//		Each failure is printed, then a pass/fail summary.
+//
+//		Run from the "System On Chip" directory:
+//			iverilog -g2012 -o dma_tb tb/AHBdma_tb.v AHBdma.v && vvp dma_tb
+//
+//////////////////////////////////////////////////////////////////////////////////
+module AHBdma_tb;
+
+	localparam POLL_WAIT = 20;			// cycles, much shorter than the system's
+	localparam SLOW_WAIT = 2;			// wait states on every slow peripheral transfer
+	localparam BYTE_CYCLES = 50;		// slow peripheral busy after each byte written
+
+	// Addresses, as in DES_M0_SoC.h
+	localparam [31:0] RAM = 32'h20000000, DMA = 32'h56000000, DMA_STATUS = 32'h56000040,
+					  SLOW_DATA = 32'h51000000, SLOW_STATUS = 32'h51000004, SLOW_SCRATCH = 32'h51000008;
+	// Channel registers, offsets from the channel base, and control bits
+	localparam [31:0] SRC = 32'h00, DST = 32'h04, COUNT = 32'h08, CTRL = 32'h0C, POLL = 32'h10, MATCH = 32'h14;
+	localparam [31:0] EN = 32'h01, SRC_INC = 32'h02, DST_INC = 32'h04, BYTE = 32'h00, HALF = 32'h10,
+					  WORD = 32'h20, PACED = 32'h40, INT_EN = 32'h80;
+
+	reg HCLK, HRESETn;
+	integer errors;
+
+	// Processor side of the arbiter
+	reg [31:0] cHADDR, cHWDATA;
+	reg [1:0] cHTRANS;
+	reg cHWRITE;
+	wire [2:0] cHSIZE = 3'b010;			// word transfers only
+	wire cHREADY;
+
+	// DMA master port
+	wire dReq, dGrant, dHWRITE;
+	wire [31:0] dHADDR, dHWDATA;
+	wire [1:0] dHTRANS;
+	wire [2:0] dHSIZE;
+
+	// Shared bus
+	wire [31:0] HADDR, HWDATA, HRDATA;
+	wire [1:0] HTRANS;
+	wire [2:0] HSIZE;
+	wire HWRITE, HREADY;
+	wire [31:0] dmaRData;
+	wire dmaReady, dma_IRQ;
+
+	AHBdma #(.POLL_WAIT(POLL_WAIT)) dut (
+			.HCLK      (HCLK),
+			.HRESETn   (HRESETn),
+			.HSEL      (HADDR[31:24] == 8'h56),
+			.HREADY    (HREADY),
+			.HADDR     (HADDR),
+			.HTRANS    (HTRANS),
+			.HWRITE    (HWRITE),
+			.HWDATA    (HWDATA),
+			.HRDATA    (dmaRData),
+			.HREADYOUT (dmaReady),
+			.mReq      (dReq),
+			.mGrant    (dGrant),
+			.mHADDR    (dHADDR),
+			.mHTRANS   (dHTRANS),
+			.mHWRITE   (dHWRITE),
+			.mHSIZE    (dHSIZE),
+			.mHWDATA   (dHWDATA),
+			.mHRDATA   (HRDATA),
+			.dma_IRQ   (dma_IRQ)
+			);
+
+	AHBarbiter arb (
+			.HCLK    (HCLK),
+			.HRESETn (HRESETn),
+			.cHADDR  (cHADDR),
+			.cHTRANS (cHTRANS),
+			.cHWRITE (cHWRITE),
+			.cHSIZE  (cHSIZE),
+			.cHWDATA (cHWDATA),
+			.cHREADY (cHREADY),
+			.dReq    (dReq),
+			.dGrant  (dGrant),
+			.dHADDR  (dHADDR),
+			.dHTRANS (dHTRANS),
+			.dHWRITE (dHWRITE),
+			.dHSIZE  (dHSIZE),
+			.dHWDATA (dHWDATA),
+			.HADDR   (HADDR),
+			.HTRANS  (HTRANS),
+			.HWRITE  (HWRITE),
+			.HSIZE   (HSIZE),
+			.HWDATA  (HWDATA),
+			.HREADY  (HREADY)
+			);
+
+	// 50 MHz bus clock
+	initial HCLK = 1'b0;
+	always #10 HCLK = ~HCLK;
+
+	integer cycle;
+	initial cycle = 0;
+	always @ (posedge HCLK) cycle <= cycle + 1;
+
+//================================  Bus Multiplexer ===============================
+
+	// Slave in the data phase: 0 RAM (or nothing), 1 slow peripheral, 2 DMA
+	reg [1:0] dataSlave;
+	wire [31:0] ramRData, slowRData;
+	wire slowReady;
+
+	always @ (posedge HCLK)
+		if (!HRESETn) dataSlave <= 2'd0;
+		else if (HREADY)
+			dataSlave <= !HTRANS[1] ? 2'd0 : (HADDR[31:24] == 8'h51) ? 2'd1 : (HADDR[31:24] == 8'h56) ? 2'd2 : 2'd0;
+
+	assign HREADY = (dataSlave == 2'd1) ? slowReady : (dataSlave == 2'd2) ? dmaReady : 1'b1;
+	assign HRDATA = (dataSlave == 2'd1) ? slowRData : (dataSlave == 2'd2) ? dmaRData : ramRData;
+
+//================================  RAM ===============================
+	// 4 KB, byte lanes written as HSIZE and the low address bits say, always ready
+
+	reg [31:0] ram [0:1023];
+	reg [7:0]  ramWrites [0:1023];		// writes to each word, to catch dropped or doubled writes
+	reg        ramSel, ramWrite;
+	reg [11:0] ramAddr;
+	reg [1:0]  ramSize;
+
+	always @ (posedge HCLK)
+		if (!HRESETn) ramSel <= 1'b0;
+		else if (HREADY)
+			begin
+				ramSel   <= HTRANS[1] & (HADDR[31:24] == 8'h20);
+				ramWrite <= HWRITE;
+				ramAddr  <= HADDR[11:0];
+				ramSize  <= HSIZE[1:0];
+			end
+
+	always @ (posedge HCLK)
+		if (ramSel & ramWrite)
+			begin
+				case ({ramSize, ramAddr[1:0]})
+					4'b0000: ram[ramAddr[11:2]][7:0]   <= HWDATA[7:0];
+					4'b0001: ram[ramAddr[11:2]][15:8]  <= HWDATA[15:8];
+					4'b0010: ram[ramAddr[11:2]][23:16] <= HWDATA[23:16];
+					4'b0011: ram[ramAddr[11:2]][31:24] <= HWDATA[31:24];
+					4'b0100: ram[ramAddr[11:2]][15:0]  <= HWDATA[15:0];
+					4'b0110: ram[ramAddr[11:2]][31:16] <= HWDATA[31:16];
+					default: ram[ramAddr[11:2]]        <= HWDATA;
+				endcase
+				ramWrites[ramAddr[11:2]] <= ramWrites[ramAddr[11:2]] + 1'b1;
+			end
+
+	assign ramRData = ram[ramAddr[11:2]];
+
+//================================  Slow Peripheral ===============================
+	// Like the UART: data register, status with a full flag in bit 0, and a
+	// scratch register.  Full from reset until slowRelease, then for
+	// BYTE_CYCLES after each byte written.  The DMA's transfers are told
+	// apart by dGrant in their address phase.
+
+	reg        slowSel, slowWrite, slowDma;
+	reg [3:0]  slowReg;
+	reg [1:0]  slowWait;
+	reg [31:0] slowScratch;
+	reg        full, slowRelease;
+	integer    busyCount;
+	reg [31:0] slowLog [0:31];			// HWDATA of each data register write
+	reg        slowLogDma [0:31];
+	integer    slowCount;
+
+	// Polls by the DMA
+	integer polls, failedPolls, lastPoll, lastFailed;
+
+	always @ (posedge HCLK)
+		if (!HRESETn)
+			begin
+				slowSel  <= 1'b0;
+				slowWait <= 2'd0;
+			end
+		else if (HREADY)
+			begin
+				slowSel   <= HTRANS[1] & (HADDR[31:24] == 8'h51);
+				slowWrite <= HWRITE;
+				slowReg   <= HADDR[3:0];
+				slowDma   <= dGrant;
+				slowWait  <= SLOW_WAIT;
+			end
+		else if (slowWait != 2'd0)
+			slowWait <= slowWait - 1'b1;
+
+	assign slowReady = (slowWait == 2'd0);
+	assign slowRData = !slowSel ? 32'h0 : !slowReady ? 32'hBAD0BAD0 :	// junk until ready, and not full
+					   (slowReg == 4'h4) ? {31'b0, full} : (slowReg == 4'h8) ? slowScratch : 32'h0;
+
+	always @ (posedge HCLK)
+		if (!HRESETn)
+			begin
+				full        <= 1'b1;
+				busyCount   <= 0;
+				slowCount   <= 0;
+				slowScratch <= 32'h0;
+			end
+		else
+			begin
+				if (slowSel & slowReady & slowWrite & (slowReg == 4'h0))
+					begin
+						if (full)
+							begin
+								$display("%0t: FAIL: data written while the peripheral is full", $time);
+								errors = errors + 1;
+							end
+						slowLog[slowCount]    <= HWDATA;
+						slowLogDma[slowCount] <= slowDma;
+						slowCount <= slowCount + 1;
+						full      <= 1'b1;
+						busyCount <= BYTE_CYCLES;
+					end
+				else if (busyCount != 0)
+					busyCount <= busyCount - 1;
+				else if (slowRelease)
+					full <= 1'b0;
+				if (slowSel & slowReady & slowWrite & (slowReg == 4'h8))
+					slowScratch <= HWDATA;
+			end
+
+	always @ (posedge HCLK)
+		if (slowSel & slowReady & !slowWrite & (slowReg == 4'h4) & slowDma)
+			begin
+				if (lastFailed && cycle - lastPoll < POLL_WAIT)
+					begin
+						$display("%0t: FAIL: polled again after %0d cycles", $time, cycle - lastPoll);
+						errors = errors + 1;
+					end
+				polls      = polls + 1;
+				failedPolls = failedPolls + full;
+				lastPoll   = cycle;
+				lastFailed = full;
+			end
+
+//================================  Processor Model ===============================
+	// Pipelined master running the ops in order: the next address phase is
+	// presented during the data phase of the last, and both move on only
+	// when cHREADY is high.  Reads are checked against the expected data.
+
+	localparam [1:0] NOP = 2'd0, WR = 2'd1, RD = 2'd2;
+	reg [1:0]  opKind [0:511];
+	reg [31:0] opAddr [0:511];
+	reg [31:0] opData [0:511];			// write data, or expected read data
+	integer opCount;					// ops added by the test sequence
+	integer opNext;						// next op to present
+	integer aOp, dOp;					// ops in the address and data phases, -1 for none
+
+	always @ (posedge HCLK)
+		if (!HRESETn)
+			begin
+				opNext  <= 0;
+				aOp     <= -1;
+				dOp     <= -1;
+				cHADDR  <= 32'h0;
+				cHTRANS <= 2'b00;
+				cHWRITE <= 1'b0;
+				cHWDATA <= 32'h0;
+			end
+		else if (cHREADY)
+			begin
+				if (dOp >= 0 && opKind[dOp] == RD && HRDATA !== opData[dOp])
+					begin
+						$display("%0t: FAIL: read %h from %h, expected %h", $time, HRDATA, opAddr[dOp], opData[dOp]);
+						errors = errors + 1;
+					end
+				dOp <= aOp;
+				if (aOp >= 0) cHWDATA <= opData[aOp];
+				if (opNext < opCount && opKind[opNext] != NOP)
+					begin
+						aOp     <= opNext;
+						cHADDR  <= opAddr[opNext];
+						cHWRITE <= (opKind[opNext] == WR);
+						cHTRANS <= 2'b10;
+					end
+				else
+					begin
+						aOp     <= -1;
+						cHTRANS <= 2'b00;
+						cHWRITE <= 1'b0;
+					end
+				if (opNext < opCount) opNext <= opNext + 1;
+			end
+
+	// Called between clock edges
+	task op;
+		input [1:0] kind;
+		input [31:0] addr;
+		input [31:0] data;
+		begin
+			opKind[opCount] = kind;
+			opAddr[opCount] = addr;
+			opData[opCount] = data;
+			opCount = opCount + 1;
+		end
+	endtask
+
+	task wait_ops;
+		begin
+			@ (posedge HCLK);
+			while (opNext < opCount || aOp >= 0 || dOp >= 0) @ (posedge HCLK);
+			@ (negedge HCLK);
+		end
+	endtask
+
+//================================  Monitors ===============================
+
+	// An address phase not taken must stay on the bus until it is
+	reg [31:0] lastAddr;
+	reg [1:0]  lastTrans;
+	reg        lastWrite, stalled;
+	initial stalled = 1'b0;
+	always @ (posedge HCLK)
+		begin
+			if (stalled && lastTrans[1] && (HADDR !== lastAddr || HTRANS !== lastTrans || HWRITE !== lastWrite))
+				begin
+					$display("%0t: FAIL: address phase changed while HREADY was low", $time);
+					errors = errors + 1;
+				end
+			stalled   <= !HREADY;
+			lastAddr  <= HADDR;
+			lastTrans <= HTRANS;
+			lastWrite <= HWRITE;
+		end
+
+	// Coverage: both asking for the same address phase, and processor transfers held for later
+	integer bothCpuOwns, bothDmaOwns, heldReads, heldWrites;
+	initial begin bothCpuOwns = 0; bothDmaOwns = 0; heldReads = 0; heldWrites = 0; end
+	always @ (posedge HCLK)
+		if (HRESETn)
+			begin
+				if (dReq && cHTRANS[1] && !dGrant) bothCpuOwns = bothCpuOwns + 1;
+				if (dReq && cHTRANS[1] && dGrant) bothDmaOwns = bothDmaOwns + 1;
+				if (dGrant && cHTRANS[1] && cHREADY)
+					if (cHWRITE) heldWrites = heldWrites + 1;
+					else heldReads = heldReads + 1;
+			end
+
+//================================  Test Sequence ===============================
+
+	task check;
+		input [31:0] got;
+		input [31:0] want;
+		input [8*48:1] what;
+		begin
+			if (got !== want)
+				begin
+					$display("%0t: FAIL: %0s: got %h, expected %h", $time, what, got, want);
+					errors = errors + 1;
+				end
+		end
+	endtask
+
+	task wait_irq;
+		integer n;
+		begin
+			n = 0;
+			while (!dma_IRQ && n < 5000)
+				begin
+					@ (posedge HCLK);
+					n = n + 1;
+				end
+			if (!dma_IRQ)
+				begin
+					$display("%0t: FAIL: no DMA interrupt", $time);
+					errors = errors + 1;
+				end
+			@ (negedge HCLK);
+		end
+	endtask
+
+	integer i, k;
+	reg [7:0] b;
+
+	initial
+		begin
+			errors = 0;
+			opCount = 0;
+			slowRelease = 1'b0;
+			polls = 0; failedPolls = 0; lastPoll = 0; lastFailed = 0;
+			for (i = 0; i < 1024; i = i + 1)
+				begin
+					ram[i] = 32'h0;
+					ramWrites[i] = 8'h0;
+				end
+			for (i = 0; i < 32; i = i + 1)		// copy source at 0x100
+				ram[64 + i] = 32'h01010101 * i ^ 32'hA5C3_0F96;
+			for (i = 0; i < 64; i = i + 1)		// bytes 0x40, 0x47, ... at 0x400
+				begin
+					b = 8'h40 + i * 7;
+					ram[256 + i/4] = ram[256 + i/4] | (b << (8 * (i % 4)));
+				end
+			for (i = 0; i < 8; i = i + 1)		// halfword source at 0x500
+				ram[320 + i] = 32'h1111_2222 * (i + 1);
+
+			HRESETn = 1'b0;
+			#50 HRESETn = 1'b1;
+			@ (negedge HCLK);
+			check(cHREADY, 1, "processor ready after reset");
+			check(dReq, 0, "no DMA request after reset");
+
+			// Word copy 0x100 to 0x200 on channel 1, the processor writing
+			// 0x300 and reading it back meanwhile, with some idle cycles and
+			// some transfers to the slow peripheral
+			op(WR, DMA + 32'h20 + SRC, RAM + 32'h100);
+			op(WR, DMA + 32'h20 + DST, RAM + 32'h200);
+			op(WR, DMA + 32'h20 + COUNT, 32);
+			op(WR, DMA + 32'h20 + CTRL, EN | SRC_INC | DST_INC | WORD | INT_EN);
+			for (i = 0; i < 40; i = i + 1)
+				begin
+					op(WR, RAM + 32'h300 + 4*i, 32'hC0DE_0000 + i);
+					if (i % 5 == 3) op(NOP, 0, 0);
+					if (i % 8 == 7) op(RD, RAM + 32'h300 + 4*i, 32'hC0DE_0000 + i);
+					if (i % 3 != 0)
+						begin
+							op(WR, SLOW_SCRATCH, 32'h5C00_0000 + i);
+							for (k = 0; k < i % 4; k = k + 1) op(NOP, 0, 0);
+							op(RD, SLOW_SCRATCH, 32'h5C00_0000 + i);
+							op(NOP, 0, 0);
+						end
+				end
+			for (i = 0; i < 40; i = i + 1)
+				op(RD, RAM + 32'h300 + 4*i, 32'hC0DE_0000 + i);
+			wait_ops;
+			wait_irq;
+			op(RD, DMA_STATUS, 32'h02);
+			op(RD, DMA + 32'h20 + COUNT, 0);
+			op(RD, DMA + 32'h20 + SRC, RAM + 32'h180);
+			op(WR, DMA_STATUS, 32'h02);
+			op(RD, DMA_STATUS, 32'h00);
+			wait_ops;
+			check(dma_IRQ, 0, "interrupt cleared");
+			for (i = 0; i < 32; i = i + 1)
+				begin
+					check(ram[128 + i], ram[64 + i], "word copy");
+					check(ramWrites[128 + i], 1, "word copy writes");
+				end
+			for (i = 0; i < 40; i = i + 1)
+				check(ramWrites[192 + i], 1, "processor writes");
+
+			// Channel 0 paced, bytes from 0x401 to the slow peripheral, while
+			// channel 1 moves halfwords 0x502 to 0x602 and the processor uses
+			// the scratch register and RAM.  The peripheral stays full for a
+			// while first, so the channel polls and waits.
+			op(WR, DMA + SRC, RAM + 32'h401);
+			op(WR, DMA + DST, SLOW_DATA);
+			op(WR, DMA + COUNT, 12);
+			op(WR, DMA + POLL, SLOW_STATUS);
+			op(WR, DMA + MATCH, 32'h0001);
+			op(WR, DMA + CTRL, EN | SRC_INC | BYTE | PACED | INT_EN);
+			op(WR, DMA + 32'h20 + SRC, RAM + 32'h502);
+			op(WR, DMA + 32'h20 + DST, RAM + 32'h602);
+			op(WR, DMA + 32'h20 + COUNT, 6);
+			op(WR, DMA + 32'h20 + CTRL, EN | SRC_INC | DST_INC | HALF);
+			for (i = 0; i < 24; i = i + 1)
+				begin
+					op(WR, SLOW_SCRATCH, 32'h5C00_0000 + i);
+					op(RD, SLOW_SCRATCH, 32'h5C00_0000 + i);
+					if (i % 2 == 0) op(NOP, 0, 0);
+					op(WR, RAM + 32'h700 + 4*i, 32'h7E57_0000 + i);
+					if (i % 3 == 1) op(NOP, 0, 0);
+					op(RD, RAM + 32'h700 + 4*i, 32'h7E57_0000 + i);
+				end
+			wait_ops;
+			for (i = 0; i < 6 * POLL_WAIT; i = i + 1) @ (negedge HCLK);
+			check(slowCount, 0, "nothing written while full");
+			k = failedPolls;
+			slowRelease = 1'b1;
+			wait_irq;
+			for (i = 0; i < 40; i = i + 1) @ (negedge HCLK);
+			op(RD, DMA_STATUS, 32'h03);
+			op(WR, DMA_STATUS, 32'h03);
+			op(RD, DMA_STATUS, 32'h00);
+			wait_ops;
+
+			check(slowCount, 12, "bytes written to the peripheral");
+			for (i = 0; i < 12; i = i + 1)
+				begin
+					b = 8'h40 + (i + 1) * 7;
+					check(slowLog[i], {4{b}}, "byte on every lane");
+					check(slowLogDma[i], 1, "byte written by the DMA");
+				end
+			if (k < 4)
+				begin
+					$display("FAIL: only %0d polls while the peripheral was held full", k);
+					errors = errors + 1;
+				end
+			if (failedPolls <= k)
+				begin
+					$display("FAIL: no polls waiting between bytes");
+					errors = errors + 1;
+				end
+			// six halfwords from 0x502 to 0x602, so the middle two words match the source
+			check(ram[384], {ram[320][31:16], 16'h0}, "halfword copy, upper lane");
+			check(ram[385], ram[321], "halfword copy");
+			check(ram[386], ram[322], "halfword copy");
+			check(ram[387], {16'h0, ram[323][15:0]}, "halfword copy, lower lane");
+			check(ram[388], 0, "halfword copy, past the end");
+			check(ramWrites[384] + ramWrites[385] + ramWrites[386] + ramWrites[387], 6, "halfword copy writes");
+			for (i = 0; i < 24; i = i + 1)
+				check(ramWrites[448 + i], 1, "processor writes");
+
+			// Words from the slow peripheral, which keeps the read data phase waiting
+			op(WR, SLOW_SCRATCH, 32'h600D_F00D);
+			op(WR, DMA + 32'h20 + SRC, SLOW_SCRATCH);
+			op(WR, DMA + 32'h20 + DST, RAM + 32'h800);
+			op(WR, DMA + 32'h20 + COUNT, 2);
+			op(WR, DMA + 32'h20 + CTRL, DST_INC | WORD | INT_EN | EN);
+			wait_ops;
+			wait_irq;
+			op(WR, DMA_STATUS, 32'h02);
+			op(RD, DMA_STATUS, 32'h00);
+			wait_ops;
+			check(ram[512], 32'h600D_F00D, "word from the slow peripheral");
+			check(ram[513], 32'h600D_F00D, "word from the slow peripheral");
+
+			// Coverage
+			$display("polls %0d (%0d failed), both requesting %0d + %0d, held reads %0d, held writes %0d",
+					polls, failedPolls, bothCpuOwns, bothDmaOwns, heldReads, heldWrites);
+			if (bothCpuOwns == 0 || bothDmaOwns == 0 || heldReads == 0 || heldWrites == 0)
+				begin
+					$display("FAIL: contention not covered");
+					errors = errors + 1;
+				end
+
+			if (errors == 0) $display("PASS");
+			else $display("FAIL: %0d errors", errors);
+			$finish;
+		end
+
+	initial
+		begin
+			#2000000 $display("FAIL: timeout");
+			$finish;
+		end
+
+endmodule
@@ -0,0 +1,379 @@
+`timescale 1ns / 1ns
+//////////////////////////////////////////////////////////////////////////////////
+// Company: UCD School of Electrical and Electronic Engineering
+// Engineer: Aidan O'Sullivan
+//
+// Create Date:     April 2021
+// Design Name:     Cortex-M0 DesignStart system
+// Module Name:     AHBspi_tb
+// Description: 	Self-checking testbench for AHBspi, with a behavioural
+//                  ADXL362 on the SPI pins.  Checks:
+//		- an 8 byte burst read of the 12-bit data registers takes only the
+//		  frame write and the transmit data writes, with chip select low
+//		  for the whole frame and released after the last byte
+//		- chip select held half an SCK period after the last falling
+//		  edge, at least the ADXL362's 20 ns tCSH
+//		- the data read back, and a register write through a frame
+//		- SCK half period is clock divider + 1 cycles
+//		- transmit FIFO full while a long frame is queued
+//		- done flag and its interrupt, cleared by writing the status
+//		- receive overrun when a frame overfills the receive FIFO
+//		Each failure is printed, then a pass/fail summary.
+//
+//		Run from the "System On Chip" directory:
+//			iverilog -g2012 -o spi_tb tb/AHBspi_tb.v AHBspi.v && vvp spi_tb
+//
+//////////////////////////////////////////////////////////////////////////////////
+module AHBspi_tb;
+
+	// Register addresses and status bits, as in DES_M0_SoC.h
+	localparam [31:0] RXD = 32'h53000000, TXD = 32'h53000004, STAT = 32'h53000008, CTRL = 32'h5300000C,
+					  CDIV = 32'h53000010, CSEL = 32'h53000014, FRAME = 32'h53000018;
+	localparam TX_FULL = 0, TX_EMPTY = 1, RX_FULL = 2, RX_AVAIL = 3, BUSY = 4, DONE = 5, OVERRUN = 6;
+
+	reg HCLK, HRESETn, HSEL, HWRITE;
+	reg [31:0] HADDR, HWDATA;
+	reg [1:0] HTRANS;
+	wire [31:0] HRDATA;
+	wire HREADYOUT;
+	wire spiMISO, spiMOSI, spiSCK, spiSSn, spi_IRQ;
+	wire monValid;
+	wire [7:0] monTx, monRx;
+
+	AHBspi dut (
+			.HCLK      (HCLK),
+			.HRESETn   (HRESETn),
+			.HSEL      (HSEL),
+			.HREADY    (HREADYOUT),		// only slave on the bus
+			.HADDR     (HADDR),
+			.HTRANS    (HTRANS),
+			.HWRITE    (HWRITE),
+			.HWDATA    (HWDATA),
+			.HRDATA    (HRDATA),
+			.HREADYOUT (HREADYOUT),
+			.spiMISO   (spiMISO),
+			.spiMOSI   (spiMOSI),
+			.spiSCK    (spiSCK),
+			.spiSSn    (spiSSn),
+			.spi_IRQ   (spi_IRQ),
+			.monValid  (monValid),
+			.monTx     (monTx),
+			.monRx     (monRx)
+			);
+
+	adxl362_model sensor (
+			.SCLK (spiSCK),
+			.CSn  (spiSSn),
+			.MOSI (spiMOSI),
+			.MISO (spiMISO)
+			);
+
+	// 50 MHz bus clock
+	initial HCLK = 1'b0;
+	always #10 HCLK = ~HCLK;
+
+//================================  Monitors ===============================
+
+	// Chip select periods, and the SCK rising edges in the last one
+	integer csFrames, sckEdges, frameEdges;
+	initial begin csFrames = 0; sckEdges = 0; frameEdges = 0; end
+	always @ (negedge spiSSn) sckEdges = 0;
+	always @ (posedge spiSCK) if (!spiSSn) sckEdges = sckEdges + 1;
+	always @ (posedge spiSSn)
+		begin
+			csFrames = csFrames + 1;
+			frameEdges = sckEdges;
+		end
+
+	// Chip select hold, from the last SCK falling edge to chip select rising
+	integer lastFall, csHoldTime;
+	initial begin lastFall = 0; csHoldTime = 0; end
+	always @ (negedge spiSCK) if (!spiSSn) lastFall = $time;
+	always @ (posedge spiSSn) csHoldTime = $time - lastFall;
+
+	// Shortest time between SCK rising edges, the period within a byte
+	integer lastRise, minPeriod;
+	initial begin lastRise = 0; minPeriod = 1000000; end
+	always @ (posedge spiSCK)
+		begin
+			if ($time - lastRise < minPeriod) minPeriod = $time - lastRise;
+			lastRise = $time;
+		end
+
+//================================  Bus Tasks ===============================
+	// Each task starts and ends just after a rising clock edge, one transfer at a time.
+
+	integer writes;			// bus writes so far
+	integer errors;
+
+	task ahb_write;
+		input [31:0] addr;
+		input [31:0] data;
+		begin
+			HSEL   <= 1'b1;
+			HADDR  <= addr;
+			HWRITE <= 1'b1;
+			HTRANS <= 2'b10;		// non-sequential
+			@ (posedge HCLK);		// end of address phase
+			HTRANS <= 2'b00;
+			HWRITE <= 1'b0;
+			HWDATA <= data;
+			@ (posedge HCLK);		// end of data phase, register written
+			writes = writes + 1;
+		end
+	endtask
+
+	task ahb_read;
+		input [31:0] addr;
+		output [31:0] data;
+		begin
+			HSEL   <= 1'b1;
+			HADDR  <= addr;
+			HWRITE <= 1'b0;
+			HTRANS <= 2'b10;
+			@ (posedge HCLK);
+			HTRANS <= 2'b00;
+			@ (posedge HCLK);
+			data = HRDATA;
+		end
+	endtask
+
+	task check;
+		input [31:0] got;
+		input [31:0] want;
+		input [8*48:1] what;
+		begin
+			if (got !== want)
+				begin
+					errors = errors + 1;
+					$display("FAIL at %0t ns: %0s, got %h, expected %h", $time, what, got, want);
+				end
+		end
+	endtask
+
+	reg [31:0] status;
+
+	task wait_done;			// polls the status register until a frame is done
+		integer n;
+		begin
+			n = 0;
+			status = 0;
+			while (!status[DONE] && n < 1000)
+				begin
+					ahb_read(STAT, status);
+					n = n + 1;
+				end
+			check(status[DONE], 1, "done flag at end of frame");
+		end
+	endtask
+
+//================================  Test Sequence ===============================
+
+	reg [31:0] data;
+	integer i, w0, f0;
+
+	initial
+		begin
+			errors = 0;
+			writes = 0;
+			HSEL = 1'b0; HADDR = 32'b0; HWRITE = 1'b0; HTRANS = 2'b0; HWDATA = 32'b0;
+			HRESETn = 1'b0;
+			repeat (3) @ (posedge HCLK);
+			HRESETn <= 1'b1;
+			@ (posedge HCLK);
+
+			// After reset
+			ahb_read(STAT, data);	check(data, 32'h02, "status after reset");
+			ahb_read(CDIV, data);	check(data, 32'd4, "clock divider after reset");
+			ahb_read(CSEL, data);	check(data, 32'd1, "chip select level after reset");
+			check(spiSSn, 1, "chip select high after reset");
+
+			// Burst read of X, Y and Z at 12 bits: command, address, six bytes
+			ahb_write(CDIV, 1);
+			w0 = writes;
+			f0 = csFrames;
+			minPeriod = 1000000;
+			ahb_write(FRAME, 8);
+			ahb_write(TXD, 8'h0B);
+			ahb_write(TXD, 8'h0E);
+			for (i = 0; i < 6; i = i + 1)
+				ahb_write(TXD, 8'h00);
+			wait_done;
+			check(writes - w0, 9, "bus writes for an 8 byte burst read");
+			#1;
+			check(spiSSn, 1, "chip select released after the frame");
+			check(csFrames - f0, 1, "one chip select period for the frame");
+			check(frameEdges, 64, "SCK rising edges in the frame");
+			check(minPeriod, 2 * (1 + 1) * 20, "SCK period with divider 1");
+			check(csHoldTime, (1 + 1) * 20, "chip select hold with divider 1");
+			check(status[BUSY], 0, "shifter idle at end of frame");
+			check(status[RX_AVAIL], 1, "received bytes available");
+			ahb_read(RXD, data);	check(data, 32'h00, "byte received during command");
+			ahb_read(RXD, data);	check(data, 32'h00, "byte received during address");
+			ahb_read(RXD, data);	check(data, 32'h34, "XDATA_L");
+			ahb_read(RXD, data);	check(data, 32'h01, "XDATA_H");
+			ahb_read(RXD, data);	check(data, 32'hF0, "YDATA_L");
+			ahb_read(RXD, data);	check(data, 32'h0F, "YDATA_H");
+			ahb_read(RXD, data);	check(data, 32'hE8, "ZDATA_L");
+			ahb_read(RXD, data);	check(data, 32'h03, "ZDATA_H");
+			ahb_read(STAT, data);	check(data[RX_AVAIL], 0, "receive FIFO empty after reading the frame");
+
+			// Done interrupt, cleared by writing the status register
+			#1;
+			check(spi_IRQ, 0, "no interrupt while disabled");
+			ahb_write(CTRL, 1 << DONE);
+			#1;
+			check(spi_IRQ, 1, "interrupt when done is enabled");
+			ahb_write(STAT, 0);
+			#1;
+			check(spi_IRQ, 0, "interrupt removed by status write");
+			ahb_read(STAT, data);	check(data[DONE], 0, "done cleared by status write");
+			ahb_write(CTRL, 0);
+
+			// Register write, then read it back, with the slower default divider
+			ahb_write(CDIV, 4);
+			minPeriod = 1000000;
+			ahb_write(FRAME, 3);
+			ahb_write(TXD, 8'h0A);
+			ahb_write(TXD, 8'h20);
+			ahb_write(TXD, 8'h5A);
+			wait_done;
+			check(minPeriod, 2 * (4 + 1) * 20, "SCK period with divider 4");
+			check(csHoldTime, (4 + 1) * 20, "chip select hold with divider 4");
+			for (i = 0; i < 3; i = i + 1)
+				ahb_read(RXD, data);
+			ahb_write(STAT, 0);
+			ahb_write(FRAME, 3);
+			ahb_write(TXD, 8'h0B);
+			ahb_write(TXD, 8'h20);
+			ahb_write(TXD, 8'h00);
+			wait_done;
+			ahb_read(RXD, data);
+			ahb_read(RXD, data);
+			ahb_read(RXD, data);	check(data, 32'h5A, "register written through a frame");
+			ahb_write(STAT, 0);
+
+			// 17 byte frame: the transmit FIFO fills while the first byte shifts,
+			// and the last received byte overruns the 16 byte receive FIFO
+			f0 = csFrames;
+			ahb_write(FRAME, 17);
+			ahb_write(TXD, 8'h0B);
+			ahb_write(TXD, 8'h00);
+			for (i = 0; i < 15; i = i + 1)
+				ahb_write(TXD, 8'h00);
+			ahb_read(STAT, data);	check(data[TX_FULL], 1, "transmit FIFO full");
+			wait_done;
+			check(csFrames - f0, 1, "one chip select period for the long frame");
+			check(frameEdges, 17 * 8, "SCK rising edges in the long frame");
+			check(status[OVERRUN], 1, "overrun flag");
+			check(status[RX_FULL], 1, "receive FIFO full");
+			ahb_write(CTRL, 1 << OVERRUN);
+			#1;
+			check(spi_IRQ, 1, "overrun interrupt");
+			ahb_write(STAT, 0);
+			#1;
+			check(spi_IRQ, 0, "overrun interrupt removed by status write");
+			ahb_write(CTRL, 0);
+			ahb_read(STAT, data);	check(data[OVERRUN], 0, "overrun cleared by status write");
+			ahb_read(RXD, data);
+			ahb_read(RXD, data);
+			ahb_read(RXD, data);	check(data, 32'hAD, "DEVID_AD");
+			ahb_read(RXD, data);	check(data, 32'h1D, "DEVID_MST");
+			ahb_read(RXD, data);	check(data, 32'hF2, "PARTID");
+			ahb_read(RXD, data);	check(data, 32'h01, "REVID");
+			for (i = 6; i < 16; i = i + 1)
+				ahb_read(RXD, data);
+			ahb_read(STAT, data);	check(data[RX_AVAIL], 0, "16 bytes kept, the 17th lost");
+
+			if (errors == 0)
+				$display("AHBspi_tb: PASS");
+			else
+				$display("AHBspi_tb: FAIL, %0d errors", errors);
+			$finish;
+		end
+
+	initial
+		begin
+			#2000000;
+			$display("AHBspi_tb: FAIL, timed out");
+			$finish;
+		end
+
+endmodule
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Module Name:     adxl362_model
+// Description: 	Behavioural ADXL362 SPI interface, mode 0.  Commands 0x0A
+//                  write register and 0x0B read register, both with an
+//                  address that increments after each data byte.  Registers
+//                  start with the ID values and a fixed X, Y, Z sample.
+//////////////////////////////////////////////////////////////////////////////////
+module adxl362_model (
+			input wire SCLK,
+			input wire CSn,
+			input wire MOSI,
+			output reg MISO
+	);
+
+	localparam [7:0] WRITE = 8'h0A, READ = 8'h0B;
+
+	reg [7:0] regs [0:63];
+	reg [7:0] inShift;			// byte being received
+	reg [7:0] outShift;			// byte being sent, MSB first
+	reg [7:0] cmd;
+	reg [5:0] addr;
+	integer bitN, byteN, i;
+
+	initial
+		begin
+			for (i = 0; i < 64; i = i + 1)
+				regs[i] = 8'h00;
+			regs[6'h00] = 8'hAD;  regs[6'h01] = 8'h1D;  regs[6'h02] = 8'hF2;  regs[6'h03] = 8'h01;
+			regs[6'h0E] = 8'h34;  regs[6'h0F] = 8'h01;		// X = 308
+			regs[6'h10] = 8'hF0;  regs[6'h11] = 8'h0F;		// Y = -16
+			regs[6'h12] = 8'hE8;  regs[6'h13] = 8'h03;		// Z = 1000
+			MISO = 1'b0;
+			outShift = 8'h00;
+			bitN = 0;
+			byteN = 0;
+		end
+
+	always @ (negedge CSn)		// start of a transaction
+		begin
+			bitN = 0;
+			byteN = 0;
+			outShift = 8'h00;
+			MISO = 1'b0;
+		end
+
+	always @ (posedge SCLK)		// sample MOSI
+		if (!CSn)
+			begin
+				inShift = {inShift[6:0], MOSI};
+				bitN = bitN + 1;
+				if (bitN == 8)
+					begin
+						bitN = 0;
+						if (byteN == 0)
+							cmd = inShift;
+						else if (byteN == 1)
+							addr = inShift[5:0];
+						else
+							begin
+								if (cmd == WRITE) regs[addr] = inShift;
+								addr = addr + 1'b1;
+							end
+						byteN = byteN + 1;
+						outShift = (cmd == READ && byteN >= 2) ? regs[addr] : 8'h00;
+					end
+			end
+
+	always @ (negedge SCLK)		// next bit out, ready for the next rising edge
+		if (!CSn)
+			begin
+				MISO = outShift[7];
+				outShift = {outShift[6:0], 1'b0};
+			end
+
+endmodule
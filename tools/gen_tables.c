@@ -0,0 +1,275 @@
+//------------------------------------------------------------------------------------------------------
+// gen_tables.c - generates the calibration constants and lookup tables used by all three projects
+// from the single description in tables_config.h, so that retuning is a rebuild, not hand arithmetic.
+//
+// Writes, relative to the repository root:
+//   System On Chip/acc_tables.h                 - mG scale factors, LED bar table, impact threshold
+//   Measuring Instrument/instrument_tables.h    - ADC mV scale, frequency gate and period constants
+//   Assembley Project/sig_tables.inc            - Timer 2 reload tables LOWER and HIGHER for Task_2,
+//                                                 DDS phase increments and wave tables
+//
+// Scale factors are emitted as a multiply and a right shift.  The smallest exact shift is used when
+// the ratio has one, otherwise the largest shift that keeps the product of the biggest input within
+// 32 bits, and the error is printed in the generated file.
+//
+// Build and run from the repository root:
+//   gcc -o gen_tables tools/gen_tables.c -lm && ./gen_tables
+//------------------------------------------------------------------------------------------------------
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "tables_config.h"
+
+typedef struct {
+	uint32_t scale;
+	unsigned shift;
+	double   err_ppm;       // (scale / 2^shift) against the exact ratio
+} fixed_t;
+
+// x * num / den as (x * scale) >> shift, for 0 <= x <= max_in
+static fixed_t fixed_scale(uint64_t num, uint64_t den, uint64_t max_in, unsigned max_shift)
+{
+	fixed_t f = {0, 0, 0.0};
+	unsigned s;
+	for (s = 0; s <= max_shift; s++) {
+		if (((num << s) % den) == 0 && max_in * ((num << s) / den) <= 0xFFFFFFFFULL) {
+			f.scale = (uint32_t)((num << s) / den);
+			f.shift = s;
+			return f;                                   // exact
+		}
+	}
+	for (s = max_shift + 1; s-- > 0; ) {
+		uint64_t scale = ((num << s) + den / 2) / den;
+		if (max_in * scale <= 0xFFFFFFFFULL) {
+			f.scale = (uint32_t)scale;
+			f.shift = s;
+			f.err_ppm = ((double)scale * den / ((double)num * (1ULL << s)) - 1.0) * 1e6;
+			return f;
+		}
+	}
+	fprintf(stderr, "gen_tables: no scale for %llu/%llu fits 32 bits\n", (unsigned long long)num, (unsigned long long)den);
+	exit(1);
+}
+
+static FILE *open_out(const char *path)
+{
+	FILE *f = fopen(path, "w");
+	if (!f) {
+		perror(path);
+		exit(1);
+	}
+	return f;
+}
+
+static void banner(FILE *f, const char *c, const char *name)
+{
+	fprintf(f, "%s %s - generated by tools/gen_tables.c from tools/tables_config.h, do not edit.\n", c, name);
+	fprintf(f, "%s Change the configuration and run gen_tables again to retune.\n", c);
+}
+
+static void fixed_comment(FILE *f, const char *c, fixed_t x)
+{
+	if (x.err_ppm == 0.0) fprintf(f, "%s exact\n", c);
+	else fprintf(f, "%s error %+.2f ppm\n", c, x.err_ppm);
+}
+
+// ---------------- Cortex-M0 SoC: accelerometer ----------------
+static void gen_acc(void)
+{
+	FILE *f = open_out("System On Chip/acc_tables.h");
+	uint64_t ug12 = (uint64_t)ACC_UG_PER_LSB_2G * (ACC_RANGE_G / 2);    // micro-g per 12-bit LSB at this range
+	uint64_t ug8 = ug12 * 16;                                           // 8-bit registers are the top 8 bits
+	fixed_t s12 = fixed_scale(ug12, 1000, 2048, 16);
+	fixed_t s8 = fixed_scale(ug8, 1000, 128, 16);
+	int r;
+
+	if (ACC_RANGE_G != 2 && ACC_RANGE_G != 4 && ACC_RANGE_G != 8) {
+		fprintf(stderr, "gen_tables: ACC_RANGE_G must be 2, 4 or 8\n");
+		exit(1);
+	}
+	banner(f, "//", "acc_tables.h");
+	fprintf(f, "#ifndef ACC_TABLES_ALREADY_INCLUDED\n#define ACC_TABLES_ALREADY_INCLUDED\n\n");
+	fprintf(f, "// ADXL362 at +-%dG, %llu micro-g per 12-bit LSB.  mG = (raw * SCALE) >> SHIFT\n",
+		ACC_RANGE_G, (unsigned long long)ug12);
+	fprintf(f, "#define ACC_RANGE_G\t\t\t%d\n", ACC_RANGE_G);
+	fprintf(f, "#define ACC8_MG_SCALE\t\t%u\t\t\t", s8.scale);
+	fixed_comment(f, "//", s8);
+	fprintf(f, "#define ACC8_MG_SHIFT\t\t%u\n", s8.shift);
+	fprintf(f, "#define ACC12_MG_SCALE\t\t%u\t\t\t", s12.scale);
+	fixed_comment(f, "//", s12);
+	fprintf(f, "#define ACC12_MG_SHIFT\t\t%u\n", s12.shift);
+	fprintf(f, "#define ACC_IMPACT_LSB\t\t%llu\t\t// %d mG in 12-bit LSB\n\n",
+		(unsigned long long)(((uint64_t)ACC_IMPACT_MG * 1000 + ug12 / 2) / ug12), ACC_IMPACT_MG);
+
+	fprintf(f, "// LED bar for an 8-bit reading, indexed by the reading as an unsigned byte.\n");
+	fprintf(f, "// %d LEDs in equal steps of %d mG from -%d mG to +%d mG, ends saturate.\n",
+		ACC_LED_COUNT, 2 * ACC_LED_FULL_SCALE_MG / ACC_LED_COUNT, ACC_LED_FULL_SCALE_MG, ACC_LED_FULL_SCALE_MG);
+	fprintf(f, "static const uint16 led_table[256] = {");
+	for (r = 0; r < 256; r++) {
+		int raw = r < 128 ? r : r - 256;
+		int64_t ug = (int64_t)raw * (int64_t)ug8;
+		int64_t bin = (ug + ACC_LED_FULL_SCALE_MG * 1000LL) * ACC_LED_COUNT / (2000LL * ACC_LED_FULL_SCALE_MG);
+		if (bin < 0) bin = 0;
+		if (bin > ACC_LED_COUNT - 1) bin = ACC_LED_COUNT - 1;
+		fprintf(f, "%s0x%04X%s", (r % 8) ? " " : "\n\t", 1u << bin, r < 255 ? "," : "");
+	}
+	fprintf(f, "\n};\n\n#endif\n");
+	fclose(f);
+}
+
+// ---------------- ADuC841 measuring instrument ----------------
+static void gen_instrument(void)
+{
+	FILE *f = open_out("Measuring Instrument/instrument_tables.h");
+	uint64_t min_gate_cycles = 65536ULL << GATE_MIN_SHIFT;
+	fixed_t mv = fixed_scale(ADC_REF_MV, 1ULL << ADC_BITS, (1ULL << ADC_BITS) - 1, 16);
+	uint64_t adc_cycles = MCU_CLK_HZ / ADC_RATE_HZ;                 // rounded down, so never slower than asked
+	fixed_t gate = fixed_scale(MCU_CLK_HZ, 65536, (uint64_t)COUNT_MAX_HZ * min_gate_cycles / MCU_CLK_HZ, 16);
+
+	if (GATE_MIN_SHIFT > GATE_MAX_SHIFT || GATE_MAX_SHIFT > 15) {
+		fprintf(stderr, "gen_tables: need GATE_MIN_SHIFT <= GATE_MAX_SHIFT <= 15\n");
+		exit(1);
+	}
+
+	banner(f, "//", "instrument_tables.h");
+	fprintf(f, "#ifndef INSTRUMENT_TABLES_ALREADY_INCLUDED\n#define INSTRUMENT_TABLES_ALREADY_INCLUDED\n\n");
+	fprintf(f, "// ADC code to mV: %d mV reference, %d bits.  mV = (code * SCALE) >> SHIFT\n", ADC_REF_MV, ADC_BITS);
+	fprintf(f, "#define ADC_MV_SCALE %uUL                     ", mv.scale);
+	fixed_comment(f, "//", mv);
+	fprintf(f, "#define ADC_MV_SHIFT %u\n", mv.shift);
+	fprintf(f, "#define ADC_T2_RELOAD 0x%04llX                    // Timer 2 reload, %llu cycles between conversions\n",
+		(unsigned long long)(65536 - adc_cycles), (unsigned long long)adc_cycles);
+	fprintf(f, "#define ADC_RATE_DHZ %lluUL                   // conversions in 10 s, %.2f a second\n\n",
+		(unsigned long long)((MCU_CLK_HZ * 10 + adc_cycles / 2) / adc_cycles), (double)MCU_CLK_HZ / adc_cycles);
+
+	fprintf(f, "// Frequency measurement, %lu Hz clock\n", MCU_CLK_HZ);
+	fprintf(f, "#define CLK_CHZ %lluUL                   // clock in hundredths, numerator for frequency in centi-Hz\n",
+		(unsigned long long)MCU_CLK_HZ * 100);
+	fprintf(f, "#define GATE_MIN_SHIFT %d                       // shortest gate 2^%d Timer 2 overflows, %.4f s\n",
+		GATE_MIN_SHIFT, GATE_MIN_SHIFT, (double)min_gate_cycles / MCU_CLK_HZ);
+	fprintf(f, "#define GATE_MAX_SHIFT %d                       // longest gate, %.4f s\n",
+		GATE_MAX_SHIFT, (double)(65536ULL << GATE_MAX_SHIFT) / MCU_CLK_HZ);
+	fprintf(f, "#define GATE_MIN_COUNT %dUL                 // edges wanted per gate, ranging keeps the count below twice this\n",
+		GATE_MIN_COUNT);
+	fprintf(f, "#define GATE_SCALE %uUL                       // count to Hz = (count * SCALE) >> (SHIFT + gate shift),", gate.scale);
+	fixed_comment(f, "", gate);
+	fprintf(f, "#define GATE_SHIFT %u\n", gate.shift);
+	fprintf(f, "#define PERIOD_BELOW_HZ %dUL                 // gated result below which periods are timed\n", PERIOD_BELOW_HZ);
+	fprintf(f, "#define GATED_ABOVE_CHZ %lluUL               // period result (%d Hz) above which edges are counted\n",
+		(unsigned long long)GATED_ABOVE_HZ * 100, GATED_ABOVE_HZ);
+	fprintf(f, "#define PERIOD_GATE %lluUL                  // %d ms in clock cycles, minimum time to average periods over\n",
+		(unsigned long long)MCU_CLK_HZ * PERIOD_GATE_MS / 1000, PERIOD_GATE_MS);
+	fprintf(f, "#define PERIOD_TIMEOUT %llu                     // Timer 2 overflows in %d ms without an edge, signal gone\n",
+		(unsigned long long)(((uint64_t)MCU_CLK_HZ * PERIOD_TIMEOUT_MS / 1000 + 32768) / 65536), PERIOD_TIMEOUT_MS);
+	fprintf(f, "\n#endif\n");
+	fclose(f);
+}
+
+static void wave_table(FILE *f, const char *label, double (*wave)(double))
+{
+	unsigned i;
+	for (i = 0; i < 256; i++) {
+		double v = wave(i / 256.0);
+		long code = lround(127.5 + 127.5 * (v > 1.0 ? 1.0 : v < -1.0 ? -1.0 : v));
+		if (i % 16 == 0) fprintf(f, i ? "\n\t\t\tDB " : "\t\t%s: DB ", label);
+		else fprintf(f, ", ");
+		fprintf(f, "0%02lXh", (unsigned long)code);
+	}
+	fprintf(f, "\n");
+}
+
+static double sine(double x) { return sin(2.0 * M_PI * x); }
+static double arb(double x) { return SIG_ARB_WAVE(x); }
+
+// Direct digital synthesis for Task_2: Timer 2 overflows at a fixed rate, and each overflow adds a
+// 24-bit increment to the phase; the top byte of the phase indexes a 256-entry wave table.
+static void dds_increments(FILE *f, const char *label, const unsigned *hz, double rate)
+{
+	unsigned i;
+	unsigned long inc[8];
+	for (i = 0; i < 8; i++) {
+		inc[i] = (unsigned long)lround(hz[i] * 16777216.0 / rate);
+		if (inc[i] >= 0x800000UL) {
+			fprintf(stderr, "gen_tables: %u Hz is above half the DDS sample rate\n", hz[i]);
+			exit(1);
+		}
+		fprintf(f, ";   %s %u: %5u Hz, increment %06lXh, actual %.3f Hz\n",
+			label, i, hz[i], inc[i], inc[i] * rate / 16777216.0);
+	}
+	fprintf(f, "\t\t%s: DB ", label);
+	for (i = 0; i < 8; i++)
+		fprintf(f, "0%02lXh, 0%02lXh, 0%02lXh%s", inc[i] & 0xFF, (inc[i] >> 8) & 0xFF, inc[i] >> 16,
+			i == 7 ? "\t\t;low byte first\n" : i == 3 ? "\n\t\t\tDB " : ", ");
+}
+
+static void gen_dds(FILE *f, const unsigned *freqs)
+{
+	double rate = (double)MCU_CLK_HZ / SIG_DDS_SAMPLE_CYCLES;
+	unsigned fine[8], coarse_max = 0, i;
+
+	if (SIG_DDS_SAMPLE_CYCLES < 64 || SIG_DDS_SAMPLE_CYCLES > 65536) {
+		fprintf(stderr, "gen_tables: SIG_DDS_SAMPLE_CYCLES out of range\n");
+		exit(1);
+	}
+	for (i = 0; i < 8; i++) {
+		fine[i] = i * SIG_DDS_FINE_HZ;
+		if (freqs[i] > coarse_max) coarse_max = freqs[i];
+	}
+	fprintf(f, "\n; DDS: Timer 2 reload for one sample every %d cycles, %.1f Hz.\n", SIG_DDS_SAMPLE_CYCLES, rate);
+	fprintf(f, "; Phase increment = f * 2^24 / %.1f, resolution %.5f Hz; coarse + fine up to %u Hz\n",
+		rate, rate / 16777216.0, coarse_max + fine[7]);
+	fprintf(f, "DDS_RELOADL\tEQU\t0%02Xh\nDDS_RELOADH\tEQU\t0%02Xh\n",
+		(65536 - SIG_DDS_SAMPLE_CYCLES) & 0xFF, (65536 - SIG_DDS_SAMPLE_CYCLES) >> 8);
+	dds_increments(f, "DDS_COARSE", freqs, rate);
+	dds_increments(f, "DDS_FINE", fine, rate);
+	if ((coarse_max + fine[7]) * 16777216.0 / rate >= 0x800000) {
+		fprintf(stderr, "gen_tables: coarse + fine frequency is above half the DDS sample rate\n");
+		exit(1);
+	}
+	fprintf(f, "; Wave tables, 256 samples of one period, DAC code 0 to 255\n");
+	wave_table(f, "SINE", sine);
+	wave_table(f, "ARB", arb);
+}
+
+// ---------------- ADuC841 signal generator, Task_2 ----------------
+static void gen_signal(void)
+{
+	static const unsigned freqs[] = SIG_FREQS_HZ;
+	FILE *f = open_out("Assembley Project/sig_tables.inc");
+	unsigned reload[8];
+	unsigned i, n = sizeof(freqs) / sizeof(freqs[0]);
+
+	if (n != 8) {
+		fprintf(stderr, "gen_tables: SIG_FREQS_HZ needs one frequency for each of the 8 switch settings\n");
+		exit(1);
+	}
+	banner(f, ";", "sig_tables.inc");
+	fprintf(f, "; Timer 2 reload for a square wave: output toggles at each overflow, so\n");
+	fprintf(f, "; RCAP2 = 65536 - %lu / (2 * f)\n", MCU_CLK_HZ);
+	for (i = 0; i < 8; i++) {
+		unsigned long half = (MCU_CLK_HZ + freqs[i]) / (2 * freqs[i]);     // rounded half period in cycles
+		if (half < 1 || half > 65536) {
+			fprintf(stderr, "gen_tables: %u Hz out of Timer 2 range\n", freqs[i]);
+			exit(1);
+		}
+		reload[i] = (unsigned)(65536 - half);
+		fprintf(f, ";   switch %u: %5u Hz, RCAP2 = %04Xh, actual %.2f Hz\n",
+			i, freqs[i], reload[i], (double)MCU_CLK_HZ / (2.0 * half));
+	}
+	fprintf(f, "\t\tLOWER: DB ");
+	for (i = 0; i < 8; i++) fprintf(f, "0%02Xh%s", reload[i] & 0xFF, i < 7 ? ", " : "\t\t;RCAP2L values\n");
+	fprintf(f, "\t\tHIGHER: DB ");
+	for (i = 0; i < 8; i++) fprintf(f, "0%02Xh%s", reload[i] >> 8, i < 7 ? ", " : "\t\t;RCAP2H values\n");
+	gen_dds(f, freqs);
+	fclose(f);
+}
+
+int main(void)
+{
+	gen_acc();
+	gen_instrument();
+	gen_signal();
+	return 0;
+}
@@ -0,0 +1,789 @@
+//------------------------------------------------------------------------------------------------------
+// sim841.c - instruction timing simulator for the ADuC841 projects
+//
+// Runs an assembled or compiled image (Intel HEX from A51 or C51) on a model of the ADuC841 and
+// reports where the cycles go, so timing claims in the source can be checked without a board:
+//   - per-routine cycles: every CALL/RET pair and every interrupt, min, max and mean, with
+//     time spent in nested interrupts taken out
+//   - interrupt entry latency: from the cycle the hardware sets the flag to the cycle the vector
+//     starts executing, min, max and jitter for each source
+//   - the output waveform on a port pin, or on DAC0 crossing mid scale: exact frequency from the
+//     mean period, period jitter and duty cycle
+//   - with a map file, a flat profile of cycles by symbol
+//
+// Core: the single cycle 8052 of the ADuC841, instruction cycles in cycles[] below (one core clock
+// each, MCU_CLK_HZ from tables_config.h).  Peripherals modelled:
+//   Timer 0 and 1   modes 0, 1 and 2, timer or counter on T0 (P3.4) / T1 (P3.5), GATE on INT0/INT1
+//   Timer 2         auto-reload and capture, counter on T2 (P1.0), reload/capture on T2EX (P1.1)
+//   INT0, INT1      edge or level on P3.2 / P3.3
+//   ADC             single (SCONV), continuous (CCONV) and Timer 2 overflow (T2C) conversions,
+//                   16 + acquisition ADC clocks, ADCI interrupt
+//   SPI master      ISPI set 8 bit times after SPIDAT is written
+//   UART transmit   TI set one character time after SBUF is written, output optionally shown
+//   DAC0 and ports  writes recorded for the waveform measurement
+// Interrupts are taken between instructions in the ADuC841 priority order, two levels set by IP,
+// not after RETI or a write to IE/IP, and cost IRQ_ENTRY_CYCLES for the hardware call.
+//
+// Stimulus: -f Hz square wave on T0, T1, T2 and T2EX (the signal being measured), -i Hz square
+// wave on INT0 (a button), -a mV on every ADC channel, -w hex on the P2 switches.
+//
+// Build and run from the repository root:
+//   gcc -O2 -o sim841 tools/sim841.c
+//   ./sim841 -t 1 -p P3.6 task_1.hex
+//   ./sim841 -t 2 -s 1 -w 80 -p dac -m Task_2.m51 Task_2.hex
+//   ./sim841 -t 2 -f 5000 -a 1200 -m Full_measurement_system.m51 Full_measurement_system.hex
+// Options: -t seconds to run, -s seconds before the output is measured (skips start-up), -p pin (P0.0 to P3.7) or dac, -m map file (Keil .M51, or "address name"
+// lines), -f Hz, -i Hz, -a mV, -w switches (hex), -b baud, -u show UART output
+//------------------------------------------------------------------------------------------------------
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tables_config.h"
+
+#define IRQ_ENTRY_CYCLES    3           // hardware call to the vector
+#define MAX_SYMS            1024
+#define MAX_FRAMES          64
+
+// SFR addresses
+enum {
+	P0 = 0x80, SP = 0x81, DPL = 0x82, DPH = 0x83, TCON = 0x88, TMOD = 0x89, TL0 = 0x8A, TL1 = 0x8B,
+	TH0 = 0x8C, TH1 = 0x8D, P1 = 0x90, SCON = 0x98, SBUF = 0x99, P2 = 0xA0, IE = 0xA8, IEIP2 = 0xA9,
+	P3 = 0xB0, IP = 0xB8, T2CON = 0xC8, RCAP2L = 0xCA, RCAP2H = 0xCB, TL2 = 0xCC, TH2 = 0xCD,
+	PSW = 0xD0, ADCCON2 = 0xD8, ADCDATAL = 0xD9, ADCDATAH = 0xDA, ACC = 0xE0, ADCCON1 = 0xEF,
+	B = 0xF0, SPIDAT = 0xF7, SPICON = 0xF8, DAC0L = 0xF9, DACCON = 0xFD,
+};
+
+// Instruction cycles, ADuC841 single cycle core, indexed by opcode
+static const uint8_t cycles[256] = {
+//	 0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F
+	 1, 3, 4, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1,   // 0  NOP AJMP LJMP RR INC
+	 4, 3, 4, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1,   // 1  JBC ACALL LCALL RRC DEC
+	 4, 3, 4, 1, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1,   // 2  JB RET RL ADD
+	 4, 3, 4, 1, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1,   // 3  JNB RETI RLC ADDC
+	 3, 3, 2, 3, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1,   // 4  JC ORL
+	 3, 3, 2, 3, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1,   // 5  JNC ANL
+	 3, 3, 2, 3, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1,   // 6  JZ XRL
+	 3, 3, 2, 3, 2, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,   // 7  JNZ ORL C JMP @A+DPTR MOV #
+	 3, 3, 2, 4, 9, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,   // 8  SJMP ANL C MOVC DIV MOV dir
+	 3, 3, 2, 4, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1,   // 9  MOV DPTR MOV bit MOVC SUBB
+	 2, 3, 2, 3, 9, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,   // A  ORL C MOV C INC DPTR MUL MOV @Ri/Rn,dir
+	 2, 3, 2, 1, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,   // B  ANL C CPL CJNE
+	 2, 3, 2, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1,   // C  PUSH CLR SWAP XCH
+	 2, 3, 2, 1, 2, 4, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3,   // D  POP SETB DA DJNZ XCHD
+	 4, 3, 4, 4, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1,   // E  MOVX CLR A MOV A
+	 4, 3, 4, 4, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1,   // F  MOVX CPL A MOV from A
+};
+
+static uint8_t code[65536], xram[65536], iram[256], sfr[256];
+static uint16_t pc;
+static uint64_t cyc, end_cyc, instructions;
+static int irq_block;                   // no interrupt after RETI or a write to IE/IP
+
+// ---------------- stimulus and options ----------------
+static double sig_hz, int0_hz;
+static unsigned adc_mv, baud = 9600;
+static uint8_t switches = 0xFF;
+static int show_uart;
+
+static int square(double hz, uint64_t t)   // level of a square wave starting high at t = 0
+{
+	if (hz <= 0) return 1;
+	return !((uint64_t)(t * 2.0 * hz / MCU_CLK_HZ) & 1);
+}
+
+static uint8_t port_pins(unsigned port)   // levels driven on the pins from outside, 1 = not pulled low
+{
+	int s = square(sig_hz, cyc), i0 = square(int0_hz, cyc);
+	switch (port) {
+	case P1: return (uint8_t)(0xFC | (s << 1) | s);                       // T2EX, T2
+	case P2: return switches;
+	case P3: return (uint8_t)(0xCB | (s << 5) | (s << 4) | (i0 << 2));    // T1, T0, INT0
+	}
+	return 0xFF;
+}
+
+// ---------------- waveform measurement ----------------
+static int watch_port = P3, watch_bit = 6, watch_dac;
+static int wave_level = -1;
+static uint64_t wave_from, wave_first, wave_last, wave_rise, wave_high, wave_min = UINT64_MAX, wave_max;
+static unsigned long wave_periods;
+
+static void wave_edge(int level, uint64_t t)
+{
+	if (level == wave_level || t < wave_from) return;
+	if (wave_level >= 0) {
+		if (level) {
+			if (wave_rise) {
+				uint64_t p = t - wave_rise;
+				if (p < wave_min) wave_min = p;
+				if (p > wave_max) wave_max = p;
+				wave_periods++;
+				wave_last = t;
+			}
+			else wave_first = wave_last = t;
+			wave_rise = t;
+		}
+		else if (wave_rise) wave_high += t - wave_rise;
+	}
+	wave_level = level;
+}
+
+// ---------------- interrupt sources ----------------
+enum { S_IE0, S_ADC, S_TF0, S_IE1, S_TF1, S_SPI, S_UART, S_TF2, S_COUNT };   // polling order
+static const struct { const char *name; uint16_t vector; uint8_t ie_bit; } src_info[S_COUNT] = {
+	{"INT0", 0x03, 0}, {"ADC", 0x33, 6}, {"Timer 0", 0x0B, 1}, {"INT1", 0x13, 2},
+	{"Timer 1", 0x1B, 3}, {"SPI", 0x3B, 0xFF}, {"UART", 0x23, 4}, {"Timer 2", 0x2B, 5},
+};
+
+// ---------------- symbols and profiling ----------------
+typedef struct { uint16_t addr; char name[40]; } sym_t;
+static sym_t syms[MAX_SYMS];
+static int nsyms;
+static int16_t sym_at[65536];           // index of the symbol covering each code address, -1 if none
+static uint64_t sym_cycles[MAX_SYMS];
+
+typedef struct {
+	unsigned long calls;
+	uint64_t total, min, max;
+} span_t;
+static span_t routine[65536];           // by entry address
+
+typedef struct { uint16_t target; int isr; uint64_t start, isr_at_start; } frame_t;
+static frame_t frames[MAX_FRAMES];
+static int nframes;
+static uint64_t isr_time;               // total cycles spent in interrupt service routines
+
+static const char *sym_name(uint16_t addr)
+{
+	static char buf[4][48];
+	static int n;
+	int i;
+	for (i = 0; i < nsyms; i++)
+		if (syms[i].addr == addr) return syms[i].name;
+	n = (n + 1) & 3;
+	snprintf(buf[n], sizeof(buf[n]), "C:%04X", addr);
+	return buf[n];
+}
+
+static const char *routine_name(uint16_t addr)     // interrupt vectors without a symbol by source
+{
+	static char buf[48];
+	int s;
+	for (s = 0; s < S_COUNT; s++)
+		if (src_info[s].vector == addr && (sym_at[addr] < 0 || syms[sym_at[addr]].addr != addr)) {
+			snprintf(buf, sizeof(buf), "%s interrupt", src_info[s].name);
+			return buf;
+		}
+	return sym_name(addr);
+}
+
+static void frame_push(uint16_t target, int isr)
+{
+	if (nframes == MAX_FRAMES) return;
+	frames[nframes].target = target;
+	frames[nframes].isr = isr;
+	frames[nframes].start = cyc;
+	frames[nframes].isr_at_start = isr_time;
+	nframes++;
+}
+
+static void frame_pop(void)
+{
+	frame_t *f;
+	span_t *r;
+	uint64_t own;
+	if (!nframes) return;
+	f = &frames[--nframes];
+	own = (cyc - f->start) - (isr_time - f->isr_at_start);
+	if (f->isr) isr_time += own;
+	r = &routine[f->target];
+	if (!r->calls || own < r->min) r->min = own;
+	if (own > r->max) r->max = own;
+	r->total += own;
+	r->calls++;
+}
+
+static int by_addr(const void *a, const void *b)
+{
+	return (int)((const sym_t *)a)->addr - (int)((const sym_t *)b)->addr;
+}
+
+static void load_map(const char *path)  // Keil M51 symbol lines "C:0035H  PUBLIC  DELAY", or "0035 DELAY"
+{
+	FILE *f = fopen(path, "r");
+	char line[256], kind[32], name[40];
+	unsigned addr;
+	int i, s = -1;
+	if (!f) {
+		perror(path);
+		exit(1);
+	}
+	while (fgets(line, sizeof(line), f) && nsyms < MAX_SYMS) {
+		if (sscanf(line, " C:%xH %31s %39s", &addr, kind, name) == 3) {
+			if (strcmp(kind, "SYMBOL") && strcmp(kind, "PUBLIC")) continue;
+		}
+		else if (sscanf(line, " %x %39s", &addr, name) != 2 || line[0] == ';') continue;
+		if (addr > 0xFFFF) continue;
+		syms[nsyms].addr = (uint16_t)addr;
+		snprintf(syms[nsyms].name, sizeof(syms[nsyms].name), "%s", name);
+		nsyms++;
+	}
+	fclose(f);
+	qsort(syms, nsyms, sizeof(syms[0]), by_addr);
+	for (addr = 0, i = 0; addr < 65536; addr++) {
+		while (i < nsyms && syms[i].addr <= addr) s = i++;
+		sym_at[addr] = (int16_t)s;
+	}
+}
+
+static void load_hex(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	char line[600];
+	unsigned n, addr, type, b, i, sum, base = 0;
+	if (!f) {
+		perror(path);
+		exit(1);
+	}
+	memset(code, 0xFF, sizeof(code));
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] != ':' || sscanf(line + 1, "%2x%4x%2x", &n, &addr, &type) != 3) continue;
+		sum = n + (addr >> 8) + (addr & 0xFF) + type;
+		for (i = 0; i <= n; i++) {
+			if (sscanf(line + 9 + 2 * i, "%2x", &b) != 1) break;
+			sum += b;
+			if (type == 0 && i < n) code[(base + addr + i) & 0xFFFF] = (uint8_t)b;
+		}
+		if (sum & 0xFF) fprintf(stderr, "sim841: checksum error in %s: %s", path, line);
+		if (type == 1) break;
+		if (type == 2 || type == 4) base = 0;      // 8051 code space is 64K, upper address ignored
+	}
+	fclose(f);
+}
+
+// ---------------- interrupt state ----------------
+static uint64_t flag_time[S_COUNT];     // cycle the request was raised, 0 = none waiting
+static span_t latency[S_COUNT];
+static int in_service[2];               // interrupts active at each priority level
+
+static void raise(int s, uint64_t t) { if (!flag_time[s]) flag_time[s] = t ? t : 1; }
+
+// ---------------- peripherals ----------------
+static int t0_last = 1, t1_last = 1, t2_last = 1, t2ex_last = 1, int0_last = 1, int1_last = 1;
+static uint64_t adc_done, spi_done, uart_done;
+
+static int bit_of(unsigned a, unsigned n) { return (sfr[a] >> n) & 1; }
+static void set_bit(unsigned a, unsigned n, int v) { sfr[a] = (uint8_t)((sfr[a] & ~(1u << n)) | ((v & 1u) << n)); }
+
+static void adc_start(void)
+{
+	static const unsigned div[4] = {32, 4, 8, 2};
+	unsigned c = sfr[ADCCON1];
+	if (!(c & 0x80) || adc_done) return;                         // powered down, or busy
+	adc_done = cyc + (16 + ((c >> 2) & 3) + 1) * div[(c >> 4) & 3];
+}
+
+static void timer01(int n)               // one clock for timer 0 or 1
+{
+	unsigned mode = (sfr[TMOD] >> (4 * n)) & 0x0F;
+	unsigned tl = n ? TL1 : TL0, th = n ? TH1 : TH0;
+	int pin = (port_pins(P3) >> (4 + n)) & 1, *last = n ? &t1_last : &t0_last;
+	int fall = *last && !pin;
+	*last = pin;
+	if (!bit_of(TCON, 4 + 2 * n)) return;                        // TRn
+	if ((mode & 8) && !((port_pins(P3) >> (2 + n)) & 1)) return;  // GATE with INTn low
+	if ((mode & 4) && !fall) return;                             // counter, falling edges only
+	switch (mode & 3) {
+	case 0:                                                      // 13-bit
+		sfr[tl] = (sfr[tl] + 1) & 0x1F;
+		if (sfr[tl]) return;
+		if (++sfr[th]) return;
+		break;
+	case 1:                                                      // 16-bit
+		if (++sfr[tl]) return;
+		if (++sfr[th]) return;
+		break;
+	case 2:                                                      // 8-bit auto-reload
+		if (++sfr[tl]) return;
+		sfr[tl] = sfr[th];
+		break;
+	default:
+		return;
+	}
+	set_bit(TCON, 5 + 2 * n, 1);
+	raise(n ? S_TF1 : S_TF0, cyc);
+}
+
+static void timer2(void)
+{
+	unsigned c = sfr[T2CON];
+	int pin = port_pins(P1) & 1, ex = (port_pins(P1) >> 1) & 1;
+	int fall = t2_last && !pin, exfall = t2ex_last && !ex;
+	t2_last = pin;
+	t2ex_last = ex;
+	if ((c & 0x08) && exfall) {                                  // EXEN2 and T2EX falling edge
+		if (c & 0x01) {                                          // capture
+			sfr[RCAP2L] = sfr[TL2];
+			sfr[RCAP2H] = sfr[TH2];
+		}
+		else {
+			sfr[TL2] = sfr[RCAP2L];
+			sfr[TH2] = sfr[RCAP2H];
+		}
+		set_bit(T2CON, 6, 1);
+		raise(S_TF2, cyc);
+	}
+	if (!(c & 0x04) || ((c & 0x02) && !fall)) return;            // TR2, counter on falling edges
+	if (++sfr[TL2]) return;
+	if (++sfr[TH2]) return;
+	if (!(c & 0x01)) {                                           // auto-reload
+		sfr[TL2] = sfr[RCAP2L];
+		sfr[TH2] = sfr[RCAP2H];
+	}
+	if (!(c & 0x30)) {                                           // not a baud rate generator
+		set_bit(T2CON, 7, 1);
+		raise(S_TF2, cyc);
+	}
+	if (sfr[ADCCON1] & 0x02) adc_start();                        // T2C
+}
+
+static void tick(unsigned n)             // advances every peripheral by n clocks
+{
+	int i0, i1;
+	while (n--) {
+		cyc++;
+		timer01(0);
+		timer01(1);
+		timer2();
+		i0 = (port_pins(P3) >> 2) & 1;
+		i1 = (port_pins(P3) >> 3) & 1;
+		if (bit_of(TCON, 0) ? int0_last && !i0 : !i0) { set_bit(TCON, 1, 1); raise(S_IE0, cyc); }
+		if (bit_of(TCON, 2) ? int1_last && !i1 : !i1) { set_bit(TCON, 3, 1); raise(S_IE1, cyc); }
+		int0_last = i0;
+		int1_last = i1;
+		if (adc_done && cyc >= adc_done) {
+			unsigned code12 = (unsigned)((uint64_t)adc_mv * (1u << ADC_BITS) / ADC_REF_MV);
+			if (code12 > (1u << ADC_BITS) - 1) code12 = (1u << ADC_BITS) - 1;
+			sfr[ADCDATAL] = (uint8_t)code12;
+			sfr[ADCDATAH] = (uint8_t)(((sfr[ADCCON2] & 0x0F) << 4) | (code12 >> 8));
+			set_bit(ADCCON2, 7, 1);
+			raise(S_ADC, cyc);
+			adc_done = 0;
+			if (sfr[ADCCON2] & 0x20) adc_start();                // continuous
+			else set_bit(ADCCON2, 4, 0);                         // SCONV cleared at the end
+		}
+		if (spi_done && cyc >= spi_done) {
+			spi_done = 0;
+			set_bit(SPICON, 7, 1);
+			raise(S_SPI, cyc);
+		}
+		if (uart_done && cyc >= uart_done) {
+			uart_done = 0;
+			set_bit(SCON, 1, 1);
+			raise(S_UART, cyc);
+		}
+	}
+}
+
+// The request stays raised while its flag is set, so one that is cleared by software without
+// being serviced is forgotten.
+static int pending(int s)
+{
+	switch (s) {
+	case S_IE0:  return bit_of(TCON, 1);
+	case S_ADC:  return bit_of(ADCCON2, 7);
+	case S_TF0:  return bit_of(TCON, 5);
+	case S_IE1:  return bit_of(TCON, 3);
+	case S_TF1:  return bit_of(TCON, 7);
+	case S_SPI:  return bit_of(SPICON, 7);
+	case S_UART: return bit_of(SCON, 0) || bit_of(SCON, 1);
+	case S_TF2:  return bit_of(T2CON, 7) || bit_of(T2CON, 6);
+	}
+	return 0;
+}
+
+static int enabled(int s)
+{
+	if (s == S_SPI) return sfr[IEIP2] & 0x01;
+	return bit_of(IE, src_info[s].ie_bit);
+}
+
+static int priority(int s)
+{
+	if (s == S_SPI) return (sfr[IEIP2] >> 4) & 1;
+	return bit_of(IP, src_info[s].ie_bit);
+}
+
+// ---------------- memory ----------------
+static uint8_t sfr_read(unsigned a, int rmw)
+{
+	if (!rmw && (a == P0 || a == P1 || a == P2 || a == P3)) return sfr[a] & port_pins(a);
+	if (a == PSW) {
+		uint8_t p = sfr[ACC];
+		p ^= p >> 4; p ^= p >> 2; p ^= p >> 1;
+		return (uint8_t)((sfr[PSW] & 0xFE) | (p & 1));
+	}
+	return sfr[a];
+}
+
+static void sfr_write(unsigned a, uint8_t v)
+{
+	static const unsigned spr[4] = {2, 4, 8, 16};
+	sfr[a] = v;
+	switch (a) {
+	case IE: case IP: case IEIP2:
+		irq_block = 1;
+		break;
+	case SBUF:
+		uart_done = cyc + (uint64_t)MCU_CLK_HZ * 10 / baud;
+		if (show_uart) putchar(v);
+		break;
+	case SPIDAT:
+		if ((sfr[SPICON] & 0x30) == 0x30) spi_done = cyc + 8 * spr[sfr[SPICON] & 3];   // SPE and master
+		break;
+	case ADCCON2:
+		if (v & 0x30) adc_start();                               // SCONV or CCONV
+		break;
+	case DAC0L:
+		if (watch_dac) wave_edge(v >= 0x80, cyc);
+		break;
+	}
+	if (!watch_dac && (int)a == watch_port) wave_edge((v >> watch_bit) & 1, cyc);
+}
+
+static uint8_t rd(unsigned a) { return a < 0x80 ? iram[a] : sfr_read(a, 0); }
+static uint8_t rd_rmw(unsigned a) { return a < 0x80 ? iram[a] : sfr_read(a, 1); }
+static void wr(unsigned a, uint8_t v) { if (a < 0x80) iram[a] = v; else sfr_write(a, v); }
+
+static unsigned bit_byte(uint8_t b) { return b < 0x80 ? 0x20 + (b >> 3) : b & 0xF8; }
+static int rd_bit(uint8_t b) { return (rd(bit_byte(b)) >> (b & 7)) & 1; }
+static void wr_bit(uint8_t b, int v)
+{
+	unsigned a = bit_byte(b);
+	uint8_t x = rd_rmw(a);
+	wr(a, (uint8_t)((x & ~(1u << (b & 7))) | ((v & 1u) << (b & 7))));
+}
+
+#define A       sfr[ACC]
+#define CY      ((sfr[PSW] >> 7) & 1)
+#define R(n)    iram[(sfr[PSW] & 0x18) + (n)]
+#define DPTR    ((uint16_t)(sfr[DPH] << 8 | sfr[DPL]))
+
+static uint8_t fetch(void) { return code[pc++]; }
+static void set_cy(int c) { set_bit(PSW, 7, c); }
+static void push(uint8_t v) { iram[++sfr[SP]] = v; }
+static uint8_t pop(void) { return iram[sfr[SP]--]; }
+static void set_dptr(uint16_t v) { sfr[DPH] = v >> 8; sfr[DPL] = v & 0xFF; }
+
+static void add(uint8_t v, int c)
+{
+	unsigned r = A + v + c;
+	set_bit(PSW, 6, ((A & 0x0F) + (v & 0x0F) + c) > 0x0F);
+	set_bit(PSW, 2, ((A ^ r) & (v ^ r) & 0x80) != 0);
+	set_cy(r > 0xFF);
+	A = (uint8_t)r;
+}
+
+static void subb(uint8_t v)
+{
+	int c = CY;
+	unsigned r = (unsigned)(A - v - c) & 0xFF;
+	set_bit(PSW, 6, (A & 0x0F) < (v & 0x0F) + c);
+	set_bit(PSW, 2, ((A ^ v) & (A ^ r) & 0x80) != 0);
+	set_cy(A < v + c);
+	A = (uint8_t)r;
+}
+
+static void jump_rel(int8_t rel) { pc = (uint16_t)(pc + rel); }
+
+// Source operand for the ALU columns: 4 = #data, 5 = direct, 6/7 = @Ri, 8-F = Rn
+static uint8_t operand(uint8_t op)
+{
+	switch (op & 0x0F) {
+	case 4:  return fetch();
+	case 5:  return rd(fetch());
+	case 6: case 7: return iram[R(op & 1)];
+	default: return R(op & 7);
+	}
+}
+
+// Executes one instruction and advances the clock.  A call is timed from the start of the CALL
+// to the end of the RET, an interrupt from the hardware call to the end of the RETI.
+static void step(void)
+{
+	uint16_t at = pc;
+	uint8_t op = fetch(), d, v, b;
+	int8_t rel;
+	unsigned t;
+	irq_block = 0;
+	switch (op) {
+	case 0x00: break;                                                       // NOP
+	case 0x01: case 0x21: case 0x41: case 0x61: case 0x81: case 0xA1: case 0xC1: case 0xE1:
+		d = fetch(); pc = (uint16_t)((pc & 0xF800) | ((op & 0xE0) << 3) | d); break;   // AJMP
+	case 0x11: case 0x31: case 0x51: case 0x71: case 0x91: case 0xB1: case 0xD1: case 0xF1:
+		d = fetch(); push(pc & 0xFF); push(pc >> 8);                          // ACALL
+		pc = (uint16_t)((pc & 0xF800) | ((op & 0xE0) << 3) | d);
+		frame_push(pc, 0); break;
+	case 0x02: t = fetch(); pc = (uint16_t)(t << 8 | fetch()); break;       // LJMP
+	case 0x12: t = fetch(); t = t << 8 | fetch(); push(pc & 0xFF); push(pc >> 8);
+		pc = (uint16_t)t; frame_push(pc, 0); break;                          // LCALL
+	case 0x22: case 0x32:                                                   // RET, RETI
+		t = pop(); pc = (uint16_t)(t << 8 | pop());
+		if (op == 0x32) {
+			if (in_service[1]) in_service[1]--; else if (in_service[0]) in_service[0]--;
+			irq_block = 1;
+		}
+		break;
+	case 0x03: A = (uint8_t)(A >> 1 | A << 7); break;                       // RR
+	case 0x13: v = A & 1; A = (uint8_t)(A >> 1 | CY << 7); set_cy(v); break;  // RRC
+	case 0x23: A = (uint8_t)(A << 1 | A >> 7); break;                       // RL
+	case 0x33: v = A >> 7; A = (uint8_t)(A << 1 | CY); set_cy(v); break;     // RLC
+	case 0x04: A++; break;
+	case 0x05: d = fetch(); wr(d, rd_rmw(d) + 1); break;
+	case 0x06: case 0x07: iram[R(op & 1)]++; break;
+	case 0x08 ... 0x0F: R(op & 7)++; break;
+	case 0x14: A--; break;
+	case 0x15: d = fetch(); wr(d, rd_rmw(d) - 1); break;
+	case 0x16: case 0x17: iram[R(op & 1)]--; break;
+	case 0x18 ... 0x1F: R(op & 7)--; break;
+	case 0x10: case 0x20: case 0x30:                                        // JBC, JB, JNB
+		b = fetch(); rel = (int8_t)fetch();
+		v = (uint8_t)(op == 0x10 ? (rd_rmw(bit_byte(b)) >> (b & 7)) & 1 : rd_bit(b));
+		if (op == 0x30 ? !v : v) {
+			if (op == 0x10) wr_bit(b, 0);
+			jump_rel(rel);
+		}
+		break;
+	case 0x24 ... 0x2F: add(operand(op), 0); break;
+	case 0x34 ... 0x3F: add(operand(op), CY); break;
+	case 0x94 ... 0x9F: subb(operand(op)); break;
+	case 0x40: rel = (int8_t)fetch(); if (CY) jump_rel(rel); break;
+	case 0x50: rel = (int8_t)fetch(); if (!CY) jump_rel(rel); break;
+	case 0x60: rel = (int8_t)fetch(); if (!A) jump_rel(rel); break;
+	case 0x70: rel = (int8_t)fetch(); if (A) jump_rel(rel); break;
+	case 0x80: rel = (int8_t)fetch(); jump_rel(rel); break;                 // SJMP
+	case 0x42: case 0x52: case 0x62:                                        // ORL/ANL/XRL direct,A
+		d = fetch(); v = rd_rmw(d);
+		wr(d, op == 0x42 ? v | A : op == 0x52 ? v & A : v ^ A); break;
+	case 0x43: case 0x53: case 0x63:                                        // ORL/ANL/XRL direct,#data
+		d = fetch(); b = fetch(); v = rd_rmw(d);
+		wr(d, op == 0x43 ? v | b : op == 0x53 ? v & b : v ^ b); break;
+	case 0x44 ... 0x4F: A |= operand(op); break;
+	case 0x54 ... 0x5F: A &= operand(op); break;
+	case 0x64 ... 0x6F: A ^= operand(op); break;
+	case 0x72: set_cy(CY | rd_bit(fetch())); break;                          // ORL C,bit
+	case 0x82: set_cy(CY & rd_bit(fetch())); break;                          // ANL C,bit
+	case 0xA0: set_cy(CY | !rd_bit(fetch())); break;                         // ORL C,/bit
+	case 0xB0: set_cy(CY & !rd_bit(fetch())); break;                         // ANL C,/bit
+	case 0x73: pc = (uint16_t)(A + DPTR); break;                            // JMP @A+DPTR
+	case 0x74: A = fetch(); break;
+	case 0x75: d = fetch(); wr(d, fetch()); break;
+	case 0x76: case 0x77: iram[R(op & 1)] = fetch(); break;
+	case 0x78 ... 0x7F: R(op & 7) = fetch(); break;
+	case 0x83: A = code[(uint16_t)(A + pc)]; break;                         // MOVC A,@A+PC
+	case 0x93: A = code[(uint16_t)(A + DPTR)]; break;                       // MOVC A,@A+DPTR
+	case 0x84:                                                              // DIV AB
+		set_cy(0);
+		if (!sfr[B]) set_bit(PSW, 2, 1);
+		else { v = A / sfr[B]; sfr[B] = A % sfr[B]; A = v; set_bit(PSW, 2, 0); }
+		break;
+	case 0xA4:                                                              // MUL AB
+		t = A * sfr[B]; A = (uint8_t)t; sfr[B] = (uint8_t)(t >> 8);
+		set_cy(0); set_bit(PSW, 2, t > 0xFF); break;
+	case 0x85: b = fetch(); d = fetch(); wr(d, rd(b)); break;               // MOV dest,src: source first
+	case 0x86: case 0x87: wr(fetch(), iram[R(op & 1)]); break;
+	case 0x88 ... 0x8F: wr(fetch(), R(op & 7)); break;
+	case 0x90: t = fetch(); set_dptr((uint16_t)(t << 8 | fetch())); break;
+	case 0x92: wr_bit(fetch(), CY); break;                                  // MOV bit,C
+	case 0xA2: set_cy(rd_bit(fetch())); break;                              // MOV C,bit
+	case 0xA3: set_dptr(DPTR + 1); break;
+	case 0xA5: break;                                                       // reserved
+	case 0xA6: case 0xA7: iram[R(op & 1)] = rd(fetch()); break;
+	case 0xA8 ... 0xAF: R(op & 7) = rd(fetch()); break;
+	case 0xB2: d = fetch(); wr_bit(d, !((rd_rmw(bit_byte(d)) >> (d & 7)) & 1)); break;   // CPL bit
+	case 0xB3: set_cy(!CY); break;
+	case 0xB4 ... 0xBF:                                                     // CJNE
+		if (op == 0xB4) { v = A; b = fetch(); }
+		else if (op == 0xB5) { v = A; b = rd(fetch()); }
+		else if (op < 0xB8) { v = iram[R(op & 1)]; b = fetch(); }
+		else { v = R(op & 7); b = fetch(); }
+		rel = (int8_t)fetch();
+		set_cy(v < b);
+		if (v != b) jump_rel(rel);
+		break;
+	case 0xC0: push(rd(fetch())); break;
+	case 0xD0: d = fetch(); wr(d, pop()); break;
+	case 0xC2: wr_bit(fetch(), 0); break;
+	case 0xC3: set_cy(0); break;
+	case 0xD2: wr_bit(fetch(), 1); break;
+	case 0xD3: set_cy(1); break;
+	case 0xC4: A = (uint8_t)(A << 4 | A >> 4); break;
+	case 0xC5: d = fetch(); v = rd_rmw(d); wr(d, A); A = v; break;
+	case 0xC6: case 0xC7: v = iram[R(op & 1)]; iram[R(op & 1)] = A; A = v; break;
+	case 0xC8 ... 0xCF: v = R(op & 7); R(op & 7) = A; A = v; break;
+	case 0xD4:                                                              // DA A
+		t = A;
+		if ((t & 0x0F) > 9 || (sfr[PSW] & 0x40)) t += 6;
+		if ((t & 0x1F0) > 0x90 || CY) t += 0x60;
+		if (t > 0xFF) set_cy(1);
+		A = (uint8_t)t; break;
+	case 0xD5: d = fetch(); rel = (int8_t)fetch(); v = rd_rmw(d) - 1; wr(d, v); if (v) jump_rel(rel); break;
+	case 0xD6: case 0xD7:                                                   // XCHD
+		v = iram[R(op & 1)];
+		iram[R(op & 1)] = (uint8_t)((v & 0xF0) | (A & 0x0F));
+		A = (uint8_t)((A & 0xF0) | (v & 0x0F)); break;
+	case 0xD8 ... 0xDF: rel = (int8_t)fetch(); if (--R(op & 7)) jump_rel(rel); break;
+	case 0xE0: A = xram[DPTR]; break;
+	case 0xE2: case 0xE3: A = xram[R(op & 1)]; break;
+	case 0xF0: xram[DPTR] = A; break;
+	case 0xF2: case 0xF3: xram[R(op & 1)] = A; break;
+	case 0xE4: A = 0; break;
+	case 0xE5: A = rd(fetch()); break;
+	case 0xE6: case 0xE7: A = iram[R(op & 1)]; break;
+	case 0xE8 ... 0xEF: A = R(op & 7); break;
+	case 0xF4: A = (uint8_t)~A; break;
+	case 0xF5: wr(fetch(), A); break;
+	case 0xF6: case 0xF7: iram[R(op & 1)] = A; break;
+	case 0xF8 ... 0xFF: R(op & 7) = A; break;
+	}
+	tick(cycles[op]);
+	if (op == 0x22 || op == 0x32) frame_pop();
+	if (sym_at[at] >= 0) sym_cycles[sym_at[at]] += cycles[op];
+}
+
+static void take_interrupt(void)
+{
+	int s, level;
+	if (irq_block || !bit_of(IE, 7)) return;
+	for (level = 1; level >= 0; level--) {
+		if (in_service[1] || (level == 0 && in_service[0])) return;
+		for (s = 0; s < S_COUNT; s++) {
+			if (!pending(s) || !enabled(s) || priority(s) != level) continue;
+			if (s == S_IE0 && bit_of(TCON, 0)) set_bit(TCON, 1, 0);   // edge triggered flags cleared on entry
+			if (s == S_IE1 && bit_of(TCON, 2)) set_bit(TCON, 3, 0);
+			if (s == S_TF0) set_bit(TCON, 5, 0);
+			if (s == S_TF1) set_bit(TCON, 7, 0);
+			if (s == S_ADC) set_bit(ADCCON2, 7, 0);
+			push(pc & 0xFF);
+			push(pc >> 8);
+			pc = src_info[s].vector;
+			frame_push(pc, 1);
+			tick(IRQ_ENTRY_CYCLES);
+			if (flag_time[s]) {
+				span_t *l = &latency[s];
+				uint64_t lat = cyc - flag_time[s];
+				if (!l->calls || lat < l->min) l->min = lat;
+				if (lat > l->max) l->max = lat;
+				l->total += lat;
+				l->calls++;
+			}
+			flag_time[s] = 0;
+			in_service[level]++;
+			return;
+		}
+	}
+}
+
+static void report(void)
+{
+	int s, i;
+	unsigned a;
+	double sec = (double)cyc / MCU_CLK_HZ;
+
+	printf("Simulated %.6f s, %llu cycles, %llu instructions, %.1f%% in interrupts\n", sec,
+		(unsigned long long)cyc, (unsigned long long)instructions, cyc ? 100.0 * isr_time / cyc : 0.0);
+
+	if (watch_dac) printf("\nOutput DAC0 crossing mid scale: ");
+	else printf("\nOutput P%d.%d: ", (watch_port - P0) >> 4, watch_bit);
+	if (wave_periods) {
+		double mean = (double)(wave_last - wave_first) / wave_periods;
+		printf("%.4f Hz, period %.2f cycles (min %llu, max %llu, jitter %llu), duty %.2f%%, %lu periods\n",
+			MCU_CLK_HZ / mean, mean, (unsigned long long)wave_min, (unsigned long long)wave_max,
+			(unsigned long long)(wave_max - wave_min), 100.0 * wave_high / (double)(wave_last - wave_first),
+			wave_periods);
+	}
+	else printf("no complete period\n");
+
+	printf("\n%-10s %10s %10s %10s %10s %10s\n", "interrupt", "count", "latency", "min", "max", "jitter");
+	for (s = 0; s < S_COUNT; s++) {
+		span_t *l = &latency[s];
+		if (!l->calls) continue;
+		printf("%-10s %10lu %10.1f %10llu %10llu %10llu\n", src_info[s].name, l->calls, (double)l->total / l->calls,
+			(unsigned long long)l->min, (unsigned long long)l->max, (unsigned long long)(l->max - l->min));
+	}
+
+	printf("\n%-24s %10s %10s %10s %10s   (cycles per call, nested interrupts excluded)\n",
+		"routine", "calls", "mean", "min", "max");
+	for (a = 0; a < 65536; a++) {
+		span_t *r = &routine[a];
+		if (!r->calls) continue;
+		printf("%-24s %10lu %10.1f %10llu %10llu\n", routine_name((uint16_t)a), r->calls, (double)r->total / r->calls,
+			(unsigned long long)r->min, (unsigned long long)r->max);
+	}
+
+	if (nsyms) {
+		printf("\n%-24s %12s %7s\n", "symbol", "cycles", "%");
+		for (i = 0; i < nsyms; i++)
+			if (sym_cycles[i])
+				printf("%-24s %12llu %6.2f%%\n", syms[i].name, (unsigned long long)sym_cycles[i],
+					100.0 * sym_cycles[i] / cyc);
+	}
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-t seconds] [-s seconds] [-p Pn.b|dac] [-m map] [-f Hz] [-i Hz] [-a mV] [-w switches] "
+		"[-b baud] [-u] image.hex\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	double seconds = 1.0, settle = 0;
+	int opt;
+	unsigned port, bitn;
+
+	memset(sym_at, 0xFF, sizeof(sym_at));
+	while ((opt = getopt(argc, argv, "t:s:p:m:f:i:a:w:b:u")) != -1) {
+		switch (opt) {
+		case 't': seconds = atof(optarg); break;
+		case 's': settle = atof(optarg); break;
+		case 'p':
+			if (!strcmp(optarg, "dac")) watch_dac = 1;
+			else if (sscanf(optarg, "P%u.%u", &port, &bitn) == 2 && port < 4 && bitn < 8) {
+				watch_port = P0 + 0x10 * port;
+				watch_bit = bitn;
+			}
+			else usage(argv[0]);
+			break;
+		case 'm': load_map(optarg); break;
+		case 'f': sig_hz = atof(optarg); break;
+		case 'i': int0_hz = atof(optarg); break;
+		case 'a': adc_mv = (unsigned)atoi(optarg); break;
+		case 'w': switches = (uint8_t)strtoul(optarg, NULL, 16); break;
+		case 'b': baud = (unsigned)atoi(optarg); break;
+		case 'u': show_uart = 1; break;
+		default: usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1) usage(argv[0]);
+	load_hex(argv[optind]);
+
+	sfr[SP] = 0x07;
+	sfr[P0] = sfr[P1] = sfr[P2] = sfr[P3] = 0xFF;
+	sfr[SCON] = 0;
+	end_cyc = (uint64_t)(seconds * MCU_CLK_HZ);
+	wave_from = (uint64_t)(settle * MCU_CLK_HZ);
+
+	while (cyc < end_cyc) {
+		step();
+		instructions++;
+		take_interrupt();
+	}
+	if (show_uart) putchar('\n');
+	report();
+	return 0;
+}
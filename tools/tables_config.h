@@ -0,0 +1,39 @@
+//------------------------------------------------------------------------------------------------------
+// tables_config.h - the one description of the hardware that calibration constants and lookup
+// tables are generated from.  Change a value here and run gen_tables (see gen_tables.c) to
+// regenerate the tables in all three projects.
+//------------------------------------------------------------------------------------------------------
+#ifndef TABLES_CONFIG_ALREADY_INCLUDED
+#define TABLES_CONFIG_ALREADY_INCLUDED
+
+// ---- ADXL362 accelerometer, Cortex-M0 SoC ----
+#define ACC_RANGE_G             2           // measurement range set in FILTER_CTL: 2, 4 or 8
+#define ACC_UG_PER_LSB_2G       1000        // 12-bit sensitivity at +-2G, micro-g per LSB (data sheet typical)
+                                            // doubles for each range step; the 8-bit registers hold the top 8 of 12 bits
+#define ACC_LED_COUNT           16          // LEDs in the bar, one lit
+#define ACC_LED_FULL_SCALE_MG   2048        // bar spans -full scale to +full scale in equal steps
+#define ACC_IMPACT_MG           2032        // impact threshold, full scale of the 8-bit registers at +-2G
+
+// ---- ADuC841 measuring instrument ----
+#define MCU_CLK_HZ              11059200UL  // core clock
+#define ADC_REF_MV              2500        // ADC reference
+#define ADC_BITS                12
+#define ADC_RATE_HZ             2023        // Timer 2 triggered conversions a second, shared by the channels in scan mode
+#define GATE_MIN_SHIFT          3           // shortest gate, 2^3 Timer 2 overflows (65536 cycles each), 47 ms
+#define GATE_MAX_SHIFT          7           // longest gate, 2^7 overflows, 0.76 s
+#define GATE_MIN_COUNT          10000       // edges wanted in a gate, the gate doubles until it gets them
+#define COUNT_MAX_HZ            6553500     // highest frequency shown, 6.5535 MHz
+#define PERIOD_GATE_MS          100         // minimum time to average periods over in reciprocal mode
+#define PERIOD_TIMEOUT_MS       3000        // no edge for this long means no signal
+#define PERIOD_BELOW_HZ         1985        // gated result below which periods are timed instead
+#define GATED_ABOVE_HZ          2500        // period result above which edges are counted instead
+
+// ---- ADuC841 signal generator, Task_2 ----
+#define SIG_FREQS_HZ            { 1000, 2000, 3000, 4000, 5000, 6000, 7000, 8000 }   // square wave for switches 0 to 7
+                                                                                      // and DDS coarse frequency
+#define SIG_DDS_SAMPLE_CYCLES   256         // clock cycles per DDS sample (43.2 kHz), must cover the Task_2 ISR budget
+#define SIG_DDS_FINE_HZ         125         // DDS fine step, switches 5:3 add 0 to 7 steps to the coarse frequency
+#define SIG_ARB_WAVE(x)         ((x) < 0.5 ? 4.0 * (x) - 1.0 : 3.0 - 4.0 * (x))    // second DDS table, one period
+                                            // for x from 0 to 1, -1 to +1 full scale (a triangle, edit to suit)
+
+#endif